@@ -6,35 +6,93 @@
 #include "AnalyticsEventAttribute.h"
 //#include "GenericPlatform/GenericPlatformMisc.h"
 #include "HAL/FileManager.h"
+#include "HAL/PlatformTime.h"
 #include "Interfaces/IPv4/IPv4Address.h"
 #include "Misc/CString.h"
 #include "Misc/DefaultValueHelper.h"
 #include "Misc/Guid.h"
 #include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
 #include "Serialization/BufferArchive.h"
 #include "SocketSubsystem.h"
 #include "Sockets.h"
+#include "TCPLoggingLog.h"
 #include "TCPLoggingProvider.h"
-
-DEFINE_LOG_CATEGORY_STATIC(LogTCPLoggingAnalytics, Display, All);
+#include "TCPLoggingSender.h"
+#include "TCPLoggingStats.h"
+
+DEFINE_LOG_CATEGORY(LogTCPLoggingAnalytics);
+
+DEFINE_STAT(STAT_TCPLogging_SerializeEvent);
+DEFINE_STAT(STAT_TCPLogging_SendBatch);
+DEFINE_STAT(STAT_TCPLogging_EventsRecorded);
+DEFINE_STAT(STAT_TCPLogging_EventsSent);
+DEFINE_STAT(STAT_TCPLogging_EventsDropped);
+DEFINE_STAT(STAT_TCPLogging_CriticalEventsRecorded);
+DEFINE_STAT(STAT_TCPLogging_CriticalEventsSent);
+DEFINE_STAT(STAT_TCPLogging_CriticalEventsDropped);
+DEFINE_STAT(STAT_TCPLogging_BytesSent);
+DEFINE_STAT(STAT_TCPLogging_SendCalls);
+DEFINE_STAT(STAT_TCPLogging_StagedEvents);
+DEFINE_STAT(STAT_TCPLogging_BufferedBytes);
+DEFINE_STAT(STAT_TCPLogging_Reconnects);
+DEFINE_STAT(STAT_TCPLogging_RecordToWireMs);
+
+CSV_DEFINE_CATEGORY(TCPLogging, true);
 
 IMPLEMENT_MODULE(FAnalyticsTCPLogging, TCPLogging)
 
 TSharedPtr<IAnalyticsProvider> FAnalyticsProviderTCPLogging::Provider;
 
-FAnalyticsProviderTCPLogging::FAnalyticsProviderTCPLogging(
-	const FString HostName, int32 PortNum, bool bGenerateSession, bool bTimeStamp)
+FAnalyticsProviderTCPLogging::FAnalyticsProviderTCPLogging(const FString HostName, int32 PortNum, bool bGenerateSession,
+	bool bTimeStamp, const FTCPLoggingSenderSettings& InSenderSettings)
+	: BufferPool(MaxPooledChunks, InSenderSettings.StagingChunkBytes + MessageBufferSize,
+		  FMath::Max(MaxPooledMessageBufferSize, InSenderSettings.StagingChunkBytes + MessageBufferSize),
+		  GetSlabChunks(InSenderSettings))
+	, Staging(BufferPool, InSenderSettings.StagingChunkBytes, InSenderSettings.MaxStagedBytesPerThread,
+		  InSenderSettings.MaxCriticalStagedBytesPerThread, InSenderSettings.OverflowPolicy, InSenderSettings.OverflowBlockSeconds)
+	, NextSuppressedSummaryCycles(0)
+	, NextDropLogCycles(0)
+	, TimestampEpochOffsetUs(0)
+	, MicrosecondsPerCycle(FPlatformTime::GetSecondsPerCycle64() * 1e6)
+	, Metrics(MetricsIntervalSeconds, [this](TArray<FTCPLoggingMetricSnapshot>&& Snapshots, double IntervalSeconds) {
+		RecordMetrics(MoveTemp(Snapshots), IntervalSeconds);
+	})
 {
 	UE_LOG(LogTCPLoggingAnalytics, Verbose, TEXT("Initializing TCP Analytics provider"));
 
+	bHasSessionStarted = false;
 	Host = HostName;
 	Port = PortNum;
 	bGenerateSessionGuid = bGenerateSession;
 	bTimeStampEvents = bTimeStamp;
+	SenderSettings = InSenderSettings;
 
 	UserId = FPlatformMisc::GetLoginId();
 
-	Socket = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateSocket(NAME_Stream, TEXT("default"), false);
+	for (int32 Lane = 0; Lane < TCPLoggingNumLanes; ++Lane)
+	{
+		ReportedDroppedCounts[Lane].store(0, std::memory_order_relaxed);
+		LoggedDroppedCounts[Lane].store(0, std::memory_order_relaxed);
+	}
+	// Metrics recorded before the session starts are kept for its first interval rather than flushed to nowhere
+	Metrics.SetPaused(true);
+	if (BufferPool.HasSlab())
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Log, TEXT("Analytics staging preallocated (%lld) bytes, overflow policy (%s)"),
+			BufferPool.GetSlabBytes(), LexToString(SenderSettings.OverflowPolicy));
+	}
+}
+
+int32 FAnalyticsProviderTCPLogging::GetSlabChunks(const FTCPLoggingSenderSettings& InSenderSettings)
+{
+	if (InSenderSettings.StagingBudgetBytes <= 0)
+	{
+		return 0;
+	}
+	// Every lane of a recording thread holds at least the chunk it is filling
+	return FMath::Max(InSenderSettings.StagingBudgetBytes / (InSenderSettings.StagingChunkBytes + MessageBufferSize),
+		TCPLoggingNumLanes);
 }
 
 void FAnalyticsTCPLogging::StartupModule()
@@ -47,6 +105,23 @@ void FAnalyticsTCPLogging::ShutdownModule()
 	FAnalyticsProviderTCPLogging::Destroy();
 }
 
+FTCPLoggingMetrics* FAnalyticsTCPLogging::GetMetrics()
+{
+	FAnalyticsProviderTCPLogging* Provider = static_cast<FAnalyticsProviderTCPLogging*>(FAnalyticsProviderTCPLogging::Provider.Get());
+	return Provider != nullptr ? &Provider->GetMetrics() : nullptr;
+}
+
+/** Reads an optional positive integer setting, anything missing or malformed keeps the default */
+static int32 GetConfigInt(const FAnalyticsProviderConfigurationDelegate& GetConfigValue, const TCHAR* Key, int32 DefaultValue)
+{
+	int32 Value;
+	if (FDefaultValueHelper::ParseInt(GetConfigValue.Execute(Key, false), Value) && Value > 0)
+	{
+		return Value;
+	}
+	return DefaultValue;
+}
+
 TSharedPtr<IAnalyticsProvider> FAnalyticsTCPLogging::CreateAnalyticsProvider(
 	const FAnalyticsProviderConfigurationDelegate& GetConfigValue) const
 {
@@ -57,11 +132,85 @@ TSharedPtr<IAnalyticsProvider> FAnalyticsTCPLogging::CreateAnalyticsProvider(
 		const bool bGenerateSessionGuid = GetConfigValue.Execute(TEXT("TCPLoggingGenerateSessionGuid"), true).ToBool();
 		const bool bTimeStampEvents = GetConfigValue.Execute(TEXT("TCPLoggingTimeStampEvents"), true).ToBool();
 
+		FTCPLoggingSenderSettings SenderSettings;
+		SenderSettings.MaxBatchBytes = GetConfigInt(GetConfigValue, TEXT("TCPLoggingBatchMaxBytes"), SenderSettings.MaxBatchBytes);
+		SenderSettings.MaxBatchEvents = GetConfigInt(GetConfigValue, TEXT("TCPLoggingBatchMaxEvents"), SenderSettings.MaxBatchEvents);
+		const int32 MaxBatchLatencyMs = GetConfigInt(GetConfigValue, TEXT("TCPLoggingBatchMaxLatencyMs"), 250);
+		SenderSettings.MaxBatchLatencySeconds = MaxBatchLatencyMs / 1000.0;
+		SenderSettings.SendBufferBytes = GetConfigInt(GetConfigValue, TEXT("TCPLoggingSendBufferBytes"), SenderSettings.SendBufferBytes);
+		SenderSettings.CriticalSendBufferBytes =
+			GetConfigInt(GetConfigValue, TEXT("TCPLoggingCriticalSendBufferBytes"), SenderSettings.CriticalSendBufferBytes);
+		SenderSettings.StagingBudgetBytes =
+			GetConfigInt(GetConfigValue, TEXT("TCPLoggingStagingBudgetBytes"), SenderSettings.StagingBudgetBytes);
+		const FString OverflowPolicyText = GetConfigValue.Execute(TEXT("TCPLoggingOverflowPolicy"), false);
+		if (!OverflowPolicyText.IsEmpty() && !LexTryParseString(SenderSettings.OverflowPolicy, *OverflowPolicyText))
+		{
+			UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Unknown TCPLoggingOverflowPolicy (%s), dropping new events"),
+				*OverflowPolicyText);
+		}
+		const int32 OverflowBlockMs = GetConfigInt(GetConfigValue, TEXT("TCPLoggingOverflowBlockMs"), 5);
+		SenderSettings.OverflowBlockSeconds = OverflowBlockMs / 1000.0;
+		const int32 ConnectTimeoutMs = GetConfigInt(GetConfigValue, TEXT("TCPLoggingConnectTimeoutMs"), 5000);
+		SenderSettings.ConnectTimeoutSeconds = ConnectTimeoutMs / 1000.0;
+		SenderSettings.HostCacheSeconds = GetConfigInt(GetConfigValue, TEXT("TCPLoggingHostCacheSeconds"), 300);
+		const int32 ReconnectMaxDelayMs = GetConfigInt(GetConfigValue, TEXT("TCPLoggingReconnectMaxDelayMs"), 30000);
+		SenderSettings.ReconnectMaxDelaySeconds = ReconnectMaxDelayMs / 1000.0;
+		SenderSettings.bAcknowledge = GetConfigValue.Execute(TEXT("TCPLoggingAcknowledge"), false).ToBool();
+		SenderSettings.AckWindowFrames =
+			GetConfigInt(GetConfigValue, TEXT("TCPLoggingAckWindowFrames"), SenderSettings.AckWindowFrames);
+		const int32 AckTimeoutMs = GetConfigInt(GetConfigValue, TEXT("TCPLoggingAckTimeoutMs"), 10000);
+		SenderSettings.AckTimeoutSeconds = AckTimeoutMs / 1000.0;
+		const FString ProtocolText = GetConfigValue.Execute(TEXT("TCPLoggingProtocol"), false);
+		if (!ProtocolText.IsEmpty() && !LexTryParseString(SenderSettings.PayloadFormat, *ProtocolText))
+		{
+			UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Unknown TCPLoggingProtocol (%s), sending JSON"), *ProtocolText);
+		}
+		const FString CompressionText = GetConfigValue.Execute(TEXT("TCPLoggingCompression"), false);
+		if (!CompressionText.IsEmpty() && !LexTryParseString(SenderSettings.Compression, *CompressionText))
+		{
+			UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Unknown TCPLoggingCompression (%s), sending uncompressed"), *CompressionText);
+		}
+		const FString EndpointsText = GetConfigValue.Execute(TEXT("TCPLoggingEndpoints"), false);
+		if (!TCPLoggingParseEndpoints(EndpointsText, SenderSettings.Endpoints))
+		{
+			UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Ignoring malformed entries of TCPLoggingEndpoints (%s)"), *EndpointsText);
+		}
+		const FString BalancingText = GetConfigValue.Execute(TEXT("TCPLoggingBalancing"), false);
+		if (!BalancingText.IsEmpty() && !LexTryParseString(SenderSettings.Balancing, *BalancingText))
+		{
+			UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Unknown TCPLoggingBalancing (%s), hashing sessions"), *BalancingText);
+		}
+		SenderSettings.MaxConnections = GetConfigInt(GetConfigValue, TEXT("TCPLoggingMaxConnections"), SenderSettings.MaxConnections);
+		const FString TransportText = GetConfigValue.Execute(TEXT("TCPLoggingTransport"), false);
+		if (!TransportText.IsEmpty() && !LexTryParseString(SenderSettings.Transport, *TransportText))
+		{
+			UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Unknown TCPLoggingTransport (%s), sending over TCP"), *TransportText);
+		}
+		SenderSettings.MaxDatagramBytes =
+			FMath::Max(GetConfigInt(GetConfigValue, TEXT("TCPLoggingMaxDatagramBytes"), SenderSettings.MaxDatagramBytes), 256);
+		SenderSettings.bSessionEnvelope = GetConfigValue.Execute(TEXT("TCPLoggingSessionEnvelope"), false).ToBool();
+		SenderSettings.bSpoolEnabled = GetConfigValue.Execute(TEXT("TCPLoggingSpoolEnabled"), false).ToBool();
+		SenderSettings.SpoolDirectory = GetConfigValue.Execute(TEXT("TCPLoggingSpoolDirectory"), false);
+		if (SenderSettings.SpoolDirectory.IsEmpty())
+		{
+			SenderSettings.SpoolDirectory = FPaths::ProjectSavedDir() / TEXT("TCPLogging") / TEXT("Spool");
+		}
+		SenderSettings.SpoolMaxBytes = (int64) GetConfigInt(GetConfigValue, TEXT("TCPLoggingSpoolMaxMB"), 64) * 1024 * 1024;
+
+		const FString EventPolicies = GetConfigValue.Execute(TEXT("TCPLoggingEventPolicies"), false);
+
 		int32 Port;
 
 		if (FDefaultValueHelper::ParseInt(PortText, Port))
 		{
-			return FAnalyticsProviderTCPLogging::Create(HostName, Port, bGenerateSessionGuid, bTimeStampEvents);
+			// Every call shares one instance unless asked for a separate one, e.g. to simulate several clients
+			const FString SeparateInstanceText = GetConfigValue.Execute(TEXT("TCPLoggingSeparateInstance"), false);
+			TSharedPtr<IAnalyticsProvider> Provider = SeparateInstanceText.ToBool()
+				? FAnalyticsProviderTCPLogging::CreateInstance(HostName, Port, bGenerateSessionGuid, bTimeStampEvents, SenderSettings)
+				: FAnalyticsProviderTCPLogging::Create(HostName, Port, bGenerateSessionGuid, bTimeStampEvents, SenderSettings);
+			// Reapplied whenever the provider is requested again, which is how a changed config takes effect at runtime
+			StaticCastSharedPtr<FAnalyticsProviderTCPLogging>(Provider)->SetEventPolicies(EventPolicies);
+			return Provider;
 		}
 		else
 		{
@@ -88,6 +237,7 @@ FAnalyticsProviderTCPLogging::~FAnalyticsProviderTCPLogging()
 
 bool FAnalyticsProviderTCPLogging::StartSession(const TArray<FAnalyticsEventAttribute>& Attributes)
 {
+	FScopeLock Lock(&SessionLock);
 	if (bHasSessionStarted)
 	{
 		EndSession();
@@ -103,82 +253,92 @@ bool FAnalyticsProviderTCPLogging::StartSession(const TArray<FAnalyticsEventAttr
 		// UserId = FPlatformMisc::GetLoginId();
 	}
 
-	Socket = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateSocket(NAME_Stream, TEXT("default"), false);
-	ISocketSubsystem* SocketSubSystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	// The wall clock is read once per session, every event after that only reads the cycle counter
+	const uint64 BaseCycles = FPlatformTime::Cycles64();
+	const int64 BaseEpochUs = (FDateTime::UtcNow() - FDateTime(1970, 1, 1)).GetTicks() / ETimespan::TicksPerMicrosecond;
+	TimestampEpochOffsetUs.store(BaseEpochUs - (int64) ((double) BaseCycles * MicrosecondsPerCycle), std::memory_order_relaxed);
 
-	const char* HostChar = TCHAR_TO_ANSI(*Host);
-	auto ResolveInfo = SocketSubSystem->GetHostByName(HostChar);
-	while (!ResolveInfo->IsComplete())
-		;
+	TArray<uint8> SessionStart;
+	SerializeMessage(SessionStart, [&](auto& Writer) {
+		Writer.BeginObject();
+		Writer.WriteAsciiString("eventName", "Session.Start");
+		if (bGenerateSessionGuid)
+		{
+			Writer.WriteString("sessionId", SessionId);
+			Writer.WriteString("deviceId", DeviceId);
+		}
+		if (bTimeStampEvents)
+		{
+			// The readable form is kept for existing collectors, it is only formatted once per session
+			Writer.WriteString("timestamp", FDateTime::Now().ToString());
+		}
+		WriteTimestamp(Writer);
+		Writer.WriteString("userId", UserId);
+		if (Attributes.Num() > 0)
+		{
+			Writer.WriteAttributes(Attributes);
+		}
+		Writer.EndObject();
+	});
 
-	if (ResolveInfo->GetErrorCode() == 0)
+	// The identity cannot change during a session, so it is serialized here once instead of by every recorded event
+	TArray<uint8> Envelope;
+	if (SenderSettings.bSessionEnvelope)
 	{
-		const FInternetAddr* Addr = &ResolveInfo->GetResolvedAddress();
-		uint32 OutIP = 0;
-		Addr->GetIp(OutIP);
-
-		UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("IP is %d.%d.%d.%d: "), 0xff & (OutIP >> 24), 0xff & (OutIP >> 16),
-			0xff & (OutIP >> 8), 0xff & OutIP);
-
-		TSharedRef<FInternetAddr> Address = SocketSubSystem->CreateInternetAddr();
-		Address->SetIp(OutIP);
-		Address->SetPort(Port);
-		bHasSessionStarted = Socket->Connect(*Address);
-
-		if (bHasSessionStarted)
-		{
-			FString message = FString::Printf(TEXT("{"));
-			message.Append(FString::Printf(TEXT("\"eventName\" : \"Session.Start\",")));
-			if (bGenerateSessionGuid)
+		auto WriteIdentity = [&](auto& Writer) {
+			if (!SessionId.IsEmpty())
 			{
-				message.Append(FString::Printf(TEXT("\"sessionId\" : \"%s\","), *SessionId));
-				message.Append(FString::Printf(TEXT("\"deviceId\" : \"%s\","), *DeviceId));
+				Writer.WriteString("sessionId", SessionId);
 			}
-			if (bTimeStampEvents)
+			if (!DeviceId.IsEmpty())
 			{
-				message.Append(FString::Printf(TEXT("\"timestamp\" : \"%s\","), *FDateTime::Now().ToString()));
+				Writer.WriteString("deviceId", DeviceId);
 			}
-			message.Append(FString::Printf(TEXT("\"userId\" : \"%s\""), *UserId));
-
-			if (Attributes.Num() > 0)
+			if (!UserId.IsEmpty())
 			{
-				message.Append(FString::Printf(TEXT(",\"attributes\" : [")));
-				bool bHasWrittenFirstAttr = false;
-				// Write out the list of attributes as an array of attribute objects
-				for (auto Attr : Attributes)
-				{
-					if (bHasWrittenFirstAttr)
-					{
-						message + FString::Printf(TEXT(","));
-					}
-					message.Append(FString::Printf(TEXT("{")));
-					message.Append(FString::Printf(TEXT("\"name\" : \"%s\","), *Attr.GetName()));
-					if (Attr.GetValue().IsNumeric())
-					{
-						message.Append(FString::Printf(TEXT("\"value\" : %s"), *Attr.GetValue()));
-					}
-					else
-					{
-						message.Append(FString::Printf(TEXT("\"value\" : \"%s\""), *Attr.GetValue()));
-					}
-					message.Append(FString::Printf(TEXT("}")));
-					bHasWrittenFirstAttr = true;
-				}
-				message.Append(FString::Printf(TEXT("]")));
+				Writer.WriteString("userId", UserId);
 			}
-			message.Append(FString::Printf(TEXT("}\n")));
-
-			SendJSON(message);
+		};
+		if (SenderSettings.PayloadFormat == ETCPLoggingPayloadFormat::Binary)
+		{
+			FTCPLoggingBinaryWriter::SerializeFields(Envelope, WriteIdentity);
+		}
+		else
+		{
+			FTCPLoggingJsonWriter::SerializeFields(Envelope, WriteIdentity);
 		}
 	}
+
+	// Resolve and connect happen on the sender thread, events recorded meanwhile wait in its queue.
+	// Session.Start is sent first on every connection so the collector can attribute replayed events after a reconnect
+	// Whatever raced the end of the previous session belongs to no session
+	Staging.Reset();
+	TArray<FTCPLoggingEndpoint> Endpoints = SenderSettings.Endpoints;
+	if (Endpoints.Num() == 0)
+	{
+		Endpoints.Add(FTCPLoggingEndpoint{Host, Port});
+	}
+	// Sessions without an id of their own still land on the same collector every time for the same user
+	const FString& SessionKey = SessionId.IsEmpty() ? UserId : SessionId;
+	Sender = MakeUnique<FTCPLoggingSender>(MoveTemp(Endpoints), SessionKey, MoveTemp(SessionStart), MoveTemp(Envelope), Staging,
+		SenderSettings);
+	bHasSessionStarted = true;
+	Metrics.SetPaused(false);
+
 	return bHasSessionStarted;
 }
 
 void FAnalyticsProviderTCPLogging::EndSession()
 {
-	if (Socket != nullptr)
+	FScopeLock Lock(&SessionLock);
+	if (Sender.IsValid())
 	{
-		Socket->Close();
+		RecordSuppressedSummary();
+		// Automatic flushes stop first, so none can land after the session is gone and lose its metrics
+		Metrics.SetPaused(true);
+		Metrics.Flush();
+		// Joins the sender thread once everything already queued has been written and closes the connection
+		Sender.Reset();
 		UE_LOG(LogTCPLoggingAnalytics, Display, TEXT("Session ended for user (%s) and session id (%s)"), *UserId, *SessionId);
 	}
 
@@ -187,9 +347,124 @@ void FAnalyticsProviderTCPLogging::EndSession()
 
 void FAnalyticsProviderTCPLogging::FlushEvents()
 {
-	if (Socket != nullptr)
+	FScopeLock Lock(&SessionLock);
+	if (Sender.IsValid())
+	{
+		Metrics.Flush();
+		switch (Sender->Flush(FlushTimeoutSeconds))
+		{
+			case ETCPLoggingFlushResult::Flushed:
+				UE_LOG(LogTCPLoggingAnalytics, Display, TEXT("Analytics socket flushed"));
+				break;
+			case ETCPLoggingFlushResult::TimedOut:
+				UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Timed out flushing analytics socket"));
+				break;
+			case ETCPLoggingFlushResult::NotConnected:
+				UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Analytics socket not connected, events stay buffered until it is"));
+				break;
+		}
+	}
+}
+
+FTCPLoggingSocketWriterStats FAnalyticsProviderTCPLogging::GetSocketStats() const
+{
+	FScopeLock Lock(&SessionLock);
+	return Sender.IsValid() ? Sender->GetSocketStats() : FTCPLoggingSocketWriterStats();
+}
+
+void FAnalyticsProviderTCPLogging::SetEventPolicies(const FString& PolicyText)
+{
+	TMap<FString, FTCPLoggingEventPolicy> Policies;
+	TCPLoggingParseEventPolicies(PolicyText, Policies);
+	EventThrottle.SetPolicies(Policies);
+}
+
+void FAnalyticsProviderTCPLogging::RecordSuppressedSummaryIfDue()
+{
+	const uint64 Now = FPlatformTime::Cycles64();
+	uint64 Due = NextSuppressedSummaryCycles.load(std::memory_order_relaxed);
+	if (Now < Due)
+	{
+		return;
+	}
+
+	const uint64 Next = Now + (uint64) (SuppressedSummaryIntervalSeconds / FPlatformTime::GetSecondsPerCycle64());
+	if (NextSuppressedSummaryCycles.compare_exchange_strong(Due, Next, std::memory_order_relaxed))
+	{
+		RecordSuppressedSummary();
+	}
+}
+
+void FAnalyticsProviderTCPLogging::LogDroppedEventsIfDue()
+{
+	const uint64 Now = FPlatformTime::Cycles64();
+	uint64 Due = NextDropLogCycles.load(std::memory_order_relaxed);
+	if (Now < Due)
+	{
+		return;
+	}
+
+	const uint64 Next = Now + (uint64) (DropLogIntervalSeconds / FPlatformTime::GetSecondsPerCycle64());
+	if (!NextDropLogCycles.compare_exchange_strong(Due, Next, std::memory_order_relaxed))
+	{
+		return;
+	}
+
+	const uint64 Critical = Staging.GetDroppedCount(ETCPLoggingLane::Critical);
+	const uint64 CriticalLogged =
+		LoggedDroppedCounts[(int32) ETCPLoggingLane::Critical].exchange(Critical, std::memory_order_relaxed);
+	if (Critical > CriticalLogged)
+	{
+		// Bulk traffic only causes this by using up a staging budget whose overflow policy does not favor critical events
+		UE_LOG(LogTCPLoggingAnalytics, Error, TEXT("Analytics critical staging is full, dropped (%llu) events"),
+			Critical - CriticalLogged);
+	}
+	const uint64 Bulk = Staging.GetDroppedCount(ETCPLoggingLane::Bulk);
+	const uint64 BulkLogged = LoggedDroppedCounts[(int32) ETCPLoggingLane::Bulk].exchange(Bulk, std::memory_order_relaxed);
+	if (Bulk > BulkLogged)
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Analytics staging is full, dropped (%llu) events"), Bulk - BulkLogged);
+	}
+}
+
+void FAnalyticsProviderTCPLogging::RecordSuppressedSummary()
+{
+	uint64 StagingDropped[TCPLoggingNumLanes];
+	bool bAnyDropped = false;
+	for (int32 Lane = 0; Lane < TCPLoggingNumLanes; ++Lane)
 	{
-		UE_LOG(LogTCPLoggingAnalytics, Display, TEXT("Analytics socket flushed"));
+		// Exchanged so racing summaries never report the same drops twice
+		const uint64 Total = Staging.GetDroppedCount((ETCPLoggingLane) Lane);
+		StagingDropped[Lane] = Total - ReportedDroppedCounts[Lane].exchange(Total, std::memory_order_relaxed);
+		bAnyDropped |= StagingDropped[Lane] > 0;
+	}
+	if (bAnyDropped)
+	{
+		// Critical, so the report of an overload is not shed by the same overload
+		RecordMessage(ETCPLoggingLane::Critical, [&](auto& Writer) {
+			Writer.BeginObject();
+			WriteTimestamp(Writer);
+			Writer.WriteAsciiString("eventName", "TCPLogging.EventsDropped");
+			Writer.WriteInteger("critical", (int64) StagingDropped[(int32) ETCPLoggingLane::Critical]);
+			Writer.WriteInteger("bulk", (int64) StagingDropped[(int32) ETCPLoggingLane::Bulk]);
+			Writer.WriteString("overflowPolicy", FString(LexToString(SenderSettings.OverflowPolicy)));
+			Writer.EndObject();
+		});
+	}
+
+	TArray<FTCPLoggingSuppressedEvents> Suppressed;
+	EventThrottle.TakeSuppressedEvents(Suppressed);
+	for (const FTCPLoggingSuppressedEvents& Counts : Suppressed)
+	{
+		RecordMessage(ETCPLoggingLane::Bulk, [&](auto& Writer) {
+			Writer.BeginObject();
+			WriteTimestamp(Writer);
+			Writer.WriteAsciiString("eventName", "TCPLogging.EventsSuppressed");
+			Writer.WriteString("suppressedEventName", Counts.EventName);
+			Writer.WriteInteger("sampledOut", (int64) Counts.SampledOut);
+			Writer.WriteInteger("rateLimited", (int64) Counts.RateLimited);
+			Writer.EndObject();
+		});
 	}
 }
 
@@ -234,46 +509,104 @@ bool FAnalyticsProviderTCPLogging::SetSessionID(const FString& InSessionID)
 	return !bHasSessionStarted;
 }
 
-void FAnalyticsProviderTCPLogging::RecordEvent(const FString& EventName, const TArray<FAnalyticsEventAttribute>& Attributes)
+static const char* GetMetricTypeName(ETCPLoggingMetricType Type)
 {
-	if (bHasSessionStarted)
+	switch (Type)
 	{
-		check(Socket != nullptr);
+		case ETCPLoggingMetricType::Gauge:
+			return "gauge";
+		case ETCPLoggingMetricType::Histogram:
+			return "histogram";
+		default:
+			return "counter";
+	}
+}
 
-		FString message = FString::Printf(TEXT("{"));
-		message.Append(FString::Printf(TEXT("\"eventName\" : \"%s\""), *EventName));
-		if (Attributes.Num() > 0)
-		{
-			message.Append(FString::Printf(TEXT(",\"attributes\" : [")));
-			bool bHasWrittenFirstAttr = false;
-			// Write out the list of attributes as an array of attribute objects
-			for (auto Attr : Attributes)
+void FAnalyticsProviderTCPLogging::RecordMetrics(TArray<FTCPLoggingMetricSnapshot>&& Snapshots, double IntervalSeconds)
+{
+	if (!bHasSessionStarted)
+	{
+		return;
+	}
+
+	for (int32 First = 0; First < Snapshots.Num(); First += MaxMetricsPerEvent)
+	{
+		const int32 Last = FMath::Min(First + MaxMetricsPerEvent, Snapshots.Num());
+		RecordMessage(ETCPLoggingLane::Bulk, [&](auto& Writer) {
+			Writer.BeginObject();
+			WriteTimestamp(Writer);
+			Writer.WriteAsciiString("eventName", "TCPLogging.Metrics");
+			Writer.WriteDouble("intervalSeconds", IntervalSeconds);
+			Writer.BeginArray("metrics");
+			for (int32 Index = First; Index < Last; ++Index)
 			{
-				if (bHasWrittenFirstAttr)
+				const FTCPLoggingMetricSnapshot& Snapshot = Snapshots[Index];
+				Writer.BeginObject();
+				Writer.WriteString("name", Snapshot.Name.ToString());
+				Writer.WriteAsciiString("type", GetMetricTypeName(Snapshot.Type));
+				if (Snapshot.Tags.Num() > 0)
 				{
-					message.Append(FString::Printf(TEXT("\t\t\t,")));
-				}
-				message.Append(FString::Printf(TEXT("{")));
-				message.Append(FString::Printf(TEXT("\"name\" : \"%s\","), *Attr.GetName()));
-				if (Attr.GetValue().IsNumeric())
-				{
-					message.Append(FString::Printf(TEXT("\"value\" : %s"), *Attr.GetValue()));
+					Writer.BeginArray("tags");
+					for (const FTCPLoggingMetricTag& Tag : Snapshot.Tags)
+					{
+						Writer.BeginObject();
+						Writer.WriteString("name", Tag.Key.ToString());
+						Writer.WriteString("value", Tag.Value.ToString());
+						Writer.EndObject();
+					}
+					Writer.EndArray();
 				}
-				else
+				switch (Snapshot.Type)
 				{
-					message.Append(FString::Printf(TEXT("\"value\" : \"%s\""), *Attr.GetValue()));
+					case ETCPLoggingMetricType::Counter:
+						Writer.WriteInteger("count", Snapshot.Count);
+						break;
+					case ETCPLoggingMetricType::Gauge:
+						Writer.WriteDouble("value", Snapshot.Value);
+						break;
+					case ETCPLoggingMetricType::Histogram:
+						Writer.WriteInteger("count", Snapshot.Count);
+						Writer.WriteDouble("sum", Snapshot.Value);
+						Writer.WriteDouble("min", Snapshot.Min);
+						Writer.WriteDouble("max", Snapshot.Max);
+						Writer.WriteDouble("p50", Snapshot.P50);
+						Writer.WriteDouble("p90", Snapshot.P90);
+						Writer.WriteDouble("p99", Snapshot.P99);
+						Writer.WriteDouble("p999", Snapshot.P999);
+						break;
 				}
-				message.Append(FString::Printf(TEXT("}")));
-				bHasWrittenFirstAttr = true;
+				Writer.EndObject();
 			}
-			message.Append(FString::Printf(TEXT("]")));
+			Writer.EndArray();
+			Writer.EndObject();
+		});
+	}
+}
+
+template <typename AttributesType>
+void FAnalyticsProviderTCPLogging::RecordEventWithAttributes(const FString& EventName, const AttributesType& Attributes)
+{
+	if (bHasSessionStarted)
+	{
+		RecordSuppressedSummaryIfDue();
+		if (!EventThrottle.Admit(EventName))
+		{
+			return;
 		}
-		message.Append(FString::Printf(TEXT("}\n")));
 
-		UE_LOG(LogTCPLoggingAnalytics, Display, TEXT("Analytics event (%s) written with (%d) attributes"), *EventName,
-			Attributes.Num());
+		RecordMessage(ETCPLoggingLane::Bulk, [&](auto& Writer) {
+			Writer.BeginObject();
+			WriteTimestamp(Writer);
+			Writer.WriteString("eventName", EventName);
+			if (Attributes.Num() > 0)
+			{
+				Writer.WriteAttributes(Attributes);
+			}
+			Writer.EndObject();
+		});
 
-		SendJSON(message);
+		UE_LOG(LogTCPLoggingAnalytics, VeryVerbose, TEXT("Analytics event (%s) written with (%d) attributes"), *EventName,
+			Attributes.Num());
 	}
 	else
 	{
@@ -282,31 +615,35 @@ void FAnalyticsProviderTCPLogging::RecordEvent(const FString& EventName, const T
 	}
 }
 
+void FAnalyticsProviderTCPLogging::RecordEvent(const FString& EventName, const TArray<FAnalyticsEventAttribute>& Attributes)
+{
+	RecordEventWithAttributes(EventName, Attributes);
+}
+
+void FAnalyticsProviderTCPLogging::RecordEvent(const FString& EventName, std::initializer_list<FTCPLoggingAttribute> Attributes)
+{
+	RecordEventWithAttributes(EventName, MakeArrayView(Attributes));
+}
+
 void FAnalyticsProviderTCPLogging::RecordItemPurchase(
 	const FString& ItemId, const FString& Currency, int PerItemCost, int ItemQuantity)
 {
 	if (bHasSessionStarted)
 	{
-		check(Socket != nullptr);
-
-		FString message = FString::Printf(TEXT("{"));
-		message.Append(FString::Printf(TEXT("\"eventName\" : \"recordItemPurchase\",")));
-
-		message.Append(FString::Printf(TEXT("\"attributes\" :")));
-		message.Append(FString::Printf(TEXT("[")));
-
-		message.Append(FString::Printf(TEXT("{ \"name\" : \"itemId\", \t\"value\" : \"%s\" },"), *ItemId));
-		message.Append(FString::Printf(TEXT("{ \"name\" : \"currency\", \t\"value\" : \"%s\" },"), *Currency));
-		message.Append(FString::Printf(TEXT("{ \"name\" : \"perItemCost\", \t\"value\" : \"%d\" },"), PerItemCost));
-		message.Append(FString::Printf(TEXT("{ \"name\" : \"itemQuantity\", \t\"value\" : \"%d\" }"), ItemQuantity));
-
-		message.Append(FString::Printf(TEXT("]")));
-
-		message.Append(FString::Printf(TEXT("}\n")));
-
-		SendJSON(message);
-
-		UE_LOG(LogTCPLoggingAnalytics, Display, TEXT("(%d) number of item (%s) purchased with (%s) at a cost of (%d) each"),
+		RecordMessage(ETCPLoggingLane::Critical, [&](auto& Writer) {
+			Writer.BeginObject();
+			WriteTimestamp(Writer);
+			Writer.WriteAsciiString("eventName", "recordItemPurchase");
+			Writer.BeginArray("attributes");
+			Writer.WriteStringAttribute("itemId", ItemId);
+			Writer.WriteStringAttribute("currency", Currency);
+			Writer.WriteIntegerAttribute("perItemCost", PerItemCost);
+			Writer.WriteIntegerAttribute("itemQuantity", ItemQuantity);
+			Writer.EndArray();
+			Writer.EndObject();
+		});
+
+		UE_LOG(LogTCPLoggingAnalytics, VeryVerbose, TEXT("(%d) number of item (%s) purchased with (%s) at a cost of (%d) each"),
 			ItemQuantity, *ItemId, *Currency, PerItemCost);
 	}
 	else
@@ -321,26 +658,21 @@ void FAnalyticsProviderTCPLogging::RecordCurrencyPurchase(const FString& GameCur
 {
 	if (bHasSessionStarted)
 	{
-		check(Socket != nullptr);
-
-		FString message = FString::Printf(TEXT("{"));
-		message.Append(FString::Printf(TEXT("\"eventName\" : \"recordCurrencyPurchase\",")));
-
-		message.Append(FString::Printf(TEXT("\"attributes\" :")));
-		message.Append(FString::Printf(TEXT("[")));
-
-		message.Append(FString::Printf(TEXT("{ \"name\" : \"gameCurrencyType\", \t\"value\" : \"%s\" },"), *GameCurrencyType));
-		message.Append(FString::Printf(TEXT("{ \"name\" : \"gameCurrencyAmount\", \t\"value\" : \"%d\" },"), GameCurrencyAmount));
-		message.Append(FString::Printf(TEXT("{ \"name\" : \"realCurrencyType\", \t\"value\" : \"%s\" },"), *RealCurrencyType));
-		message.Append(FString::Printf(TEXT("{ \"name\" : \"realMoneyCost\", \t\"value\" : \"%f\" },"), RealMoneyCost));
-		message.Append(FString::Printf(TEXT("{ \"name\" : \"paymentProvider\", \t\"value\" : \"%s\" }"), *PaymentProvider));
-
-		message.Append(FString::Printf(TEXT("]")));
-
-		message.Append(FString::Printf(TEXT("}")));
-		SendJSON(message);
-
-		UE_LOG(LogTCPLoggingAnalytics, Display,
+		RecordMessage(ETCPLoggingLane::Critical, [&](auto& Writer) {
+			Writer.BeginObject();
+			WriteTimestamp(Writer);
+			Writer.WriteAsciiString("eventName", "recordCurrencyPurchase");
+			Writer.BeginArray("attributes");
+			Writer.WriteStringAttribute("gameCurrencyType", GameCurrencyType);
+			Writer.WriteIntegerAttribute("gameCurrencyAmount", GameCurrencyAmount);
+			Writer.WriteStringAttribute("realCurrencyType", RealCurrencyType);
+			Writer.WriteFloatAttribute("realMoneyCost", RealMoneyCost);
+			Writer.WriteStringAttribute("paymentProvider", PaymentProvider);
+			Writer.EndArray();
+			Writer.EndObject();
+		});
+
+		UE_LOG(LogTCPLoggingAnalytics, VeryVerbose,
 			TEXT("(%d) amount of in game currency (%s) purchased with (%s) at a cost of (%f) each"), GameCurrencyAmount,
 			*GameCurrencyType, *RealCurrencyType, RealMoneyCost);
 	}
@@ -355,26 +687,18 @@ void FAnalyticsProviderTCPLogging::RecordCurrencyGiven(const FString& GameCurren
 {
 	if (bHasSessionStarted)
 	{
-		check(Socket != nullptr);
-
-		FString message = FString::Printf(TEXT("\t\t{"));
-		message.Append(FString::Printf(TEXT("\t\t\t\"eventName\" : \"recordCurrencyGiven\",")));
-
-		message.Append(FString::Printf(TEXT("\t\t\t\"attributes\" :")));
-		message.Append(FString::Printf(TEXT("\t\t\t[")));
-
-		message.Append(
-			FString::Printf(TEXT("\t\t\t\t{ \"name\" : \"gameCurrencyType\", \t\"value\" : \"%s\" },"), *GameCurrencyType));
-		message.Append(
-			FString::Printf(TEXT("\t\t\t\t{ \"name\" : \"gameCurrencyAmount\", \t\"value\" : \"%d\" }"), GameCurrencyAmount));
-
-		message.Append(FString::Printf(TEXT("\t\t\t]")));
-
-		message.Append(FString::Printf(TEXT("\t\t}")));
-
-		SendJSON(message);
-
-		UE_LOG(LogTCPLoggingAnalytics, Display, TEXT("(%d) amount of in game currency (%s) given to user"), GameCurrencyAmount,
+		RecordMessage(ETCPLoggingLane::Bulk, [&](auto& Writer) {
+			Writer.BeginObject();
+			WriteTimestamp(Writer);
+			Writer.WriteAsciiString("eventName", "recordCurrencyGiven");
+			Writer.BeginArray("attributes");
+			Writer.WriteStringAttribute("gameCurrencyType", GameCurrencyType);
+			Writer.WriteIntegerAttribute("gameCurrencyAmount", GameCurrencyAmount);
+			Writer.EndArray();
+			Writer.EndObject();
+		});
+
+		UE_LOG(LogTCPLoggingAnalytics, VeryVerbose, TEXT("(%d) amount of in game currency (%s) given to user"), GameCurrencyAmount,
 			*GameCurrencyType);
 	}
 	else
@@ -388,37 +712,15 @@ void FAnalyticsProviderTCPLogging::RecordError(const FString& Error, const TArra
 {
 	if (bHasSessionStarted)
 	{
-		check(Socket != nullptr);
-
-		FString message = FString::Printf(TEXT("\t\t{"));
-		message.Append(FString::Printf(TEXT("\t\t\t\"error\" : \"%s\","), *Error));
-
-		message.Append(FString::Printf(TEXT("\t\t\t\"attributes\" :")));
-		message.Append(FString::Printf(TEXT("\t\t\t[")));
-		bool bHasWrittenFirstAttr = false;
-		// Write out the list of attributes as an array of attribute objects
-		for (auto Attr : Attributes)
-		{
-			message.Append(FString::Printf(TEXT("\t\t\t{")));
-			message.Append(FString::Printf(TEXT("\t\t\t\t\"name\" : \"%s\","), *Attr.GetName()));
-			if (Attr.GetValue().IsNumeric())
-			{
-				message.Append(FString::Printf(TEXT("\"value\" : %s"), *Attr.GetValue()));
-			}
-			else
-			{
-				message.Append(FString::Printf(TEXT("\"value\" : \"%s\""), *Attr.GetValue()));
-			}
-			message.Append(FString::Printf(TEXT("\t\t\t}")));
-			bHasWrittenFirstAttr = true;
-		}
-		message.Append(FString::Printf(TEXT("\t\t\t]")));
-
-		message.Append(FString::Printf(TEXT("\t\t}")));
-
-		SendJSON(message);
-
-		UE_LOG(LogTCPLoggingAnalytics, Display, TEXT("Error is (%s) number of attributes is (%d)"), *Error, Attributes.Num());
+		RecordMessage(ETCPLoggingLane::Critical, [&](auto& Writer) {
+			Writer.BeginObject();
+			WriteTimestamp(Writer);
+			Writer.WriteString("error", Error);
+			Writer.WriteAttributes(Attributes);
+			Writer.EndObject();
+		});
+
+		UE_LOG(LogTCPLoggingAnalytics, VeryVerbose, TEXT("Error is (%s) number of attributes is (%d)"), *Error, Attributes.Num());
 	}
 	else
 	{
@@ -432,43 +734,17 @@ void FAnalyticsProviderTCPLogging::RecordProgress(
 {
 	if (bHasSessionStarted)
 	{
-		check(Socket != nullptr);
-
-		FString message = FString::Printf(TEXT("\t\t{"));
-		message.Append(FString::Printf(TEXT("\t\t\t\"eventType\" : \"Progress\",")));
-		message.Append(FString::Printf(TEXT("\t\t\t\"progressType\" : \"%s\","), *ProgressType));
-		message.Append(FString::Printf(TEXT("\t\t\t\"progressName\" : \"%s\","), *ProgressName));
-
-		message.Append(FString::Printf(TEXT("\t\t\t\"attributes\" :")));
-		message.Append(FString::Printf(TEXT("\t\t\t[")));
-		bool bHasWrittenFirstAttr = false;
-		// Write out the list of attributes as an array of attribute objects
-		for (auto Attr : Attributes)
-		{
-			if (bHasWrittenFirstAttr)
-			{
-				message.Append(FString::Printf(TEXT("\t\t\t,")));
-			}
-			message.Append(FString::Printf(TEXT("\t\t\t{")));
-			message.Append(FString::Printf(TEXT("\t\t\t\t\"name\" : \"%s\","), *Attr.GetName()));
-			if (Attr.GetValue().IsNumeric())
-			{
-				message.Append(FString::Printf(TEXT("\"value\" : %s"), *Attr.GetValue()));
-			}
-			else
-			{
-				message.Append(FString::Printf(TEXT("\"value\" : \"%s\""), *Attr.GetValue()));
-			}
-			message.Append(FString::Printf(TEXT("\t\t\t}")));
-			bHasWrittenFirstAttr = true;
-		}
-		message.Append(FString::Printf(TEXT("\t\t\t]")));
-
-		message.Append(FString::Printf(TEXT("\t\t}")));
-
-		SendJSON(message);
-
-		UE_LOG(LogTCPLoggingAnalytics, Display, TEXT("Progress event is type (%s), named (%s), number of attributes is (%d)"),
+		RecordMessage(ETCPLoggingLane::Bulk, [&](auto& Writer) {
+			Writer.BeginObject();
+			WriteTimestamp(Writer);
+			Writer.WriteAsciiString("eventType", "Progress");
+			Writer.WriteString("progressType", ProgressType);
+			Writer.WriteString("progressName", ProgressName);
+			Writer.WriteAttributes(Attributes);
+			Writer.EndObject();
+		});
+
+		UE_LOG(LogTCPLoggingAnalytics, VeryVerbose, TEXT("Progress event is type (%s), named (%s), number of attributes is (%d)"),
 			*ProgressType, *ProgressName, Attributes.Num());
 	}
 	else
@@ -483,43 +759,17 @@ void FAnalyticsProviderTCPLogging::RecordItemPurchase(
 {
 	if (bHasSessionStarted)
 	{
-		check(Socket != nullptr);
-
-		FString message = FString::Printf(TEXT("{"));
-		message.Append(FString::Printf(TEXT("\"eventType\" : \"ItemPurchase\",")));
-		message.Append(FString::Printf(TEXT("\"itemId\" : \"%s\","), *ItemId));
-		message.Append(FString::Printf(TEXT("\"itemQuantity\" : %d,"), ItemQuantity));
-
-		message.Append(FString::Printf(TEXT("\"attributes\" :")));
-		message.Append(FString::Printf(TEXT("[")));
-		bool bHasWrittenFirstAttr = false;
-		// Write out the list of attributes as an array of attribute objects
-		for (auto Attr : Attributes)
-		{
-			if (bHasWrittenFirstAttr)
-			{
-				message.Append(FString::Printf(TEXT(",")));
-			}
-			message.Append(FString::Printf(TEXT("{")));
-			message.Append(FString::Printf(TEXT("\"name\" : \"%s\","), *Attr.GetName()));
-			if (Attr.GetValue().IsNumeric())
-			{
-				message.Append(FString::Printf(TEXT("\"value\" : %s"), *Attr.GetValue()));
-			}
-			else
-			{
-				message.Append(FString::Printf(TEXT("\"value\" : \"%s\""), *Attr.GetValue()));
-			}
-			message.Append(FString::Printf(TEXT("}")));
-			bHasWrittenFirstAttr = true;
-		}
-		message.Append(FString::Printf(TEXT("]")));
-
-		message.Append(FString::Printf(TEXT("}\n")));
-
-		SendJSON(message);
-
-		UE_LOG(LogTCPLoggingAnalytics, Display, TEXT("Item purchase id (%s), quantity (%d), number of attributes is (%d)"), *ItemId,
+		RecordMessage(ETCPLoggingLane::Critical, [&](auto& Writer) {
+			Writer.BeginObject();
+			WriteTimestamp(Writer);
+			Writer.WriteAsciiString("eventType", "ItemPurchase");
+			Writer.WriteString("itemId", ItemId);
+			Writer.WriteInteger("itemQuantity", ItemQuantity);
+			Writer.WriteAttributes(Attributes);
+			Writer.EndObject();
+		});
+
+		UE_LOG(LogTCPLoggingAnalytics, VeryVerbose, TEXT("Item purchase id (%s), quantity (%d), number of attributes is (%d)"), *ItemId,
 			ItemQuantity, Attributes.Num());
 	}
 	else
@@ -534,43 +784,17 @@ void FAnalyticsProviderTCPLogging::RecordCurrencyPurchase(
 {
 	if (bHasSessionStarted)
 	{
-		check(Socket != nullptr);
-
-		FString message = FString::Printf(TEXT("{"));
-		message.Append(FString::Printf(TEXT("\"eventType\" : \"CurrencyPurchase\",")));
-		message.Append(FString::Printf(TEXT("\"gameCurrencyType\" : \"%s\","), *GameCurrencyType));
-		message.Append(FString::Printf(TEXT("\"gameCurrencyAmount\" : %d,"), GameCurrencyAmount));
-
-		message.Append(FString::Printf(TEXT("\"attributes\" :")));
-		message.Append(FString::Printf(TEXT("[")));
-		bool bHasWrittenFirstAttr = false;
-		// Write out the list of attributes as an array of attribute objects
-		for (auto Attr : Attributes)
-		{
-			if (bHasWrittenFirstAttr)
-			{
-				FString::Printf(TEXT(","));
-			}
-			message.Append(FString::Printf(TEXT("{")));
-			message.Append(FString::Printf(TEXT("\"name\" : \"%s\","), *Attr.GetName()));
-			if (Attr.GetValue().IsNumeric())
-			{
-				message.Append(FString::Printf(TEXT("\"value\" : %s"), *Attr.GetValue()));
-			}
-			else
-			{
-				message.Append(FString::Printf(TEXT("\"value\" : \"%s\""), *Attr.GetValue()));
-			}
-			message.Append(FString::Printf(TEXT("}")));
-			bHasWrittenFirstAttr = true;
-		}
-		message.Append(FString::Printf(TEXT("]")));
-
-		message.Append(FString::Printf(TEXT("}\n")));
-
-		SendJSON(message);
-
-		UE_LOG(LogTCPLoggingAnalytics, Display, TEXT("Currency purchase type (%s), quantity (%d), number of attributes is (%d)"),
+		RecordMessage(ETCPLoggingLane::Critical, [&](auto& Writer) {
+			Writer.BeginObject();
+			WriteTimestamp(Writer);
+			Writer.WriteAsciiString("eventType", "CurrencyPurchase");
+			Writer.WriteString("gameCurrencyType", GameCurrencyType);
+			Writer.WriteInteger("gameCurrencyAmount", GameCurrencyAmount);
+			Writer.WriteAttributes(Attributes);
+			Writer.EndObject();
+		});
+
+		UE_LOG(LogTCPLoggingAnalytics, VeryVerbose, TEXT("Currency purchase type (%s), quantity (%d), number of attributes is (%d)"),
 			*GameCurrencyType, GameCurrencyAmount, Attributes.Num());
 	}
 	else
@@ -585,43 +809,17 @@ void FAnalyticsProviderTCPLogging::RecordCurrencyGiven(
 {
 	if (bHasSessionStarted)
 	{
-		check(Socket != nullptr);
-
-		FString message = FString::Printf(TEXT("{"));
-		message.Append(FString::Printf(TEXT("\"eventType\" : \"CurrencyGiven\",")));
-		message.Append(FString::Printf(TEXT("\"gameCurrencyType\" : \"%s\","), *GameCurrencyType));
-		message.Append(FString::Printf(TEXT("\"gameCurrencyAmount\" : %d,"), GameCurrencyAmount));
-
-		message.Append(FString::Printf(TEXT("\"attributes\" :")));
-		message.Append(FString::Printf(TEXT("[")));
-		bool bHasWrittenFirstAttr = false;
-		// Write out the list of attributes as an array of attribute objects
-		for (auto Attr : Attributes)
-		{
-			if (bHasWrittenFirstAttr)
-			{
-				message.Append(FString::Printf(TEXT(",")));
-			}
-			message.Append(FString::Printf(TEXT("{")));
-			message.Append(FString::Printf(TEXT("\"name\" : \"%s\","), *Attr.GetName()));
-			if (Attr.GetValue().IsNumeric())
-			{
-				message.Append(FString::Printf(TEXT("\"value\" : %s"), *Attr.GetValue()));
-			}
-			else
-			{
-				message.Append(FString::Printf(TEXT("\"value\" : \"%s\""), *Attr.GetValue()));
-			}
-			message.Append(FString::Printf(TEXT("}")));
-			bHasWrittenFirstAttr = true;
-		}
-		message.Append(FString::Printf(TEXT("]")));
-
-		message.Append(FString::Printf(TEXT("}\n")));
-
-		SendJSON(message);
-
-		UE_LOG(LogTCPLoggingAnalytics, Display, TEXT("Currency given type (%s), quantity (%d), number of attributes is (%d)"),
+		RecordMessage(ETCPLoggingLane::Bulk, [&](auto& Writer) {
+			Writer.BeginObject();
+			WriteTimestamp(Writer);
+			Writer.WriteAsciiString("eventType", "CurrencyGiven");
+			Writer.WriteString("gameCurrencyType", GameCurrencyType);
+			Writer.WriteInteger("gameCurrencyAmount", GameCurrencyAmount);
+			Writer.WriteAttributes(Attributes);
+			Writer.EndObject();
+		});
+
+		UE_LOG(LogTCPLoggingAnalytics, VeryVerbose, TEXT("Currency given type (%s), quantity (%d), number of attributes is (%d)"),
 			*GameCurrencyType, GameCurrencyAmount, Attributes.Num());
 	}
 	else
@@ -630,12 +828,3 @@ void FAnalyticsProviderTCPLogging::RecordCurrencyGiven(
 			TEXT("FAnalyticsProviderTCPLogging::RecordCurrencyGiven called before StartSession. Ignoring."));
 	}
 }
-
-void FAnalyticsProviderTCPLogging::SendJSON(FString& serialized)
-{
-	TCHAR* payloadChar = serialized.GetCharArray().GetData();
-	int32 JSONSize = FCString::Strlen(payloadChar);
-	int32 AmountSent = 0;
-
-	Socket->Send((uint8*) TCHAR_TO_UTF8(payloadChar), JSONSize, AmountSent);
-}
\ No newline at end of file
@@ -0,0 +1,80 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "Containers/StringView.h"
+#include "CoreMinimal.h"
+
+/**
+ * Event attribute that keeps the type of its value, for the typed RecordEvent overload. Numbers are written straight
+ * from their binary value and nothing is converted to an FString first. Meant to be built in the argument list of the
+ * call it is passed to: the name and string values are referenced, not copied.
+ */
+struct FTCPLoggingAttribute
+{
+	enum class EType : uint8
+	{
+		Integer,
+		Double,
+		/** Kept apart from Double so it is written at float precision, not as the double it widens to */
+		Float,
+		Bool,
+		String,
+	};
+
+	FTCPLoggingAttribute(FAnsiStringView InName, int32 Value)
+		: Name(InName), Type(EType::Integer), Integer(Value)
+	{
+	}
+
+	FTCPLoggingAttribute(FAnsiStringView InName, int64 Value)
+		: Name(InName), Type(EType::Integer), Integer(Value)
+	{
+	}
+
+	FTCPLoggingAttribute(FAnsiStringView InName, uint32 Value)
+		: Name(InName), Type(EType::Integer), Integer(Value)
+	{
+	}
+
+	/** Values beyond the int64 range wrap, e.g. cycle counts are far from it */
+	FTCPLoggingAttribute(FAnsiStringView InName, uint64 Value)
+		: Name(InName), Type(EType::Integer), Integer((int64) Value)
+	{
+	}
+
+	FTCPLoggingAttribute(FAnsiStringView InName, float Value)
+		: Name(InName), Type(EType::Float), Float(Value)
+	{
+	}
+
+	FTCPLoggingAttribute(FAnsiStringView InName, double Value)
+		: Name(InName), Type(EType::Double), Double(Value)
+	{
+	}
+
+	FTCPLoggingAttribute(FAnsiStringView InName, bool Value)
+		: Name(InName), Type(EType::Bool), Bool(Value)
+	{
+	}
+
+	FTCPLoggingAttribute(FAnsiStringView InName, const FString& Value)
+		: Name(InName), Type(EType::String), String(&Value)
+	{
+	}
+
+	/** Would otherwise convert to bool */
+	FTCPLoggingAttribute(FAnsiStringView InName, const TCHAR* Value) = delete;
+
+	/** ASCII, written without escaping like every other key the provider writes */
+	FAnsiStringView Name;
+	EType Type;
+	union
+	{
+		int64 Integer;
+		double Double;
+		float Float;
+		bool Bool;
+		const FString* String;
+	};
+};
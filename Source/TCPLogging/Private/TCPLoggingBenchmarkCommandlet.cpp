@@ -0,0 +1,393 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "TCPLoggingBenchmarkCommandlet.h"
+
+#include "AnalyticsEventAttribute.h"
+#include "Async/Async.h"
+#include "HAL/MemoryBase.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/Parse.h"
+#include "TCPLoggingLog.h"
+#include "TCPLoggingLoopbackSink.h"
+#include "TCPLoggingProvider.h"
+#include "TCPLoggingUtf8.h"
+
+#include <atomic>
+
+/** Heap allocations made by the calling thread since it started, counted once the counting allocator is installed */
+static thread_local uint64 ThreadAllocationCount = 0;
+
+/** Forwards to the allocator it wraps and counts every allocation per thread */
+class FTCPLoggingCountingMalloc final : public FMalloc
+{
+public:
+	explicit FTCPLoggingCountingMalloc(FMalloc* InInner)
+		: Inner(InInner)
+	{
+	}
+
+	virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+	{
+		++ThreadAllocationCount;
+		return Inner->Malloc(Count, Alignment);
+	}
+
+	virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+	{
+		++ThreadAllocationCount;
+		return Inner->Realloc(Original, Count, Alignment);
+	}
+
+	virtual void Free(void* Original) override
+	{
+		Inner->Free(Original);
+	}
+
+	virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override
+	{
+		return Inner->QuantizeSize(Count, Alignment);
+	}
+
+	virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override
+	{
+		return Inner->GetAllocationSize(Original, SizeOut);
+	}
+
+	virtual void Trim(bool bTrimThreadCaches) override
+	{
+		Inner->Trim(bTrimThreadCaches);
+	}
+
+	virtual void SetupTLSCachesOnCurrentThread() override
+	{
+		Inner->SetupTLSCachesOnCurrentThread();
+	}
+
+	virtual void ClearAndDisableTLSCachesOnCurrentThread() override
+	{
+		Inner->ClearAndDisableTLSCachesOnCurrentThread();
+	}
+
+	virtual void UpdateStats() override
+	{
+		Inner->UpdateStats();
+	}
+
+	virtual void GetAllocatorStats(FGenericMemoryStats& OutStats) override
+	{
+		Inner->GetAllocatorStats(OutStats);
+	}
+
+	virtual bool IsInternallyThreadSafe() const override
+	{
+		return Inner->IsInternallyThreadSafe();
+	}
+
+	virtual bool ValidateHeap() override
+	{
+		return Inner->ValidateHeap();
+	}
+
+	virtual const TCHAR* GetDescriptiveName() override
+	{
+		return Inner->GetDescriptiveName();
+	}
+
+private:
+	FMalloc* Inner;
+};
+
+/**
+ * Wraps GMalloc in the counting allocator the first time it is called. The wrapper is never removed, threads that
+ * read GMalloc before the swap may still call into it, and it costs one thread local increment per allocation.
+ */
+static void InstallCountingMalloc()
+{
+	static FTCPLoggingCountingMalloc* CountingMalloc = nullptr;
+	if (CountingMalloc == nullptr)
+	{
+		CountingMalloc = new FTCPLoggingCountingMalloc(GMalloc);
+		GMalloc = CountingMalloc;
+	}
+}
+
+/** Parses a comma separated list of positive integers, keeps Out's defaults if Text has none */
+static void ParseCounts(const FString& Text, TArray<int32>& Out)
+{
+	TArray<FString> Parts;
+	Text.ParseIntoArray(Parts, TEXT(","));
+	TArray<int32> Parsed;
+	for (const FString& Part : Parts)
+	{
+		const int32 Value = FCString::Atoi(*Part);
+		if (Value > 0 || Part.TrimStartAndEnd() == TEXT("0"))
+		{
+			Parsed.Add(Value);
+		}
+	}
+	if (Parsed.Num() > 0)
+	{
+		Out = MoveTemp(Parsed);
+	}
+}
+
+/** Value below which Fraction of the sorted samples fall */
+static double Percentile(const TArray<double>& Sorted, double Fraction)
+{
+	if (Sorted.Num() == 0)
+	{
+		return 0.0;
+	}
+	return Sorted[FMath::Min(Sorted.Num() - 1, FMath::FloorToInt(Fraction * Sorted.Num()))];
+}
+
+/** What one recording thread measured of its own Record* calls */
+struct FTCPLoggingBenchmarkWorkerResult
+{
+	uint64 Events = 0;
+	uint64 RecordCycles = 0;
+	uint64 Allocations = 0;
+};
+
+/** Records Events events cycling through every Record* overload, timing only the calls themselves */
+static FTCPLoggingBenchmarkWorkerResult RunBenchmarkWorker(
+	IAnalyticsProvider& Provider, int32 Events, int32 AttributeCount, const std::atomic<bool>& bGo)
+{
+	TArray<FAnalyticsEventAttribute> Attributes;
+	for (int32 Index = 0; Index < AttributeCount; ++Index)
+	{
+		Attributes.Emplace(FString::Printf(TEXT("Attribute%d"), Index), Index % 2 == 0 ? TEXT("SomeValue") : TEXT("12345"));
+	}
+
+	const FString EventName(TEXT("Benchmark.Event"));
+	const FString ItemId(TEXT("Benchmark.Item"));
+	const FString Currency(TEXT("Gems"));
+	const FString RealCurrency(TEXT("USD"));
+	const FString PaymentProvider(TEXT("Store"));
+	const FString Error(TEXT("Benchmark error"));
+	const FString ProgressType(TEXT("Complete"));
+	const FString ProgressHierarchy(TEXT("World.Level"));
+
+	while (!bGo.load(std::memory_order_acquire))
+	{
+		FPlatformProcess::YieldThread();
+	}
+
+	FTCPLoggingBenchmarkWorkerResult Result;
+	for (int32 Index = 0; Index < Events; ++Index)
+	{
+		// Replaced outside the measured region, building attributes is the caller's cost rather than the provider's
+		Attributes.Emplace(ANSI_TO_TCHAR(FTCPLoggingLoopbackSink::LatencyAttributeName), FPlatformTime::Cycles64());
+
+		const uint64 AllocationsBefore = ThreadAllocationCount;
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		switch (Index % 9)
+		{
+			case 0:
+				Provider.RecordEvent(EventName, Attributes);
+				break;
+			case 1:
+				Provider.RecordItemPurchase(ItemId, Currency, 100, 1);
+				break;
+			case 2:
+				Provider.RecordCurrencyPurchase(Currency, 500, RealCurrency, 4.99f, PaymentProvider);
+				break;
+			case 3:
+				Provider.RecordCurrencyGiven(Currency, 50);
+				break;
+			case 4:
+				Provider.RecordError(Error, Attributes);
+				break;
+			case 5:
+				Provider.RecordProgress(ProgressType, ProgressHierarchy, Attributes);
+				break;
+			case 6:
+				Provider.RecordItemPurchase(ItemId, 1, Attributes);
+				break;
+			case 7:
+				Provider.RecordCurrencyPurchase(Currency, 500, Attributes);
+				break;
+			default:
+				Provider.RecordCurrencyGiven(Currency, 50, Attributes);
+				break;
+		}
+		Result.RecordCycles += FPlatformTime::Cycles64() - StartCycles;
+		Result.Allocations += ThreadAllocationCount - AllocationsBefore;
+		++Result.Events;
+
+		Attributes.Pop(false);
+	}
+	return Result;
+}
+
+/** Nanoseconds per character one escaping function takes over Passes copies of Text, into a buffer that is kept */
+template <typename FuncType>
+static double TimeEscape(FuncType&& Escape, const FString& Text, int32 Passes, TArray<uint8>& Out)
+{
+	Out.Reset();
+	Escape(Out, *Text, Text.Len());
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+	for (int32 Pass = 0; Pass < Passes; ++Pass)
+	{
+		Out.Reset();
+		Escape(Out, *Text, Text.Len());
+	}
+	const double Seconds = (FPlatformTime::Cycles64() - StartCycles) * FPlatformTime::GetSecondsPerCycle64();
+	return Seconds * 1e9 / ((double) Passes * FMath::Max(Text.Len(), 1));
+}
+
+/** Compares the vectorized JSON string escaping with the scalar reference on typical and worst case text */
+static int32 RunEscapeBenchmark(int32 Passes)
+{
+	struct FSample
+	{
+		const TCHAR* Label;
+		FString Text;
+	};
+	const FString Sentence(TEXT("Player reached checkpoint 12 in World.Level after 351 seconds. "));
+	FString Long;
+	FString Escapes;
+	FString NonAscii;
+	for (int32 Index = 0; Index < 16; ++Index)
+	{
+		Long += Sentence;
+		Escapes += TEXT("C:\\Game\\Saved\\Logs\t\"quoted\"\n");
+		NonAscii += TEXT("Spieler erreichte Pr\u00fcfpunkt \u00e9\u4e16\u754c \U0001F3C1 ");
+	}
+	const FSample Samples[] = {
+		{TEXT("short ascii"), TEXT("Benchmark.Event")},
+		{TEXT("long ascii"), Long},
+		{TEXT("escapes"), Escapes},
+		{TEXT("non-ascii"), NonAscii},
+	};
+
+	UE_LOG(LogTCPLoggingAnalytics, Display, TEXT("Escaping %d passes per sample"), Passes);
+	UE_LOG(LogTCPLoggingAnalytics, Display, TEXT("sample       chars  scalar ns/char  vector ns/char  speedup"));
+
+	int32 Result = 0;
+	TArray<uint8> Scalar;
+	TArray<uint8> Vector;
+	for (const FSample& Sample : Samples)
+	{
+		const double ScalarNs = TimeEscape(
+			[](TArray<uint8>& Out, const TCHAR* Text, int32 Len) { TCPLoggingAppendJsonEscapedScalar(Out, Text, Len); },
+			Sample.Text, Passes, Scalar);
+		const double VectorNs = TimeEscape(
+			[](TArray<uint8>& Out, const TCHAR* Text, int32 Len) { TCPLoggingAppendJsonEscaped(Out, Text, Len); },
+			Sample.Text, Passes, Vector);
+		if (Scalar != Vector)
+		{
+			UE_LOG(LogTCPLoggingAnalytics, Error, TEXT("Vectorized escaping differs from scalar for %s"), Sample.Label);
+			Result = 1;
+		}
+		UE_LOG(LogTCPLoggingAnalytics, Display, TEXT("%-11s %6d %15.3f %15.3f %8.2fx"), Sample.Label, Sample.Text.Len(), ScalarNs,
+			VectorNs, ScalarNs / FMath::Max(VectorNs, 1e-9));
+	}
+	return Result;
+}
+
+UTCPLoggingBenchmarkCommandlet::UTCPLoggingBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UTCPLoggingBenchmarkCommandlet::Main(const FString& Params)
+{
+	if (FParse::Param(*Params, TEXT("Escape")))
+	{
+		int32 Passes = 100000;
+		FParse::Value(*Params, TEXT("Passes="), Passes);
+		return RunEscapeBenchmark(FMath::Max(Passes, 1));
+	}
+
+	int32 EventsPerThread = 20000;
+	FParse::Value(*Params, TEXT("Events="), EventsPerThread);
+	EventsPerThread = FMath::Max(EventsPerThread, 1);
+
+	TArray<int32> ThreadCounts = {1, 2, 4, 8};
+	TArray<int32> AttributeCounts = {0, 4, 16};
+	FString ListText;
+	if (FParse::Value(*Params, TEXT("Threads="), ListText, false))
+	{
+		ParseCounts(ListText, ThreadCounts);
+	}
+	if (FParse::Value(*Params, TEXT("Attributes="), ListText, false))
+	{
+		ParseCounts(ListText, AttributeCounts);
+	}
+
+	FTCPLoggingSenderSettings Settings;
+	FString FormatText;
+	if (FParse::Value(*Params, TEXT("Protocol="), FormatText) && !LexTryParseString(Settings.PayloadFormat, *FormatText))
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Error, TEXT("Unknown protocol (%s)"), *FormatText);
+		return 1;
+	}
+	if (FParse::Value(*Params, TEXT("Compression="), FormatText) && !LexTryParseString(Settings.Compression, *FormatText))
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Error, TEXT("Unknown compression (%s)"), *FormatText);
+		return 1;
+	}
+
+	FTCPLoggingLoopbackSink Sink;
+	if (!Sink.Start())
+	{
+		return 1;
+	}
+	InstallCountingMalloc();
+
+	UE_LOG(LogTCPLoggingAnalytics, Display, TEXT("Benchmarking %d events per thread, protocol %s, compression %s"), EventsPerThread,
+		LexToString(Settings.PayloadFormat), LexToString(Settings.Compression));
+	UE_LOG(LogTCPLoggingAnalytics, Display,
+		TEXT("threads attrs   events/s  ns/event  allocs/event  wire bytes/event   p50 ms   p99 ms  received"));
+
+	for (const int32 ThreadCount : ThreadCounts)
+	{
+		for (const int32 AttributeCount : AttributeCounts)
+		{
+			FAnalyticsProviderTCPLogging Provider(TEXT("127.0.0.1"), Sink.GetPort(), true, false, Settings);
+			Sink.TakeStats();
+			Provider.StartSession(TArray<FAnalyticsEventAttribute>());
+
+			std::atomic<bool> bGo(false);
+			TArray<TFuture<FTCPLoggingBenchmarkWorkerResult>> Workers;
+			for (int32 Index = 0; Index < ThreadCount; ++Index)
+			{
+				Workers.Add(Async(EAsyncExecution::Thread, [&Provider, EventsPerThread, AttributeCount, &bGo]() {
+					return RunBenchmarkWorker(Provider, EventsPerThread, AttributeCount, bGo);
+				}));
+			}
+
+			const double StartSeconds = FPlatformTime::Seconds();
+			bGo.store(true, std::memory_order_release);
+			FTCPLoggingBenchmarkWorkerResult Total;
+			for (TFuture<FTCPLoggingBenchmarkWorkerResult>& Worker : Workers)
+			{
+				const FTCPLoggingBenchmarkWorkerResult Result = Worker.Get();
+				Total.Events += Result.Events;
+				Total.RecordCycles += Result.RecordCycles;
+				Total.Allocations += Result.Allocations;
+			}
+
+			// Session.Start goes out ahead of the events, a shortfall means events were dropped on the way
+			const uint64 Expected = Total.Events + 1;
+			Sink.WaitForEvents(Expected, 30.0);
+			const double ElapsedSeconds = FPlatformTime::Seconds() - StartSeconds;
+			Provider.EndSession();
+
+			FTCPLoggingLoopbackStats Stats = Sink.TakeStats();
+			Stats.LatenciesSeconds.Sort();
+			const double Events = (double) FMath::Max<uint64>(Total.Events, 1);
+			UE_LOG(LogTCPLoggingAnalytics, Display, TEXT("%7d %5d %10.0f %9.1f %13.2f %17.1f %8.3f %8.3f  %llu/%llu"), ThreadCount,
+				AttributeCount, Total.Events / ElapsedSeconds,
+				Total.RecordCycles * FPlatformTime::GetSecondsPerCycle64() * 1e9 / Events, Total.Allocations / Events,
+				Stats.BytesReceived / Events, Percentile(Stats.LatenciesSeconds, 0.5) * 1000.0,
+				Percentile(Stats.LatenciesSeconds, 0.99) * 1000.0, Stats.Events, Expected);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,32 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+
+#include "TCPLoggingBenchmarkCommandlet.generated.h"
+
+/**
+ * Measures the provider end to end against an in-process loopback collector, see FTCPLoggingLoopbackSink.
+ * Every combination of thread and attribute count drives all Record* overloads and reports throughput, the cost on the
+ * recording thread, allocations per event, bytes on the wire and record to receipt latency.
+ *
+ *   -run=TCPLoggingBenchmark [-Events=20000] [-Threads=1,2,4,8] [-Attributes=0,4,16] [-Protocol=json] [-Compression=none]
+ *
+ * Events is per thread, Attributes is the number of attributes besides the one carrying the recording time.
+ *
+ *   -run=TCPLoggingBenchmark -Escape [-Passes=100000]
+ *
+ * only times JSON string escaping instead, the vectorized kernel against the scalar one, and fails if they differ.
+ */
+UCLASS()
+class UTCPLoggingBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UTCPLoggingBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
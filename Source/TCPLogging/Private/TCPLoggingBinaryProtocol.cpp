@@ -0,0 +1,387 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "TCPLoggingBinaryProtocol.h"
+
+#include "Hash/CityHash.h"
+#include "TCPLoggingJsonWriter.h"
+#include "TCPLoggingLog.h"
+
+using namespace TCPLoggingBinaryProtocol;
+
+/** Twice the entry limit keeps probe sequences short */
+static constexpr int32 DictionarySlotCount = MaxDictionaryEntries * 2;
+
+FTCPLoggingBinaryEncoder::FTCPLoggingBinaryEncoder()
+{
+	Slots.Init(INDEX_NONE, DictionarySlotCount);
+}
+
+bool FTCPLoggingBinaryEncoder::Encode(const uint8* Data, int32 Count, TArray<uint8>& Out)
+{
+	const uint8* End = Data + Count;
+	while (Data < End)
+	{
+		if (End - Data < RecordHeaderSize)
+		{
+			return false;
+		}
+		const uint32 BodySize = ReadUInt32(Data);
+		if (BodySize < 1 || (int64) BodySize > End - Data - 4)
+		{
+			return false;
+		}
+		const uint8* BodyEnd = Data + 4 + BodySize;
+
+		// The size changes as literals turn into references, patch it once the body is written
+		const int32 HeaderOffset = Out.AddUninitialized(4);
+		Out.Add(Data[4]);
+		Data += RecordHeaderSize;
+
+		while (Data < BodyEnd)
+		{
+			const EToken Token = (EToken) *Data++;
+			Out.Add((uint8) Token);
+			switch (Token)
+			{
+				case EToken::BeginObject:
+				case EToken::EndObject:
+				case EToken::EndArray:
+					break;
+
+				case EToken::BeginArray:
+					if (!EncodeSlot(Data, BodyEnd, Out))
+					{
+						return false;
+					}
+					break;
+
+				case EToken::String:
+				case EToken::NumberText:
+					if (!EncodeSlot(Data, BodyEnd, Out) || !EncodeSlot(Data, BodyEnd, Out))
+					{
+						return false;
+					}
+					break;
+
+				case EToken::Integer:
+				{
+					uint64 Value;
+					if (!EncodeSlot(Data, BodyEnd, Out) || !ReadVarInt(Data, BodyEnd, Value))
+					{
+						return false;
+					}
+					WriteVarInt(Out, Value);
+					break;
+				}
+
+				case EToken::Double:
+					if (!EncodeSlot(Data, BodyEnd, Out) || BodyEnd - Data < 8)
+					{
+						return false;
+					}
+					Out.Append(Data, 8);
+					Data += 8;
+					break;
+
+				default:
+					return false;
+			}
+		}
+
+		WriteUInt32(Out.GetData() + HeaderOffset, (uint32) (Out.Num() - HeaderOffset - 4));
+	}
+	return true;
+}
+
+bool FTCPLoggingBinaryEncoder::EncodeSlot(const uint8*& Data, const uint8* End, TArray<uint8>& Out)
+{
+	uint64 Tag;
+	if (!ReadVarInt(Data, End, Tag) || (ESlotTag) (Tag & 3) != ESlotTag::Literal || (int64) (Tag >> 2) > End - Data)
+	{
+		return false;
+	}
+	const int32 Len = (int32) (Tag >> 2);
+	const uint8* Text = Data;
+	Data += Len;
+
+	bool bAdded = false;
+	const int32 Id = Len <= MaxInternedStringLength ? Intern(Text, Len, bAdded) : INDEX_NONE;
+	if (Id == INDEX_NONE)
+	{
+		WriteVarInt(Out, Tag);
+		Out.Append(Text, Len);
+	}
+	else if (bAdded)
+	{
+		WriteVarInt(Out, ((uint64) Len << 2) | (uint64) ESlotTag::Define);
+		WriteVarInt(Out, (uint64) Id);
+		Out.Append(Text, Len);
+	}
+	else
+	{
+		WriteVarInt(Out, ((uint64) Id << 2) | (uint64) ESlotTag::Reference);
+	}
+	return true;
+}
+
+int32 FTCPLoggingBinaryEncoder::Intern(const uint8* Text, int32 Len, bool& bOutAdded)
+{
+	const uint32 Hash = CityHash32((const char*) Text, (uint32) Len);
+	const int32 Mask = DictionarySlotCount - 1;
+	for (int32 Slot = (int32) (Hash & Mask);; Slot = (Slot + 1) & Mask)
+	{
+		const int32 Index = Slots[Slot];
+		if (Index == INDEX_NONE)
+		{
+			if (Entries.Num() >= MaxDictionaryEntries)
+			{
+				return INDEX_NONE;
+			}
+			Slots[Slot] = Entries.Add(FEntry{Strings.Num(), Len, Hash});
+			Strings.Append(Text, Len);
+			bOutAdded = true;
+			return Slots[Slot];
+		}
+
+		const FEntry& Entry = Entries[Index];
+		if (Entry.Hash == Hash && Entry.Len == Len && FMemory::Memcmp(Strings.GetData() + Entry.Offset, Text, Len) == 0)
+		{
+			return Index;
+		}
+	}
+}
+
+void FTCPLoggingBinaryEncoder::WriteDictionary(TArray<uint8>& Out) const
+{
+	const int32 HeaderOffset = Out.AddUninitialized(4);
+	Out.Add((uint8) ERecordKind::Dictionary);
+	for (int32 Id = 0; Id < Entries.Num(); ++Id)
+	{
+		const FEntry& Entry = Entries[Id];
+		WriteVarInt(Out, ((uint64) Entry.Len << 2) | (uint64) ESlotTag::Define);
+		WriteVarInt(Out, (uint64) Id);
+		Out.Append(Strings.GetData() + Entry.Offset, Entry.Len);
+	}
+	WriteUInt32(Out.GetData() + HeaderOffset, (uint32) (Out.Num() - HeaderOffset - 4));
+}
+
+FTCPLoggingBinaryDecoder::FTCPLoggingBinaryDecoder()
+	: bFailed(false)
+{
+}
+
+bool FTCPLoggingBinaryDecoder::Decode(const uint8* Data, int32 Count, TArray<uint8>& Out)
+{
+	if (bFailed)
+	{
+		return false;
+	}
+	Pending.Append(Data, Count);
+
+	int32 Offset = 0;
+	while (Pending.Num() - Offset >= RecordHeaderSize)
+	{
+		const uint32 BodySize = ReadUInt32(Pending.GetData() + Offset);
+		if (BodySize < 1)
+		{
+			bFailed = true;
+			break;
+		}
+		if ((int64) Pending.Num() - Offset - 4 < (int64) BodySize)
+		{
+			break;
+		}
+
+		const uint8* Record = Pending.GetData() + Offset + 4;
+		if (!DecodeRecord(Record, Record + BodySize, Out))
+		{
+			bFailed = true;
+			break;
+		}
+		Offset += 4 + (int32) BodySize;
+	}
+
+	if (bFailed)
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Malformed binary analytics record"));
+		return false;
+	}
+	Pending.RemoveAt(0, Offset, false);
+	return true;
+}
+
+bool FTCPLoggingBinaryDecoder::DecodeRecord(const uint8* Data, const uint8* End, TArray<uint8>& Out)
+{
+	const ERecordKind Kind = (ERecordKind) *Data++;
+	if (Kind == ERecordKind::Dictionary)
+	{
+		FAnsiStringView Ignored;
+		while (Data < End)
+		{
+			if (!ReadSlot(Data, End, Ignored))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	if (Kind != ERecordKind::Event)
+	{
+		return false;
+	}
+
+	// Roll back whatever a malformed record wrote so the output only ever holds complete lines
+	const int32 StartNum = Out.Num();
+	FTCPLoggingJsonWriter Writer(Out);
+	int32 Depth = 0;
+	bool bValid = true;
+	while (bValid && Data < End)
+	{
+		FAnsiStringView Key;
+		FAnsiStringView Text;
+		switch ((EToken) *Data++)
+		{
+			case EToken::BeginObject:
+				bValid = Depth < MaxDepth;
+				if (bValid)
+				{
+					Writer.BeginObject();
+					++Depth;
+				}
+				break;
+
+			case EToken::EndObject:
+				bValid = Depth > 0;
+				if (bValid)
+				{
+					Writer.EndObject();
+					--Depth;
+				}
+				break;
+
+			case EToken::BeginArray:
+				bValid = Depth > 0 && Depth < MaxDepth && ReadSlot(Data, End, Key);
+				if (bValid)
+				{
+					Writer.BeginArray(Key);
+					++Depth;
+				}
+				break;
+
+			case EToken::EndArray:
+				bValid = Depth > 0;
+				if (bValid)
+				{
+					Writer.EndArray();
+					--Depth;
+				}
+				break;
+
+			case EToken::String:
+				bValid = Depth > 0 && ReadSlot(Data, End, Key) && ReadSlot(Data, End, Text);
+				if (bValid)
+				{
+					Writer.WriteUtf8String(Key, Text);
+				}
+				break;
+
+			case EToken::NumberText:
+				bValid = Depth > 0 && ReadSlot(Data, End, Key) && ReadSlot(Data, End, Text);
+				if (bValid)
+				{
+					Writer.WriteUtf8NumberText(Key, Text);
+				}
+				break;
+
+			case EToken::Integer:
+			{
+				uint64 Value;
+				bValid = Depth > 0 && ReadSlot(Data, End, Key) && ReadVarInt(Data, End, Value);
+				if (bValid)
+				{
+					Writer.WriteInteger(Key, ZigZagDecode(Value));
+				}
+				break;
+			}
+
+			case EToken::Double:
+			{
+				bValid = Depth > 0 && ReadSlot(Data, End, Key) && End - Data >= 8;
+				if (bValid)
+				{
+					const uint64 Bits = (uint64) ReadUInt32(Data) | ((uint64) ReadUInt32(Data + 4) << 32);
+					Data += 8;
+					double Value;
+					FMemory::Memcpy(&Value, &Bits, sizeof(Value));
+					Writer.WriteDouble(Key, Value);
+				}
+				break;
+			}
+
+			default:
+				bValid = false;
+				break;
+		}
+	}
+
+	if (!bValid || Depth != 0)
+	{
+		Out.SetNum(StartNum, false);
+		return false;
+	}
+	Writer.EndMessage();
+	return true;
+}
+
+bool FTCPLoggingBinaryDecoder::ReadSlot(const uint8*& Data, const uint8* End, FAnsiStringView& OutText)
+{
+	uint64 Tag;
+	if (!ReadVarInt(Data, End, Tag))
+	{
+		return false;
+	}
+
+	switch ((ESlotTag) (Tag & 3))
+	{
+		case ESlotTag::Literal:
+		case ESlotTag::Define:
+		{
+			const uint64 Len = Tag >> 2;
+			uint64 Id = 0;
+			if (((ESlotTag) (Tag & 3) == ESlotTag::Define && !ReadVarInt(Data, End, Id)) || (int64) Len > End - Data)
+			{
+				return false;
+			}
+			OutText = FAnsiStringView((const ANSICHAR*) Data, (int32) Len);
+			if ((ESlotTag) (Tag & 3) == ESlotTag::Define)
+			{
+				if (Id >= (uint64) MaxDictionaryEntries)
+				{
+					return false;
+				}
+				if (Dictionary.Num() <= (int32) Id)
+				{
+					Dictionary.SetNum((int32) Id + 1);
+				}
+				Dictionary[(int32) Id] = TArray<uint8>(Data, (int32) Len);
+			}
+			Data += Len;
+			return true;
+		}
+
+		case ESlotTag::Reference:
+		{
+			const uint64 Id = Tag >> 2;
+			if (Id >= (uint64) Dictionary.Num())
+			{
+				return false;
+			}
+			const TArray<uint8>& Entry = Dictionary[(int32) Id];
+			OutText = FAnsiStringView((const ANSICHAR*) Entry.GetData(), Entry.Num());
+			return true;
+		}
+
+		default:
+			return false;
+	}
+}
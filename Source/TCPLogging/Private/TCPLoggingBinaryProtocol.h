@@ -0,0 +1,180 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Compact binary encoding of the events the provider emits, an alternative to NDJSON selected with TCPLoggingProtocol.
+ * It always travels inside the framed stream from TCPLoggingCompression.h, whose header names the payload format.
+ *
+ * The payload is a sequence of records:
+ *
+ *   body size (uint32 LE) | kind (uint8) | tokens
+ *
+ * An Event record holds one event as the same sequence of calls the JSON writer would have made, a Dictionary record
+ * only defines strings. Tokens are one byte followed by their operands:
+ *
+ *   BeginObject, EndObject, EndArray
+ *   BeginArray key
+ *   String key value | NumberText key text | Integer key zigzag-varint | Double key float64 LE
+ *
+ * Every key, string value and number text is a string slot starting with a varint tag whose low two bits say what follows:
+ *
+ *   Literal: (length << 2) | 0, then length UTF-8 bytes
+ *   Reference: (id << 2) | 1, a string defined earlier on this connection
+ *   Define: (length << 2) | 2, then varint id, then length UTF-8 bytes, used in place and remembered as id
+ *
+ * Record threads only ever write literals. The sender interns them into the connection's dictionary as it batches,
+ * and every connection starts with a Dictionary record holding all definitions so far, so retained frames can be
+ * replayed on a new connection unchanged.
+ */
+namespace TCPLoggingBinaryProtocol
+{
+	enum class ERecordKind : uint8
+	{
+		Event = 1,
+		Dictionary = 2,
+	};
+
+	enum class EToken : uint8
+	{
+		BeginObject = 1,
+		EndObject = 2,
+		BeginArray = 3,
+		EndArray = 4,
+		String = 5,
+		NumberText = 6,
+		Integer = 7,
+		Double = 8,
+	};
+
+	enum class ESlotTag : uint8
+	{
+		Literal = 0,
+		Reference = 1,
+		Define = 2,
+	};
+
+	static constexpr int32 RecordHeaderSize = 5;
+	/** Longer strings are always sent as literals, they rarely repeat and would crowd out the short ones that do */
+	static constexpr int32 MaxInternedStringLength = 64;
+	static constexpr int32 MaxDictionaryEntries = 4096;
+	/** Nesting depth the decoder accepts, matching what the JSON writer supports */
+	static constexpr int32 MaxDepth = 63;
+
+	inline void WriteVarInt(TArray<uint8>& Out, uint64 Value)
+	{
+		while (Value >= 0x80)
+		{
+			Out.Add((uint8) (Value | 0x80));
+			Value >>= 7;
+		}
+		Out.Add((uint8) Value);
+	}
+
+	/** Returns false if the varint runs past End or is longer than 64 bits */
+	inline bool ReadVarInt(const uint8*& Data, const uint8* End, uint64& OutValue)
+	{
+		OutValue = 0;
+		for (int32 Shift = 0; Shift < 64 && Data < End; Shift += 7)
+		{
+			const uint8 Byte = *Data++;
+			OutValue |= (uint64) (Byte & 0x7F) << Shift;
+			if ((Byte & 0x80) == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	inline uint64 ZigZagEncode(int64 Value)
+	{
+		return ((uint64) Value << 1) ^ (uint64) (Value >> 63);
+	}
+
+	inline int64 ZigZagDecode(uint64 Value)
+	{
+		return (int64) (Value >> 1) ^ -(int64) (Value & 1);
+	}
+
+	inline void WriteUInt32(uint8* Dest, uint32 Value)
+	{
+		Dest[0] = (uint8) Value;
+		Dest[1] = (uint8) (Value >> 8);
+		Dest[2] = (uint8) (Value >> 16);
+		Dest[3] = (uint8) (Value >> 24);
+	}
+
+	inline uint32 ReadUInt32(const uint8* Data)
+	{
+		return (uint32) Data[0] | ((uint32) Data[1] << 8) | ((uint32) Data[2] << 16) | ((uint32) Data[3] << 24);
+	}
+}
+
+/**
+ * Sender side of the string dictionary. Rewrites the literal slots of records produced by FTCPLoggingBinaryWriter
+ * into definitions on first use and references afterwards. Only touched by the sender thread.
+ */
+class FTCPLoggingBinaryEncoder
+{
+public:
+	FTCPLoggingBinaryEncoder();
+
+	/** Re-encodes complete records from Data into Out. Returns false if Data is not well formed */
+	bool Encode(const uint8* Data, int32 Count, TArray<uint8>& Out);
+
+	/** Appends a Dictionary record defining every interned string, to start a connection with */
+	void WriteDictionary(TArray<uint8>& Out) const;
+
+	int32 NumEntries() const
+	{
+		return Entries.Num();
+	}
+
+private:
+	/** Copies one string slot, interning it if it is a short literal. Returns false on malformed input */
+	bool EncodeSlot(const uint8*& Data, const uint8* End, TArray<uint8>& Out);
+
+	/** Id of the string, adding it if there is room. Sets bOutAdded for new entries, returns INDEX_NONE if full */
+	int32 Intern(const uint8* Text, int32 Len, bool& bOutAdded);
+
+	struct FEntry
+	{
+		int32 Offset;
+		int32 Len;
+		uint32 Hash;
+	};
+
+	/** Interned bytes back to back */
+	TArray<uint8> Strings;
+	TArray<FEntry> Entries;
+	/** Open addressing table of entry indices, INDEX_NONE marks a free slot */
+	TArray<int32> Slots;
+};
+
+/**
+ * Reference decoder turning binary records back into the NDJSON the JSON path produces, byte for byte.
+ * Fed incrementally with the payload of one connection, e.g. the output of FTCPLoggingFrameDecoder.
+ */
+class FTCPLoggingBinaryDecoder
+{
+public:
+	FTCPLoggingBinaryDecoder();
+
+	/**
+	 * Consumes Count bytes and appends one NDJSON line per complete event record to Out.
+	 * Returns false once the stream is malformed, after which the decoder rejects everything.
+	 */
+	bool Decode(const uint8* Data, int32 Count, TArray<uint8>& Out);
+
+private:
+	bool DecodeRecord(const uint8* Data, const uint8* End, TArray<uint8>& Out);
+	bool ReadSlot(const uint8*& Data, const uint8* End, FAnsiStringView& OutText);
+
+	TArray<uint8> Pending;
+	/** Strings defined on this connection, indexed by id */
+	TArray<TArray<uint8>> Dictionary;
+	bool bFailed;
+};
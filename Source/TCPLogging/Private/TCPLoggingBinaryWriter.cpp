@@ -0,0 +1,240 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "TCPLoggingBinaryWriter.h"
+
+#include "TCPLoggingBinaryProtocol.h"
+#include "TCPLoggingNumberFormat.h"
+#include "TCPLoggingUtf8.h"
+
+using namespace TCPLoggingBinaryProtocol;
+
+/** Varint tags of literals up to this length fit in a single byte */
+static constexpr int32 MaxShortLiteralLength = 0x7F >> 2;
+
+FTCPLoggingBinaryWriter::FTCPLoggingBinaryWriter(TArray<uint8>& InBuffer)
+	: Buffer(InBuffer)
+	, RecordStart(InBuffer.Num())
+	, Depth(0)
+{
+	Buffer.AddUninitialized(4);
+	Buffer.Add((uint8) ERecordKind::Event);
+}
+
+void FTCPLoggingBinaryWriter::BeginObject()
+{
+	WriteToken((uint8) EToken::BeginObject);
+	++Depth;
+	check(Depth <= MaxDepth);
+}
+
+void FTCPLoggingBinaryWriter::EndObject()
+{
+	check(Depth > 0);
+	--Depth;
+	WriteToken((uint8) EToken::EndObject);
+}
+
+void FTCPLoggingBinaryWriter::BeginArray(FAnsiStringView Key)
+{
+	WriteToken((uint8) EToken::BeginArray);
+	WriteLiteral(Key);
+	++Depth;
+	check(Depth <= MaxDepth);
+}
+
+void FTCPLoggingBinaryWriter::EndArray()
+{
+	check(Depth > 0);
+	--Depth;
+	WriteToken((uint8) EToken::EndArray);
+}
+
+void FTCPLoggingBinaryWriter::WriteString(FAnsiStringView Key, const FString& Value)
+{
+	WriteToken((uint8) EToken::String);
+	WriteLiteral(Key);
+	WriteLiteral(Value);
+}
+
+void FTCPLoggingBinaryWriter::WriteAsciiString(FAnsiStringView Key, FAnsiStringView Value)
+{
+	WriteToken((uint8) EToken::String);
+	WriteLiteral(Key);
+	WriteLiteral(Value);
+}
+
+void FTCPLoggingBinaryWriter::WriteInteger(FAnsiStringView Key, int64 Value)
+{
+	WriteToken((uint8) EToken::Integer);
+	WriteLiteral(Key);
+	WriteVarInt(Buffer, ZigZagEncode(Value));
+}
+
+void FTCPLoggingBinaryWriter::WriteDouble(FAnsiStringView Key, double Value)
+{
+	WriteToken((uint8) EToken::Double);
+	WriteLiteral(Key);
+
+	uint64 Bits;
+	FMemory::Memcpy(&Bits, &Value, sizeof(Bits));
+	const int32 Start = Buffer.AddUninitialized(8);
+	WriteUInt32(Buffer.GetData() + Start, (uint32) Bits);
+	WriteUInt32(Buffer.GetData() + Start + 4, (uint32) (Bits >> 32));
+}
+
+void FTCPLoggingBinaryWriter::WriteFloat(FAnsiStringView Key, float Value)
+{
+	ANSICHAR Text[TCPLoggingMaxNumberText];
+	WriteToken((uint8) EToken::NumberText);
+	WriteLiteral(Key);
+	WriteLiteral(TCPLoggingFormatFloat(Value, Text));
+}
+
+void FTCPLoggingBinaryWriter::WriteBool(FAnsiStringView Key, bool Value)
+{
+	WriteToken((uint8) EToken::NumberText);
+	WriteLiteral(Key);
+	WriteLiteral(Value ? FAnsiStringView("true") : FAnsiStringView("false"));
+}
+
+void FTCPLoggingBinaryWriter::WriteNumberText(FAnsiStringView Key, const FString& Value)
+{
+	WriteToken((uint8) EToken::NumberText);
+	WriteLiteral(Key);
+	WriteLiteral(Value);
+}
+
+void FTCPLoggingBinaryWriter::WriteStringAttribute(FAnsiStringView Name, const FString& Value)
+{
+	BeginObject();
+	WriteAsciiString("name", Name);
+	WriteString("value", Value);
+	EndObject();
+}
+
+void FTCPLoggingBinaryWriter::WriteIntegerAttribute(FAnsiStringView Name, int64 Value)
+{
+	BeginObject();
+	WriteAsciiString("name", Name);
+	WriteInteger("value", Value);
+	EndObject();
+}
+
+void FTCPLoggingBinaryWriter::WriteDoubleAttribute(FAnsiStringView Name, double Value)
+{
+	BeginObject();
+	WriteAsciiString("name", Name);
+	WriteDouble("value", Value);
+	EndObject();
+}
+
+void FTCPLoggingBinaryWriter::WriteFloatAttribute(FAnsiStringView Name, float Value)
+{
+	BeginObject();
+	WriteAsciiString("name", Name);
+	WriteFloat("value", Value);
+	EndObject();
+}
+
+void FTCPLoggingBinaryWriter::WriteAttributes(const TArray<FAnalyticsEventAttribute>& Attributes)
+{
+	BeginArray("attributes");
+	for (const FAnalyticsEventAttribute& Attr : Attributes)
+	{
+		BeginObject();
+		WriteString("name", Attr.GetName());
+		if (Attr.IsJsonFragment())
+		{
+			WriteNumberText("value", Attr.GetValue());
+		}
+		else
+		{
+			WriteString("value", Attr.GetValue());
+		}
+		EndObject();
+	}
+	EndArray();
+}
+
+void FTCPLoggingBinaryWriter::WriteAttributes(TArrayView<const FTCPLoggingAttribute> Attributes)
+{
+	BeginArray("attributes");
+	for (const FTCPLoggingAttribute& Attr : Attributes)
+	{
+		BeginObject();
+		WriteAsciiString("name", Attr.Name);
+		switch (Attr.Type)
+		{
+			case FTCPLoggingAttribute::EType::Integer:
+				WriteInteger("value", Attr.Integer);
+				break;
+			case FTCPLoggingAttribute::EType::Double:
+				WriteDouble("value", Attr.Double);
+				break;
+			case FTCPLoggingAttribute::EType::Float:
+				WriteFloat("value", Attr.Float);
+				break;
+			case FTCPLoggingAttribute::EType::Bool:
+				WriteBool("value", Attr.Bool);
+				break;
+			case FTCPLoggingAttribute::EType::String:
+				WriteString("value", *Attr.String);
+				break;
+		}
+		EndObject();
+	}
+	EndArray();
+}
+
+void FTCPLoggingBinaryWriter::EndMessage()
+{
+	check(Depth == 0);
+	WriteUInt32(Buffer.GetData() + RecordStart, (uint32) (Buffer.Num() - RecordStart - 4));
+}
+
+void FTCPLoggingBinaryWriter::SpliceFields(TArray<uint8>& Out, const uint8* Message, int32 Count, const TArray<uint8>& Fields)
+{
+	// The record size is the only length in a record, tokens need no fixing up wherever they move
+	const int32 FieldsOffset = RecordHeaderSize + 1;
+	check(Count >= FieldsOffset && Message[4] == (uint8) ERecordKind::Event && Message[5] == (uint8) EToken::BeginObject);
+	const int32 Start = Out.AddUninitialized(4);
+	WriteUInt32(Out.GetData() + Start, (uint32) (Count - 4 + Fields.Num()));
+	Out.Append(Message + 4, FieldsOffset - 4);
+	Out.Append(Fields);
+	Out.Append(Message + FieldsOffset, Count - FieldsOffset);
+}
+
+void FTCPLoggingBinaryWriter::WriteToken(uint8 Token)
+{
+	Buffer.Add(Token);
+}
+
+void FTCPLoggingBinaryWriter::WriteLiteral(FAnsiStringView Text)
+{
+	WriteVarInt(Buffer, ((uint64) Text.Len() << 2) | (uint64) ESlotTag::Literal);
+	Buffer.Append((const uint8*) Text.GetData(), Text.Len());
+}
+
+void FTCPLoggingBinaryWriter::WriteLiteral(const FString& Text)
+{
+	// The UTF-8 length is only known after encoding, reserve a one byte tag and widen it in the rare case that is too small
+	const int32 TagOffset = Buffer.Add(0);
+	TCPLoggingAppendUtf8(Buffer, *Text, Text.Len());
+	const int32 Len = Buffer.Num() - TagOffset - 1;
+	if (Len <= MaxShortLiteralLength)
+	{
+		Buffer[TagOffset] = (uint8) (((uint32) Len << 2) | (uint32) ESlotTag::Literal);
+		return;
+	}
+
+	TArray<uint8, TInlineAllocator<10>> Tag;
+	uint64 Value = ((uint64) Len << 2) | (uint64) ESlotTag::Literal;
+	while (Value >= 0x80)
+	{
+		Tag.Add((uint8) (Value | 0x80));
+		Value >>= 7;
+	}
+	Tag.Add((uint8) Value);
+	Buffer.InsertUninitialized(TagOffset + 1, Tag.Num() - 1);
+	FMemory::Memcpy(Buffer.GetData() + TagOffset, Tag.GetData(), Tag.Num());
+}
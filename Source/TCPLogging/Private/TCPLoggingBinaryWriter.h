@@ -0,0 +1,74 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "AnalyticsEventAttribute.h"
+#include "Containers/ArrayView.h"
+#include "Containers/StringView.h"
+#include "CoreMinimal.h"
+#include "TCPLoggingAttribute.h"
+
+/**
+ * Binary counterpart of FTCPLoggingJsonWriter with the same interface, so an event is serialized by the same code
+ * whichever protocol is selected. Writes one Event record of TCPLoggingBinaryProtocol.h with every string as a literal,
+ * interning happens later on the sender thread. Numbers are written as varints and raw doubles, nothing is formatted.
+ */
+class FTCPLoggingBinaryWriter
+{
+public:
+	explicit FTCPLoggingBinaryWriter(TArray<uint8>& InBuffer);
+
+	void BeginObject();
+	void EndObject();
+
+	void BeginArray(FAnsiStringView Key);
+	void EndArray();
+
+	void WriteString(FAnsiStringView Key, const FString& Value);
+	void WriteAsciiString(FAnsiStringView Key, FAnsiStringView Value);
+	void WriteInteger(FAnsiStringView Key, int64 Value);
+	void WriteDouble(FAnsiStringView Key, double Value);
+	/** Sent as number text at float precision, a raw double would carry the noise of widening it */
+	void WriteFloat(FAnsiStringView Key, float Value);
+	/** Sent as number text, the protocol has no token of its own for it */
+	void WriteBool(FAnsiStringView Key, bool Value);
+	void WriteNumberText(FAnsiStringView Key, const FString& Value);
+
+	void WriteStringAttribute(FAnsiStringView Name, const FString& Value);
+	void WriteIntegerAttribute(FAnsiStringView Name, int64 Value);
+	void WriteDoubleAttribute(FAnsiStringView Name, double Value);
+	void WriteFloatAttribute(FAnsiStringView Name, float Value);
+
+	void WriteAttributes(const TArray<FAnalyticsEventAttribute>& Attributes);
+	void WriteAttributes(TArrayView<const FTCPLoggingAttribute> Attributes);
+
+	/** Completes the record, must follow the closing EndObject */
+	void EndMessage();
+
+	/** Serializes fields once as bare tokens for SpliceFields to put into any number of records */
+	template <typename FuncType>
+	static void SerializeFields(TArray<uint8>& OutFields, FuncType&& WriteFields)
+	{
+		TArray<uint8> Record;
+		FTCPLoggingBinaryWriter Writer(Record);
+		Writer.BeginObject();
+		const int32 FieldsStart = Record.Num();
+		WriteFields(Writer);
+		Writer.EndObject();
+		OutFields.Reset();
+		OutFields.Append(Record.GetData() + FieldsStart, Record.Num() - FieldsStart - 1);
+	}
+
+	/** Appends a whole Event record to Out with Fields from SerializeFields inserted ahead of the record's own */
+	static void SpliceFields(TArray<uint8>& Out, const uint8* Message, int32 Count, const TArray<uint8>& Fields);
+
+private:
+	void WriteToken(uint8 Token);
+	void WriteLiteral(FAnsiStringView Text);
+	void WriteLiteral(const FString& Text);
+
+	TArray<uint8>& Buffer;
+	/** Where this record's size goes once it is complete */
+	int32 RecordStart;
+	int32 Depth;
+};
@@ -0,0 +1,218 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Event.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "TCPLoggingLane.h"
+#include "TCPLoggingQueue.h"
+
+#include <atomic>
+
+/** Messages one thread recorded back to back in one lane, in the order it recorded them */
+struct FTCPLoggingStagedChunk
+{
+	TArray<uint8> Data;
+	/** End offset of every message in Data */
+	TArray<uint32> MessageEnds;
+	ETCPLoggingLane Lane = ETCPLoggingLane::Bulk;
+	/** When the first message was staged, for measuring how long events take to reach the wire */
+	uint64 FirstStagedCycles = 0;
+	/** Slab chunks an oversize chunk stands in for, zero for every other chunk */
+	int32 SlabChunksTaken = 0;
+};
+
+/**
+ * Recycles staging chunks between the recording threads and the sender so that serializing an event
+ * does not allocate once the pool has warmed up.
+ *
+ * With a slab, every chunk is allocated up front and no more are ever made: Acquire fails once all of them hold staged
+ * messages, which is what bounds the memory staged events take. Staging never grows a chunk, a message too big for one
+ * gets an oversize chunk of its own that frees as many slab chunks as its size covers while it is in use, so the slab
+ * is a hard cap on staged memory either way.
+ */
+class FTCPLoggingBufferPool
+{
+public:
+	FTCPLoggingBufferPool(int32 MaxPooledBuffers, int32 InInitialBufferSize, int32 InMaxRetainedBufferSize, int32 InSlabChunks = 0)
+		: FreeBuffers(FMath::Max(MaxPooledBuffers, InSlabChunks))
+		, InitialBufferSize(InInitialBufferSize)
+		, MaxRetainedBufferSize(InMaxRetainedBufferSize)
+		, SlabChunks(InSlabChunks)
+		, ReleaseEvent(nullptr)
+		, Waiters(0)
+	{
+		for (int32 Index = 0; Index < SlabChunks; ++Index)
+		{
+			FTCPLoggingStagedChunk Chunk;
+			Reserve(Chunk);
+			FreeBuffers.Enqueue(MoveTemp(Chunk));
+		}
+		if (SlabChunks > 0)
+		{
+			ReleaseEvent = FPlatformProcess::GetSynchEventFromPool(false);
+		}
+	}
+
+	~FTCPLoggingBufferPool()
+	{
+		if (ReleaseEvent != nullptr)
+		{
+			FPlatformProcess::ReturnSynchEventToPool(ReleaseEvent);
+			ReleaseEvent = nullptr;
+		}
+	}
+
+	UE_NONCOPYABLE(FTCPLoggingBufferPool);
+
+	/** True if the pool is a fixed slab rather than allocating on demand */
+	bool HasSlab() const
+	{
+		return SlabChunks > 0;
+	}
+
+	/** Bytes preallocated for the slab */
+	int64 GetSlabBytes() const
+	{
+		return (int64) SlabChunks * InitialBufferSize;
+	}
+
+	/**
+	 * Hands out an empty chunk, reusing a released allocation when one is available. Only fails with a slab, once every
+	 * chunk of it is in use. Safe to call from any thread
+	 */
+	bool Acquire(FTCPLoggingStagedChunk& OutChunk)
+	{
+		if (FreeBuffers.Dequeue(OutChunk))
+		{
+			return true;
+		}
+		if (HasSlab())
+		{
+			return false;
+		}
+		OutChunk = FTCPLoggingStagedChunk();
+		Reserve(OutChunk);
+		return true;
+	}
+
+	/** Bytes of messages a chunk from Acquire holds without reallocating */
+	int32 GetChunkCapacity() const
+	{
+		return InitialBufferSize;
+	}
+
+	/**
+	 * Hands out an empty chunk with room for one message of Bytes, more than GetChunkCapacity. With a slab it takes the
+	 * place of as many free slab chunks as its size covers, freeing their memory until it is released, and fails if
+	 * that many are not free. Allocates, unlike Acquire, which is why only messages that fit nowhere else come here
+	 */
+	bool AcquireOversize(int32 Bytes, FTCPLoggingStagedChunk& OutChunk)
+	{
+		OutChunk = FTCPLoggingStagedChunk();
+		if (HasSlab())
+		{
+			const int32 Needed = FMath::DivideAndRoundUp(Bytes, InitialBufferSize);
+			TArray<FTCPLoggingStagedChunk, TInlineAllocator<4>> Taken;
+			FTCPLoggingStagedChunk Chunk;
+			while (Taken.Num() < Needed && FreeBuffers.Dequeue(Chunk))
+			{
+				Taken.Add(MoveTemp(Chunk));
+			}
+			if (Taken.Num() < Needed)
+			{
+				for (FTCPLoggingStagedChunk& Untaken : Taken)
+				{
+					Release(MoveTemp(Untaken));
+				}
+				return false;
+			}
+			// Their memory goes with Taken, the oversize chunk's takes its place
+			OutChunk.SlabChunksTaken = Needed;
+		}
+		OutChunk.Data.Reserve(Bytes);
+		OutChunk.MessageEnds.Reserve(InitialMessageEnds);
+		return true;
+	}
+
+	/** Acquire that waits up to TimeoutSeconds for another thread to release a chunk while the slab is used up */
+	bool AcquireWithin(FTCPLoggingStagedChunk& OutChunk, double TimeoutSeconds)
+	{
+		// Only a slab runs out, and a slab always has the event
+		if (Acquire(OutChunk))
+		{
+			return true;
+		}
+
+		const double Deadline = FPlatformTime::Seconds() + TimeoutSeconds;
+		bool bAcquired = false;
+		Waiters.fetch_add(1, std::memory_order_seq_cst);
+		for (double Now = FPlatformTime::Seconds(); !bAcquired && Now < Deadline; Now = FPlatformTime::Seconds())
+		{
+			// Checked again after registering as a waiter, a release in between would not have triggered the event
+			bAcquired = Acquire(OutChunk);
+			if (!bAcquired)
+			{
+				ReleaseEvent->Wait(FMath::Max(1u, (uint32) ((Deadline - Now) * 1000.0)));
+			}
+		}
+		Waiters.fetch_sub(1, std::memory_order_relaxed);
+		return bAcquired || Acquire(OutChunk);
+	}
+
+	/**
+	 * Hands a chunk back for reuse. An oversize chunk is freed and the slab chunks it stood in for are allocated again.
+	 * Without a slab, oversized chunks and chunks beyond the pool capacity are freed
+	 */
+	void Release(FTCPLoggingStagedChunk&& Chunk)
+	{
+		if (Chunk.SlabChunksTaken > 0)
+		{
+			const int32 SlabChunksTaken = Chunk.SlabChunksTaken;
+			Chunk = FTCPLoggingStagedChunk();
+			for (int32 Index = 0; Index < SlabChunksTaken; ++Index)
+			{
+				FTCPLoggingStagedChunk Restored;
+				Reserve(Restored);
+				FreeBuffers.Enqueue(MoveTemp(Restored));
+			}
+		}
+		else
+		{
+			// Staging never grows a chunk, so slab chunks come back at the size they were allocated with
+			if (!HasSlab() && Chunk.Data.Max() > MaxRetainedBufferSize)
+			{
+				return;
+			}
+			Chunk.Data.Reset();
+			Chunk.MessageEnds.Reset();
+			FreeBuffers.Enqueue(MoveTemp(Chunk));
+		}
+
+		if (Waiters.load(std::memory_order_seq_cst) > 0)
+		{
+			ReleaseEvent->Trigger();
+		}
+	}
+
+private:
+	/** Message ends reserved per chunk, enough for chunks of small events to never grow them */
+	static constexpr int32 InitialMessageEnds = 128;
+
+	void Reserve(FTCPLoggingStagedChunk& Chunk) const
+	{
+		Chunk.Data.Reserve(InitialBufferSize);
+		Chunk.MessageEnds.Reserve(InitialMessageEnds);
+	}
+
+	TTCPLoggingBoundedQueue<FTCPLoggingStagedChunk> FreeBuffers;
+	const int32 InitialBufferSize;
+	const int32 MaxRetainedBufferSize;
+	/** Number of chunks in the slab, zero without one */
+	const int32 SlabChunks;
+	/** Wakes recording threads blocked in AcquireWithin, only created with a slab */
+	FEvent* ReleaseEvent;
+	std::atomic<int32> Waiters;
+};
@@ -0,0 +1,224 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "TCPLoggingCompression.h"
+
+#include "Misc/Compression.h"
+#include "TCPLoggingLog.h"
+
+static FName GetCompressionFormatName(ETCPLoggingCompression Compression)
+{
+	switch (Compression)
+	{
+		case ETCPLoggingCompression::Zlib:
+			return NAME_Zlib;
+		case ETCPLoggingCompression::LZ4:
+			return NAME_LZ4;
+		default:
+			return NAME_None;
+	}
+}
+
+static void WriteUInt32(uint8* Dest, uint32 Value)
+{
+	Dest[0] = (uint8) Value;
+	Dest[1] = (uint8) (Value >> 8);
+	Dest[2] = (uint8) (Value >> 16);
+	Dest[3] = (uint8) (Value >> 24);
+}
+
+static uint32 ReadUInt32(const uint8* Data)
+{
+	return (uint32) Data[0] | ((uint32) Data[1] << 8) | ((uint32) Data[2] << 16) | ((uint32) Data[3] << 24);
+}
+
+bool LexTryParseString(ETCPLoggingCompression& OutCompression, const TCHAR* Text)
+{
+	for (ETCPLoggingCompression Compression : {ETCPLoggingCompression::None, ETCPLoggingCompression::Zlib, ETCPLoggingCompression::LZ4})
+	{
+		if (FCString::Stricmp(Text, LexToString(Compression)) == 0)
+		{
+			OutCompression = Compression;
+			return true;
+		}
+	}
+	return false;
+}
+
+const TCHAR* LexToString(ETCPLoggingCompression Compression)
+{
+	switch (Compression)
+	{
+		case ETCPLoggingCompression::Zlib:
+			return TEXT("zlib");
+		case ETCPLoggingCompression::LZ4:
+			return TEXT("lz4");
+		default:
+			return TEXT("none");
+	}
+}
+
+bool LexTryParseString(ETCPLoggingPayloadFormat& OutFormat, const TCHAR* Text)
+{
+	for (ETCPLoggingPayloadFormat Format : {ETCPLoggingPayloadFormat::Json, ETCPLoggingPayloadFormat::Binary})
+	{
+		if (FCString::Stricmp(Text, LexToString(Format)) == 0)
+		{
+			OutFormat = Format;
+			return true;
+		}
+	}
+	return false;
+}
+
+const TCHAR* LexToString(ETCPLoggingPayloadFormat Format)
+{
+	return Format == ETCPLoggingPayloadFormat::Binary ? TEXT("binary") : TEXT("json");
+}
+
+FTCPLoggingFrameEncoder::FTCPLoggingFrameEncoder(
+	ETCPLoggingCompression InCompression, ETCPLoggingPayloadFormat InPayloadFormat, bool bInSequenced)
+	: Compression(InCompression)
+	, PayloadFormat(InPayloadFormat)
+	, FormatName(GetCompressionFormatName(InCompression))
+	, bSequenced(bInSequenced)
+{
+}
+
+void FTCPLoggingFrameEncoder::WriteStreamHeader(TArray<uint8>& Out) const
+{
+	const uint8 Header[TCPLoggingWireFormat::StreamHeaderSize] = {
+		'T', 'C', 'P', 'L', TCPLoggingWireFormat::Version, (uint8) Compression, (uint8) PayloadFormat,
+		bSequenced ? TCPLoggingWireFormat::StreamFlagSequenced : (uint8) 0};
+	Out.Append(Header, TCPLoggingWireFormat::StreamHeaderSize);
+}
+
+void FTCPLoggingFrameEncoder::EncodeFrame(const uint8* Data, int32 Count, TArray<uint8>& Out) const
+{
+	const int32 HeaderOffset = Out.Num();
+	const int32 PayloadOffset =
+		HeaderOffset + (bSequenced ? TCPLoggingWireFormat::SequencedFrameHeaderSize : TCPLoggingWireFormat::FrameHeaderSize);
+
+	// Compress straight into the output, falling back to storing the bytes if that does not pay off
+	int32 CompressedSize = Compression != ETCPLoggingCompression::None ? FCompression::CompressMemoryBound(FormatName, Count) : 0;
+	Out.SetNumUninitialized(PayloadOffset + FMath::Max(CompressedSize, Count), false);
+	const bool bCompressed = CompressedSize > 0
+		&& FCompression::CompressMemory(FormatName, Out.GetData() + PayloadOffset, CompressedSize, Data, Count, COMPRESS_BiasSpeed)
+		&& CompressedSize < Count;
+	if (!bCompressed)
+	{
+		CompressedSize = 0;
+		FMemory::Memcpy(Out.GetData() + PayloadOffset, Data, Count);
+	}
+	Out.SetNum(PayloadOffset + (bCompressed ? CompressedSize : Count), false);
+
+	WriteUInt32(Out.GetData() + HeaderOffset, (uint32) Count);
+	WriteUInt32(Out.GetData() + HeaderOffset + 4, (uint32) CompressedSize);
+	if (bSequenced)
+	{
+		WriteUInt32(Out.GetData() + HeaderOffset + 8, 0);
+		WriteUInt32(Out.GetData() + HeaderOffset + 12, 0);
+	}
+}
+
+void FTCPLoggingFrameEncoder::StampSequence(TArray<uint8>& Frame, uint64 Sequence) const
+{
+	check(bSequenced && Frame.Num() >= TCPLoggingWireFormat::SequencedFrameHeaderSize);
+	WriteUInt32(Frame.GetData() + 8, (uint32) Sequence);
+	WriteUInt32(Frame.GetData() + 12, (uint32) (Sequence >> 32));
+}
+
+FTCPLoggingFrameDecoder::FTCPLoggingFrameDecoder()
+	: Compression(ETCPLoggingCompression::None)
+	, PayloadFormat(ETCPLoggingPayloadFormat::Json)
+	, LastSequence(0)
+	, bHasStreamHeader(false)
+	, bSequenced(false)
+	, bFailed(false)
+{
+}
+
+bool FTCPLoggingFrameDecoder::Decode(const uint8* Data, int32 Count, TArray<uint8>& Out)
+{
+	if (bFailed)
+	{
+		return false;
+	}
+	Pending.Append(Data, Count);
+
+	int32 Offset = 0;
+	if (!bHasStreamHeader)
+	{
+		if (Pending.Num() < TCPLoggingWireFormat::StreamHeaderSize)
+		{
+			return true;
+		}
+		const uint8* Header = Pending.GetData();
+		const uint8 Codec = Header[5];
+		const uint8 Format = Header[6];
+		const uint8 Flags = Header[7];
+		if (FMemory::Memcmp(Header, "TCPL", 4) != 0 || Header[4] != TCPLoggingWireFormat::Version
+			|| Codec > (uint8) ETCPLoggingCompression::LZ4 || Format > (uint8) ETCPLoggingPayloadFormat::Binary
+			|| (Flags & ~TCPLoggingWireFormat::StreamFlagSequenced) != 0)
+		{
+			UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Invalid analytics stream header"));
+			bFailed = true;
+			return false;
+		}
+		Compression = (ETCPLoggingCompression) Codec;
+		PayloadFormat = (ETCPLoggingPayloadFormat) Format;
+		FormatName = GetCompressionFormatName(Compression);
+		bSequenced = (Flags & TCPLoggingWireFormat::StreamFlagSequenced) != 0;
+		bHasStreamHeader = true;
+		Offset = TCPLoggingWireFormat::StreamHeaderSize;
+	}
+
+	const int32 FrameHeaderSize =
+		bSequenced ? TCPLoggingWireFormat::SequencedFrameHeaderSize : TCPLoggingWireFormat::FrameHeaderSize;
+	while (Pending.Num() - Offset >= FrameHeaderSize)
+	{
+		const uint32 UncompressedSize = ReadUInt32(Pending.GetData() + Offset);
+		const uint32 CompressedSize = ReadUInt32(Pending.GetData() + Offset + 4);
+		if (UncompressedSize > TCPLoggingWireFormat::MaxFrameSize || CompressedSize > TCPLoggingWireFormat::MaxFrameSize
+			|| (CompressedSize != 0 && Compression == ETCPLoggingCompression::None))
+		{
+			UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Invalid analytics frame header (%u/%u bytes)"), UncompressedSize,
+				CompressedSize);
+			bFailed = true;
+			return false;
+		}
+
+		const int32 PayloadSize = (int32) (CompressedSize != 0 ? CompressedSize : UncompressedSize);
+		if (Pending.Num() - Offset - FrameHeaderSize < PayloadSize)
+		{
+			break;
+		}
+
+		const uint8* Payload = Pending.GetData() + Offset + FrameHeaderSize;
+		if (CompressedSize == 0)
+		{
+			Out.Append(Payload, PayloadSize);
+		}
+		else
+		{
+			const int32 OutOffset = Out.Num();
+			Out.SetNumUninitialized(OutOffset + (int32) UncompressedSize, false);
+			if (!FCompression::UncompressMemory(FormatName, Out.GetData() + OutOffset, (int32) UncompressedSize, Payload, PayloadSize))
+			{
+				UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Failed to decompress (%d) byte analytics frame"), PayloadSize);
+				Out.SetNum(OutOffset, false);
+				bFailed = true;
+				return false;
+			}
+		}
+		if (bSequenced)
+		{
+			const uint64 Sequence = (uint64) ReadUInt32(Pending.GetData() + Offset + 8)
+				| ((uint64) ReadUInt32(Pending.GetData() + Offset + 12) << 32);
+			LastSequence = FMath::Max(LastSequence, Sequence);
+		}
+		Offset += FrameHeaderSize + PayloadSize;
+	}
+
+	Pending.RemoveAt(0, Offset, false);
+	return true;
+}
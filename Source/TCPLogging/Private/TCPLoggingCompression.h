@@ -0,0 +1,140 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/** Codec applied to batches on the wire, the value is what the stream header carries */
+enum class ETCPLoggingCompression : uint8
+{
+	/** Frames are stored as is, and JSON payloads are not framed at all */
+	None = 0,
+	Zlib = 1,
+	LZ4 = 2,
+};
+
+/** Encoding of the events inside the stream, the value is what the stream header carries */
+enum class ETCPLoggingPayloadFormat : uint8
+{
+	/** NDJSON lines */
+	Json = 0,
+	/** Records of TCPLoggingBinaryProtocol.h */
+	Binary = 1,
+};
+
+/** Parses the TCPLoggingProtocol config value ("json" or "binary"). Returns false for anything else */
+bool LexTryParseString(ETCPLoggingPayloadFormat& OutFormat, const TCHAR* Text);
+const TCHAR* LexToString(ETCPLoggingPayloadFormat Format);
+
+/** Parses the TCPLoggingCompression config value ("none", "zlib" or "lz4"). Returns false for anything else */
+bool LexTryParseString(ETCPLoggingCompression& OutCompression, const TCHAR* Text);
+const TCHAR* LexToString(ETCPLoggingCompression Compression);
+
+/**
+ * Framed wire format, used whenever compression or the binary protocol is enabled. A connection opens with an
+ * 8 byte stream header naming the codec and payload format:
+ *
+ *   'T' 'C' 'P' 'L' | version (1) | codec (ETCPLoggingCompression) | format (ETCPLoggingPayloadFormat) | flags
+ *
+ * followed by frames, each holding one or more whole NDJSON lines or binary records:
+ *
+ *   uncompressed size (uint32 LE) | compressed size (uint32 LE) | [sequence (uint64 LE)] | payload
+ *
+ * A compressed size of 0 means the payload is stored as is, used when compressing would not make it smaller.
+ *
+ * With StreamFlagSequenced set every frame carries the sequence number and the collector acknowledges them: once it
+ * has committed a frame it sends back that frame's sequence as a uint64 LE, which covers every earlier frame of the
+ * connection too. Sequences increase with every frame of a session and survive reconnects, so frames replayed after
+ * a lost connection arrive with the numbers they had before and a collector can drop what it already committed.
+ * Sequence 0 marks frames that are never acknowledged, such as the session preamble.
+ */
+namespace TCPLoggingWireFormat
+{
+	static constexpr int32 StreamHeaderSize = 8;
+	static constexpr int32 FrameHeaderSize = 8;
+	static constexpr int32 SequencedFrameHeaderSize = 16;
+	static constexpr int32 AckSize = 8;
+	static constexpr uint8 Version = 1;
+	static constexpr uint8 StreamFlagSequenced = 0x01;
+	/** Frames claiming more than this are treated as a corrupt stream by the decoder */
+	static constexpr uint32 MaxFrameSize = 64 * 1024 * 1024;
+}
+
+/** Produces the framed wire format */
+class FTCPLoggingFrameEncoder
+{
+public:
+	FTCPLoggingFrameEncoder(
+		ETCPLoggingCompression InCompression, ETCPLoggingPayloadFormat InPayloadFormat, bool bInSequenced = false);
+
+	ETCPLoggingCompression GetCompression() const
+	{
+		return Compression;
+	}
+
+	/** Appends the stream header that starts every connection */
+	void WriteStreamHeader(TArray<uint8>& Out) const;
+
+	/** Appends Data as a single frame, with sequence 0 if the stream is sequenced */
+	void EncodeFrame(const uint8* Data, int32 Count, TArray<uint8>& Out) const;
+
+	/** Sets the sequence of the frame Frame starts with, only for sequenced streams */
+	void StampSequence(TArray<uint8>& Frame, uint64 Sequence) const;
+
+private:
+	ETCPLoggingCompression Compression;
+	ETCPLoggingPayloadFormat PayloadFormat;
+	FName FormatName;
+	bool bSequenced;
+};
+
+/**
+ * Turns the framed wire format back into its payload, fed incrementally as bytes arrive.
+ * For the binary payload format the output still has to go through FTCPLoggingBinaryDecoder to become NDJSON.
+ */
+class FTCPLoggingFrameDecoder
+{
+public:
+	FTCPLoggingFrameDecoder();
+
+	/**
+	 * Consumes Count bytes of the stream and appends the payload of every frame they complete to Out.
+	 * Returns false once the stream is malformed, after which the decoder rejects everything.
+	 */
+	bool Decode(const uint8* Data, int32 Count, TArray<uint8>& Out);
+
+	/** Codec named by the stream header, None until the header has been read */
+	ETCPLoggingCompression GetCompression() const
+	{
+		return Compression;
+	}
+
+	/** Payload format named by the stream header, Json until the header has been read */
+	ETCPLoggingPayloadFormat GetPayloadFormat() const
+	{
+		return PayloadFormat;
+	}
+
+	/** True if the stream header asked for acknowledgements */
+	bool IsSequenced() const
+	{
+		return bSequenced;
+	}
+
+	/** Highest sequence of any frame decoded so far, 0 if none carried one */
+	uint64 GetLastSequence() const
+	{
+		return LastSequence;
+	}
+
+private:
+	/** Bytes of an incomplete header or frame carried over to the next call */
+	TArray<uint8> Pending;
+	ETCPLoggingCompression Compression;
+	ETCPLoggingPayloadFormat PayloadFormat;
+	FName FormatName;
+	uint64 LastSequence;
+	bool bHasStreamHeader;
+	bool bSequenced;
+	bool bFailed;
+};
@@ -0,0 +1,347 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "TCPLoggingConnection.h"
+
+#include "Async/Async.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "IPAddress.h"
+#include "Misc/ScopeLock.h"
+#include "SocketSubsystem.h"
+#include "Sockets.h"
+#include "TCPLoggingEndpoints.h"
+#include "TCPLoggingLog.h"
+#include "TCPLoggingStats.h"
+
+/** Resolved collector addresses shared by every connection, keyed by host name */
+struct FTCPLoggingHostCacheEntry
+{
+	TSharedPtr<FInternetAddr> Address;
+	double ExpiryTime;
+};
+
+static FCriticalSection GTCPLoggingHostCacheLock;
+static TMap<FString, FTCPLoggingHostCacheEntry> GTCPLoggingHostCache;
+
+static TSharedPtr<FInternetAddr> FindCachedHostAddress(const FString& Host, double Now)
+{
+	FScopeLock Lock(&GTCPLoggingHostCacheLock);
+	const FTCPLoggingHostCacheEntry* Entry = GTCPLoggingHostCache.Find(Host);
+	if (Entry != nullptr && Entry->ExpiryTime > Now)
+	{
+		return Entry->Address->Clone();
+	}
+	return nullptr;
+}
+
+static void CacheHostAddress(const FString& Host, const FInternetAddr& Address, double ExpiryTime)
+{
+	FScopeLock Lock(&GTCPLoggingHostCacheLock);
+	GTCPLoggingHostCache.Add(Host, FTCPLoggingHostCacheEntry{Address.Clone(), ExpiryTime});
+}
+
+static void EvictHostAddress(const FString& Host)
+{
+	FScopeLock Lock(&GTCPLoggingHostCacheLock);
+	GTCPLoggingHostCache.Remove(Host);
+}
+
+/** Sleep used while nothing but a pending resolve or connect can make progress */
+static constexpr double ConnectPollSeconds = 0.01;
+
+FTCPLoggingConnection::FTCPLoggingConnection(
+	FTCPLoggingEndpointSet& InEndpoints, TArray<int32>&& InOrder, const FTCPLoggingSenderSettings& InSettings)
+	: Endpoints(InEndpoints)
+	, Order(MoveTemp(InOrder))
+	, CurrentEndpoint(Order[0])
+	, Host(Endpoints.Get(CurrentEndpoint).Host)
+	, Port(Endpoints.Get(CurrentEndpoint).Port)
+	, Settings(InSettings)
+	, SocketSubsystem(ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM))
+	, Socket(nullptr)
+	, ResolveInfo(nullptr)
+	, State(ETCPLoggingConnectionState::Backoff)
+	, StateStartTime(0.0)
+	, RetryTime(0.0)
+	, ConnectedTime(0.0)
+	, FailedAttempts(0)
+	, Jitter((int32) FPlatformTime::Cycles())
+{
+}
+
+FTCPLoggingConnection::~FTCPLoggingConnection()
+{
+	DestroySocket();
+	ReleaseResolveInfo();
+}
+
+bool FTCPLoggingConnection::Tick(double Now)
+{
+	switch (State)
+	{
+		case ETCPLoggingConnectionState::Resolving:
+			PollResolve(Now);
+			break;
+		case ETCPLoggingConnectionState::Connecting:
+			PollConnect(Now);
+			break;
+		case ETCPLoggingConnectionState::Backoff:
+			if (Now >= RetryTime)
+			{
+				StartResolve(Now);
+			}
+			break;
+		case ETCPLoggingConnectionState::Connected:
+			break;
+	}
+	return IsConnected();
+}
+
+void FTCPLoggingConnection::Disconnect(double Now)
+{
+	if (State == ETCPLoggingConnectionState::Connected)
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Lost connection to analytics collector %s:%d"), *Host, Port);
+	}
+	HandleFailure(Now);
+}
+
+bool FTCPLoggingConnection::ShouldFailBack(double Now) const
+{
+	if (State != ETCPLoggingConnectionState::Connected)
+	{
+		return false;
+	}
+	for (const int32 Index : Order)
+	{
+		if (Index == CurrentEndpoint)
+		{
+			return false;
+		}
+		if (Endpoints.IsAvailable(Index, Now))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void FTCPLoggingConnection::FailBack(double Now)
+{
+	UE_LOG(LogTCPLoggingAnalytics, Log, TEXT("Leaving analytics collector %s:%d for a preferred one that may have recovered"), *Host,
+		Port);
+	DestroySocket();
+	State = ETCPLoggingConnectionState::Backoff;
+	StateStartTime = Now;
+	RetryTime = Now;
+}
+
+double FTCPLoggingConnection::GetPollDelay(double Now) const
+{
+	switch (State)
+	{
+		case ETCPLoggingConnectionState::Backoff:
+			return FMath::Max(RetryTime - Now, 0.0);
+		case ETCPLoggingConnectionState::Connected:
+			return 0.0;
+		default:
+			return ConnectPollSeconds;
+	}
+}
+
+void FTCPLoggingConnection::StartResolve(double Now)
+{
+	CurrentEndpoint = Endpoints.Pick(Order, Now);
+	Host = Endpoints.Get(CurrentEndpoint).Host;
+	Port = Endpoints.Get(CurrentEndpoint).Port;
+
+	if (TSharedPtr<FInternetAddr> Cached = FindCachedHostAddress(Host, Now))
+	{
+		StartConnect(Now, *Cached);
+		return;
+	}
+
+	ReleaseResolveInfo();
+	ResolveInfo = SocketSubsystem->GetHostByName(TCHAR_TO_ANSI(*Host));
+	if (ResolveInfo == nullptr)
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Unable to start resolving analytics host %s"), *Host);
+		HandleFailure(Now);
+		return;
+	}
+	StateStartTime = Now;
+	State = ETCPLoggingConnectionState::Resolving;
+}
+
+void FTCPLoggingConnection::PollResolve(double Now)
+{
+	if (!ResolveInfo->IsComplete())
+	{
+		// A hung lookup must not keep the connection from backing off or failing over to the next endpoint
+		if (Now - StateStartTime >= Settings.ConnectTimeoutSeconds)
+		{
+			UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Timed out resolving analytics host %s"), *Host);
+			ReleaseResolveInfo();
+			HandleFailure(Now);
+		}
+		return;
+	}
+
+	if (ResolveInfo->GetErrorCode() != 0)
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Failed to resolve analytics host %s (%d)"), *Host,
+			(int32) ResolveInfo->GetErrorCode());
+		ReleaseResolveInfo();
+		HandleFailure(Now);
+		return;
+	}
+
+	TSharedRef<FInternetAddr> Address = ResolveInfo->GetResolvedAddress().Clone();
+	ReleaseResolveInfo();
+	CacheHostAddress(Host, *Address, Now + Settings.HostCacheSeconds);
+	StartConnect(Now, *Address);
+}
+
+void FTCPLoggingConnection::StartConnect(double Now, const FInternetAddr& ResolvedAddress)
+{
+	TSharedRef<FInternetAddr> Address = ResolvedAddress.Clone();
+	Address->SetPort(Port);
+	PeerAddress = Address;
+
+	UE_LOG(LogTCPLoggingAnalytics, Log, TEXT("Connecting to analytics collector at %s"), *Address->ToString(true));
+
+	DestroySocket();
+	Socket = SocketSubsystem->CreateSocket(NAME_Stream, TEXT("TCPLogging"), Address->GetProtocolType());
+	if (Socket == nullptr)
+	{
+		HandleFailure(Now);
+		return;
+	}
+	Socket->SetNonBlocking(true);
+	Socket->SetNoDelay(true);
+
+	StateStartTime = Now;
+	State = ETCPLoggingConnectionState::Connecting;
+
+	if (!Socket->Connect(*Address))
+	{
+		// A non-blocking connect normally reports that it is still in progress
+		const ESocketErrors Error = SocketSubsystem->GetLastErrorCode();
+		if (Error != SE_EINPROGRESS && Error != SE_EWOULDBLOCK)
+		{
+			UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Failed to connect to analytics collector %s:%d (%s)"), *Host, Port,
+				SocketSubsystem->GetSocketError(Error));
+			EvictHostAddress(Host);
+			HandleFailure(Now);
+		}
+	}
+}
+
+void FTCPLoggingConnection::PollConnect(double Now)
+{
+	switch (Socket->GetConnectionState())
+	{
+		case SCS_Connected:
+			// The socket stays non-blocking, the sender's socket writer deals with partial writes
+			State = ETCPLoggingConnectionState::Connected;
+			if (ConnectedTime > 0.0)
+			{
+				INC_DWORD_STAT(STAT_TCPLogging_Reconnects);
+				CSV_CUSTOM_STAT(TCPLogging, Reconnects, 1, ECsvCustomStatOp::Accumulate);
+			}
+			ConnectedTime = Now;
+			Endpoints.MarkConnected(CurrentEndpoint);
+			UE_LOG(LogTCPLoggingAnalytics, Log, TEXT("Connected to analytics collector %s:%d"), *Host, Port);
+			break;
+
+		case SCS_ConnectionError:
+			UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Failed to connect to analytics collector %s:%d"), *Host, Port);
+			EvictHostAddress(Host);
+			HandleFailure(Now);
+			break;
+
+		default:
+			if (Now - StateStartTime >= Settings.ConnectTimeoutSeconds)
+			{
+				UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Timed out connecting to analytics collector %s:%d"), *Host, Port);
+				EvictHostAddress(Host);
+				HandleFailure(Now);
+			}
+			break;
+	}
+}
+
+void FTCPLoggingConnection::HandleFailure(double Now)
+{
+	const bool bWasStable =
+		State == ETCPLoggingConnectionState::Connected && Now - ConnectedTime >= Settings.ReconnectMaxDelaySeconds;
+	Endpoints.MarkFailed(CurrentEndpoint, Now, bWasStable);
+
+	for (const int32 Index : Order)
+	{
+		if (Endpoints.IsAvailable(Index, Now))
+		{
+			// Fail over without waiting, the backoff is for when every collector is down
+			DestroySocket();
+			State = ETCPLoggingConnectionState::Backoff;
+			StateStartTime = Now;
+			RetryTime = Now;
+			return;
+		}
+	}
+	EnterBackoff(Now);
+}
+
+void FTCPLoggingConnection::EnterBackoff(double Now)
+{
+	// A connection that stayed up for a while counts as recovered, one that drops straight away keeps backing off
+	if (State == ETCPLoggingConnectionState::Connected && Now - ConnectedTime >= Settings.ReconnectMaxDelaySeconds)
+	{
+		FailedAttempts = 0;
+	}
+
+	const double Delay = FMath::Min(
+		Settings.ReconnectMaxDelaySeconds, Settings.ReconnectBaseDelaySeconds * (double) (1 << FMath::Min(FailedAttempts, 16)));
+	++FailedAttempts;
+
+	DestroySocket();
+	State = ETCPLoggingConnectionState::Backoff;
+	StateStartTime = Now;
+	RetryTime = Now + Jitter.FRandRange(Delay * 0.5, Delay);
+}
+
+void FTCPLoggingConnection::DestroySocket()
+{
+	if (Socket != nullptr)
+	{
+		Socket->Close();
+		SocketSubsystem->DestroySocket(Socket);
+		Socket = nullptr;
+	}
+}
+
+void FTCPLoggingConnection::ReleaseResolveInfo()
+{
+	if (ResolveInfo == nullptr)
+	{
+		return;
+	}
+
+	if (ResolveInfo->IsComplete())
+	{
+		delete ResolveInfo;
+	}
+	else
+	{
+		// The lookup cannot be cancelled, let a background task wait it out instead of blocking the caller
+		FResolveInfo* PendingResolve = ResolveInfo;
+		AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [PendingResolve]() {
+			while (!PendingResolve->IsComplete())
+			{
+				FPlatformProcess::Sleep(0.01f);
+			}
+			delete PendingResolve;
+		});
+	}
+	ResolveInfo = nullptr;
+}
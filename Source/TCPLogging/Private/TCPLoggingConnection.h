@@ -0,0 +1,122 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Math/RandomStream.h"
+#include "TCPLoggingSenderSettings.h"
+#include "Templates/SharedPointer.h"
+
+class FInternetAddr;
+class FResolveInfo;
+class FSocket;
+class FTCPLoggingEndpointSet;
+class ISocketSubsystem;
+
+enum class ETCPLoggingConnectionState : uint8
+{
+	/** Waiting for the host name lookup to complete */
+	Resolving,
+	/** Non-blocking connect issued, waiting for the socket to become writable */
+	Connecting,
+	/** Socket is usable */
+	Connected,
+	/** Last attempt failed, waiting before trying again */
+	Backoff,
+};
+
+/**
+ * Resolves and connects to a collector without ever blocking the caller.
+ * Tick is polled by the sender thread and advances Resolving -> Connecting -> Connected, falling back to Backoff on failure.
+ * Resolved addresses are cached per host so reconnecting skips DNS until the cache entry expires.
+ * Every attempt goes to the first endpoint in the connection's order that is not cooling down, so a failure moves
+ * straight on to the next one. Only once all are down do retries use jittered exponential backoff, so a fleet of
+ * servers does not reconnect in lockstep after a collector restart.
+ */
+class FTCPLoggingConnection
+{
+public:
+	/** Order lists the endpoints to try, most preferred first */
+	FTCPLoggingConnection(FTCPLoggingEndpointSet& InEndpoints, TArray<int32>&& InOrder, const FTCPLoggingSenderSettings& InSettings);
+	~FTCPLoggingConnection();
+
+	UE_NONCOPYABLE(FTCPLoggingConnection);
+
+	/** Advances the state machine. Returns true if the socket is connected */
+	bool Tick(double Now);
+
+	/** Closes the socket and retries after the backoff delay */
+	void Disconnect(double Now);
+
+	/** True while connected to an endpoint when one earlier in the order has finished its cooldown */
+	bool ShouldFailBack(double Now) const;
+
+	/** Closes the socket without counting it as a failure and connects to the most preferred available endpoint */
+	void FailBack(double Now);
+
+	ETCPLoggingConnectionState GetState() const
+	{
+		return State;
+	}
+
+	bool IsConnected() const
+	{
+		return State == ETCPLoggingConnectionState::Connected;
+	}
+
+	/** True while an attempt is under way, i.e. resolving or connecting rather than waiting out a backoff */
+	bool IsConnecting() const
+	{
+		return State == ETCPLoggingConnectionState::Resolving || State == ETCPLoggingConnectionState::Connecting;
+	}
+
+	/** Connected socket, null in every other state */
+	FSocket* GetSocket() const
+	{
+		return IsConnected() ? Socket : nullptr;
+	}
+
+	/** Address the connected socket goes to, null in every other state */
+	const FInternetAddr* GetPeerAddress() const
+	{
+		return IsConnected() ? PeerAddress.Get() : nullptr;
+	}
+
+	/** Time until the next Tick can make progress, used by the sender to decide how long to sleep */
+	double GetPollDelay(double Now) const;
+
+private:
+	void StartResolve(double Now);
+	void PollResolve(double Now);
+	void StartConnect(double Now, const FInternetAddr& Address);
+	void PollConnect(double Now);
+	/** Puts the current endpoint into cooldown, then retries right away on another one or backs off if all are down */
+	void HandleFailure(double Now);
+	void EnterBackoff(double Now);
+	void DestroySocket();
+	void ReleaseResolveInfo();
+
+	FTCPLoggingEndpointSet& Endpoints;
+	TArray<int32> Order;
+	/** Endpoint of the current or last attempt */
+	int32 CurrentEndpoint;
+	FString Host;
+	int32 Port;
+	const FTCPLoggingSenderSettings& Settings;
+
+	ISocketSubsystem* SocketSubsystem;
+	FSocket* Socket;
+	TSharedPtr<FInternetAddr> PeerAddress;
+	FResolveInfo* ResolveInfo;
+
+	ETCPLoggingConnectionState State;
+	/** When the current state was entered, for resolve and connect timeouts */
+	double StateStartTime;
+	/** When the next attempt may start while in Backoff */
+	double RetryTime;
+	/** When the current connection was established */
+	double ConnectedTime;
+	/** Attempts that failed since the last stable connection, drives the backoff delay */
+	int32 FailedAttempts;
+	FRandomStream Jitter;
+};
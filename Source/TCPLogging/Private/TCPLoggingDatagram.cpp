@@ -0,0 +1,127 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "TCPLoggingDatagram.h"
+
+#include "IPAddress.h"
+#include "SocketSubsystem.h"
+#include "Sockets.h"
+#include "TCPLoggingLog.h"
+#include "TCPLoggingStats.h"
+
+bool LexTryParseString(ETCPLoggingTransport& OutTransport, const TCHAR* Text)
+{
+	for (ETCPLoggingTransport Transport : {ETCPLoggingTransport::Tcp, ETCPLoggingTransport::Udp})
+	{
+		if (FCString::Stricmp(Text, LexToString(Transport)) == 0)
+		{
+			OutTransport = Transport;
+			return true;
+		}
+	}
+	return false;
+}
+
+const TCHAR* LexToString(ETCPLoggingTransport Transport)
+{
+	return Transport == ETCPLoggingTransport::Udp ? TEXT("udp") : TEXT("tcp");
+}
+
+FTCPLoggingDatagramWriter::FTCPLoggingDatagramWriter(
+	const FString& SessionId, ETCPLoggingPayloadFormat PayloadFormat, int32 InMaxDatagramBytes)
+	: SocketSubsystem(ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM))
+	, Socket(nullptr)
+	, MaxDatagramBytes(InMaxDatagramBytes)
+	, PendingEvents(0)
+	, Sequence(0)
+{
+	FTCHARToUTF8 SessionIdUtf8(*SessionId);
+	// A session id that leaves less than half the datagram for events is cut short, the collector only needs it unique
+	const int32 SessionIdBytes = FMath::Min(SessionIdUtf8.Length(), MaxDatagramBytes / 2 - TCPLoggingDatagramFormat::FixedHeaderSize);
+
+	Header.SetNumZeroed(TCPLoggingDatagramFormat::FixedHeaderSize);
+	Header[0] = 'T';
+	Header[1] = 'C';
+	Header[2] = 'P';
+	Header[3] = 'U';
+	Header[4] = TCPLoggingDatagramFormat::Version;
+	Header[5] = (uint8) PayloadFormat;
+	Header[6] = (uint8) SessionIdBytes;
+	Header[7] = (uint8) (SessionIdBytes >> 8);
+	Header.Append((const uint8*) SessionIdUtf8.Get(), SessionIdBytes);
+
+	Pending.Reserve(MaxDatagramBytes);
+	ResetPending();
+}
+
+FTCPLoggingDatagramWriter::~FTCPLoggingDatagramWriter()
+{
+	if (Socket != nullptr)
+	{
+		Socket->Close();
+		SocketSubsystem->DestroySocket(Socket);
+		Socket = nullptr;
+	}
+}
+
+void FTCPLoggingDatagramWriter::Append(const uint8* Data, int32 Count)
+{
+	check(CanAppend(Count));
+	Pending.Append(Data, Count);
+	++PendingEvents;
+}
+
+bool FTCPLoggingDatagramWriter::Send(const FInternetAddr& Destination)
+{
+	if (Socket == nullptr || SocketProtocol != Destination.GetProtocolType())
+	{
+		if (Socket != nullptr)
+		{
+			Socket->Close();
+			SocketSubsystem->DestroySocket(Socket);
+		}
+		SocketProtocol = Destination.GetProtocolType();
+		Socket = SocketSubsystem->CreateSocket(NAME_DGram, TEXT("TCPLoggingDatagram"), SocketProtocol);
+		if (Socket != nullptr)
+		{
+			Socket->SetNonBlocking(true);
+		}
+	}
+
+	for (int32 Byte = 0; Byte < 8; ++Byte)
+	{
+		Pending[8 + Byte] = (uint8) (Sequence >> (Byte * 8));
+	}
+	++Sequence;
+
+	int32 BytesSent = 0;
+	INC_DWORD_STAT(STAT_TCPLogging_SendCalls);
+	CSV_CUSTOM_STAT(TCPLogging, SendCalls, 1, ECsvCustomStatOp::Accumulate);
+	const bool bSent = Socket != nullptr && Socket->SendTo(Pending.GetData(), Pending.Num(), BytesSent, Destination)
+		&& BytesSent == Pending.Num();
+	if (bSent)
+	{
+		INC_DWORD_STAT_BY(STAT_TCPLogging_BytesSent, BytesSent);
+		INC_DWORD_STAT_BY(STAT_TCPLogging_EventsSent, PendingEvents);
+		CSV_CUSTOM_STAT(TCPLogging, BytesSent, BytesSent, ECsvCustomStatOp::Accumulate);
+	}
+	else
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Verbose, TEXT("Dropped analytics datagram of (%d) events (%s)"), PendingEvents,
+			SocketSubsystem->GetSocketError(SocketSubsystem->GetLastErrorCode()));
+	}
+	ResetPending();
+	return bSent;
+}
+
+void FTCPLoggingDatagramWriter::Discard()
+{
+	++Sequence;
+	ResetPending();
+}
+
+void FTCPLoggingDatagramWriter::ResetPending()
+{
+	Pending.Reset();
+	Pending.Append(Header);
+	PendingEvents = 0;
+}
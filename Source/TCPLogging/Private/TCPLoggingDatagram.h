@@ -0,0 +1,94 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TCPLoggingCompression.h"
+
+class FInternetAddr;
+class FSocket;
+class ISocketSubsystem;
+
+/** How bulk events reach the collector, critical ones always take the TCP connection */
+enum class ETCPLoggingTransport : uint8
+{
+	Tcp,
+	/** Best effort datagrams, lost ones are never resent */
+	Udp,
+};
+
+/** Parses the TCPLoggingTransport config value ("tcp" or "udp"). Returns false for anything else */
+bool LexTryParseString(ETCPLoggingTransport& OutTransport, const TCHAR* Text);
+const TCHAR* LexToString(ETCPLoggingTransport Transport);
+
+/**
+ * Datagram format of the udp transport, sent to the address the session's TCP connection goes to. Every datagram is
+ *
+ *   'T' 'C' 'P' 'U' | version (1) | format (ETCPLoggingPayloadFormat) | session id length (uint16 LE) |
+ *   sequence (uint64 LE) | session id (UTF-8) | payload
+ *
+ * where the payload holds whole NDJSON lines or binary records. Binary records are sent as serialized, without the
+ * string dictionary a TCP connection has, so every datagram decodes on its own. The sequence starts at zero for every
+ * session and increases by one per datagram, gaps tell the collector how much was lost.
+ */
+namespace TCPLoggingDatagramFormat
+{
+	static constexpr uint8 Version = 1;
+	/** Header size without the session id */
+	static constexpr int32 FixedHeaderSize = 16;
+}
+
+/**
+ * Packs messages into datagrams of at most a configured size, small enough to avoid IP fragmentation, and sends
+ * them from a non-blocking UDP socket. A datagram the socket does not take right away is dropped.
+ * Only used by the sender thread.
+ */
+class FTCPLoggingDatagramWriter
+{
+public:
+	FTCPLoggingDatagramWriter(const FString& SessionId, ETCPLoggingPayloadFormat PayloadFormat, int32 InMaxDatagramBytes);
+	~FTCPLoggingDatagramWriter();
+
+	UE_NONCOPYABLE(FTCPLoggingDatagramWriter);
+
+	/** Largest message that fits in a datagram, anything bigger has to go over TCP */
+	int32 GetMaxMessageBytes() const
+	{
+		return MaxDatagramBytes - Header.Num();
+	}
+
+	/** True if Count more bytes fit in the pending datagram */
+	bool CanAppend(int32 Count) const
+	{
+		return Pending.Num() + Count <= MaxDatagramBytes;
+	}
+
+	/** Adds a whole message to the pending datagram, which must have room for it */
+	void Append(const uint8* Data, int32 Count);
+
+	int32 GetPendingEvents() const
+	{
+		return PendingEvents;
+	}
+
+	/** Sends the pending datagram to Destination and starts a new one. Returns false if it was dropped */
+	bool Send(const FInternetAddr& Destination);
+
+	/** Starts a new datagram without sending the pending one, its sequence number is skipped */
+	void Discard();
+
+private:
+	void ResetPending();
+
+	ISocketSubsystem* SocketSubsystem;
+	/** Created for the protocol of the first destination, and again whenever that changes */
+	FSocket* Socket;
+	FName SocketProtocol;
+
+	const int32 MaxDatagramBytes;
+	/** Everything up to and including the session id, the sequence is patched in per datagram */
+	TArray<uint8> Header;
+	TArray<uint8> Pending;
+	int32 PendingEvents;
+	uint64 Sequence;
+};
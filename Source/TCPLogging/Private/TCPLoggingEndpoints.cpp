@@ -0,0 +1,121 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "TCPLoggingEndpoints.h"
+
+#include "Algo/BinarySearch.h"
+#include "Hash/CityHash.h"
+#include "Misc/DefaultValueHelper.h"
+
+static uint64 HashRingKey(const FString& Text)
+{
+	const FTCHARToUTF8 Utf8(*Text);
+	return CityHash64(Utf8.Get(), (uint32) Utf8.Length());
+}
+
+bool LexTryParseString(ETCPLoggingBalancing& OutBalancing, const TCHAR* Text)
+{
+	for (ETCPLoggingBalancing Balancing : {ETCPLoggingBalancing::ConsistentHash, ETCPLoggingBalancing::LeastOutstandingBytes})
+	{
+		if (FCString::Stricmp(Text, LexToString(Balancing)) == 0)
+		{
+			OutBalancing = Balancing;
+			return true;
+		}
+	}
+	return false;
+}
+
+const TCHAR* LexToString(ETCPLoggingBalancing Balancing)
+{
+	return Balancing == ETCPLoggingBalancing::LeastOutstandingBytes ? TEXT("leastbytes") : TEXT("hash");
+}
+
+bool TCPLoggingParseEndpoints(const FString& Text, TArray<FTCPLoggingEndpoint>& OutEndpoints)
+{
+	TArray<FString> Entries;
+	Text.ParseIntoArray(Entries, TEXT(","));
+
+	bool bAllValid = true;
+	for (const FString& Entry : Entries)
+	{
+		FString Host;
+		FString PortText;
+		int32 Port = 0;
+		// Split on the last colon so a bracketed IPv6 literal keeps its own
+		if (!Entry.TrimStartAndEnd().Split(TEXT(":"), &Host, &PortText, ESearchCase::CaseSensitive, ESearchDir::FromEnd)
+			|| Host.IsEmpty() || !FDefaultValueHelper::ParseInt(PortText, Port) || Port <= 0 || Port > 65535)
+		{
+			bAllValid = false;
+			continue;
+		}
+		OutEndpoints.Add(FTCPLoggingEndpoint{Host, Port});
+	}
+	return bAllValid;
+}
+
+FTCPLoggingEndpointSet::FTCPLoggingEndpointSet(
+	TArray<FTCPLoggingEndpoint>&& InEndpoints, double InBaseCooldownSeconds, double InMaxCooldownSeconds)
+	: Endpoints(MoveTemp(InEndpoints))
+	, BaseCooldownSeconds(InBaseCooldownSeconds)
+	, MaxCooldownSeconds(InMaxCooldownSeconds)
+{
+	check(Endpoints.Num() > 0);
+	Health.SetNum(Endpoints.Num());
+
+	// Nodes are placed by host and port rather than list position, so reordering the config moves no sessions
+	Ring.Reserve(Endpoints.Num() * VirtualNodesPerEndpoint);
+	for (int32 Index = 0; Index < Endpoints.Num(); ++Index)
+	{
+		for (int32 Node = 0; Node < VirtualNodesPerEndpoint; ++Node)
+		{
+			const FString NodeKey = FString::Printf(TEXT("%s:%d#%d"), *Endpoints[Index].Host, Endpoints[Index].Port, Node);
+			Ring.Add(FRingNode{HashRingKey(NodeKey), Index});
+		}
+	}
+	Ring.Sort([](const FRingNode& A, const FRingNode& B) { return A.Hash < B.Hash; });
+}
+
+void FTCPLoggingEndpointSet::GetRingOrder(const FString& Key, TArray<int32>& OutOrder) const
+{
+	OutOrder.Reset();
+	const uint64 KeyHash = HashRingKey(Key);
+	const int32 Start = Algo::LowerBoundBy(Ring, KeyHash, &FRingNode::Hash);
+	for (int32 Step = 0; Step < Ring.Num() && OutOrder.Num() < Endpoints.Num(); ++Step)
+	{
+		OutOrder.AddUnique(Ring[(Start + Step) % Ring.Num()].Endpoint);
+	}
+}
+
+int32 FTCPLoggingEndpointSet::Pick(const TArray<int32>& Order, double Now) const
+{
+	int32 Earliest = Order[0];
+	for (const int32 Index : Order)
+	{
+		if (IsAvailable(Index, Now))
+		{
+			return Index;
+		}
+		if (Health[Index].DownUntil < Health[Earliest].DownUntil)
+		{
+			Earliest = Index;
+		}
+	}
+	return Earliest;
+}
+
+void FTCPLoggingEndpointSet::MarkFailed(int32 Index, double Now, bool bWasStable)
+{
+	FHealth& Entry = Health[Index];
+	if (bWasStable)
+	{
+		Entry.Failures = 0;
+	}
+	const double Cooldown = FMath::Min(MaxCooldownSeconds, BaseCooldownSeconds * (double) (1 << FMath::Min(Entry.Failures, 16)));
+	++Entry.Failures;
+	Entry.DownUntil = Now + Cooldown;
+}
+
+void FTCPLoggingEndpointSet::MarkConnected(int32 Index)
+{
+	Health[Index].DownUntil = 0.0;
+}
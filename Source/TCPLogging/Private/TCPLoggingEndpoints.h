@@ -0,0 +1,97 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/** One collector node */
+struct FTCPLoggingEndpoint
+{
+	FString Host;
+	int32 Port = 0;
+};
+
+/** How a sender spreads its batches when several collectors are configured */
+enum class ETCPLoggingBalancing : uint8
+{
+	/** The whole session goes to one collector picked by hashing the session id, the next one on the ring if it is down */
+	ConsistentHash,
+	/** The sender keeps a connection to several collectors and writes each batch to the one with the least unsent bytes */
+	LeastOutstandingBytes,
+};
+
+/** Parses the TCPLoggingBalancing config value ("hash" or "leastbytes"). Returns false for anything else */
+bool LexTryParseString(ETCPLoggingBalancing& OutBalancing, const TCHAR* Text);
+const TCHAR* LexToString(ETCPLoggingBalancing Balancing);
+
+/**
+ * Parses the TCPLoggingEndpoints config value, a comma separated list of host:port.
+ * Returns false if any entry is malformed, OutEndpoints then only holds the valid ones.
+ */
+bool TCPLoggingParseEndpoints(const FString& Text, TArray<FTCPLoggingEndpoint>& OutEndpoints);
+
+/**
+ * The collectors one sender may connect to, with a consistent hash ring to order them for a session and the health of
+ * each. An endpoint that failed to connect or dropped its connection is skipped for a cooldown that doubles with every
+ * consecutive failure, connections fail over to the next endpoint in their order meanwhile and fail back once it ends.
+ * Only used by the sender thread.
+ */
+class FTCPLoggingEndpointSet
+{
+public:
+	FTCPLoggingEndpointSet(TArray<FTCPLoggingEndpoint>&& InEndpoints, double InBaseCooldownSeconds, double InMaxCooldownSeconds);
+
+	int32 Num() const
+	{
+		return Endpoints.Num();
+	}
+
+	const FTCPLoggingEndpoint& Get(int32 Index) const
+	{
+		return Endpoints[Index];
+	}
+
+	/**
+	 * Every endpoint once, in the order the ring visits them starting at Key's hash. Adding or removing a collector only
+	 * moves the sessions that hashed next to it.
+	 */
+	void GetRingOrder(const FString& Key, TArray<int32>& OutOrder) const;
+
+	/** False while the endpoint is cooling down after a failure */
+	bool IsAvailable(int32 Index, double Now) const
+	{
+		return Health[Index].DownUntil <= Now;
+	}
+
+	/** First available endpoint in Order, or the one whose cooldown ends first if none is */
+	int32 Pick(const TArray<int32>& Order, double Now) const;
+
+	/** Starts a cooldown. A connection that stayed up for a while resets the count of consecutive failures first */
+	void MarkFailed(int32 Index, double Now, bool bWasStable);
+
+	/** The endpoint accepted a connection */
+	void MarkConnected(int32 Index);
+
+private:
+	/** Points each endpoint takes on the ring, more of them even out the share of sessions every collector gets */
+	static constexpr int32 VirtualNodesPerEndpoint = 64;
+
+	struct FHealth
+	{
+		int32 Failures = 0;
+		double DownUntil = 0.0;
+	};
+
+	struct FRingNode
+	{
+		uint64 Hash;
+		int32 Endpoint;
+	};
+
+	TArray<FTCPLoggingEndpoint> Endpoints;
+	TArray<FHealth> Health;
+	/** Sorted by hash */
+	TArray<FRingNode> Ring;
+	double BaseCooldownSeconds;
+	double MaxCooldownSeconds;
+};
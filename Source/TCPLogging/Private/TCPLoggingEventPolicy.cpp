@@ -0,0 +1,229 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "TCPLoggingEventPolicy.h"
+
+#include "HAL/PlatformTime.h"
+#include "Misc/DefaultValueHelper.h"
+#include "TCPLoggingLog.h"
+
+/** Name of the policy that covers every event without one of its own */
+static const TCHAR* DefaultPolicyName = TEXT("*");
+
+struct FTCPLoggingEventThrottle::FTable
+{
+	struct FState
+	{
+		FString EventName;
+		double SampleRate = 1.0;
+		/** Cycles between two events at the sustained rate, 0 when unlimited */
+		uint64 IntervalCycles = 0;
+		/** How far the theoretical arrival time may run ahead of now, i.e. the burst */
+		uint64 ToleranceCycles = 0;
+
+		std::atomic<uint64> Seen{0};
+		std::atomic<uint64> TheoreticalArrival{0};
+		std::atomic<uint64> SampledOut{0};
+		std::atomic<uint64> RateLimited{0};
+	};
+
+	TMap<FString, int32> Index;
+	TUniquePtr<FState[]> States;
+	int32 NumStates = 0;
+	int32 DefaultState = INDEX_NONE;
+
+	FState* Find(const FString& EventName) const
+	{
+		const int32* Found = Index.Find(EventName);
+		const int32 StateIndex = Found != nullptr ? *Found : DefaultState;
+		return StateIndex != INDEX_NONE ? &States[StateIndex] : nullptr;
+	}
+};
+
+static bool ParseEventPolicy(const FString& Params, FTCPLoggingEventPolicy& OutPolicy)
+{
+	TArray<FString> Pairs;
+	Params.ParseIntoArray(Pairs, TEXT(","));
+	for (const FString& Pair : Pairs)
+	{
+		FString Key;
+		FString ValueText;
+		double Value;
+		if (!Pair.Split(TEXT("="), &Key, &ValueText) || !FDefaultValueHelper::ParseDouble(ValueText.TrimStartAndEnd(), Value))
+		{
+			return false;
+		}
+
+		Key.TrimStartAndEndInline();
+		if (Key.Equals(TEXT("sample"), ESearchCase::IgnoreCase) && Value >= 0.0 && Value <= 1.0)
+		{
+			OutPolicy.SampleRate = Value;
+		}
+		else if (Key.Equals(TEXT("rate"), ESearchCase::IgnoreCase) && Value >= 0.0)
+		{
+			OutPolicy.RatePerSecond = Value;
+		}
+		else if (Key.Equals(TEXT("burst"), ESearchCase::IgnoreCase) && Value >= 1.0)
+		{
+			OutPolicy.Burst = Value;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool TCPLoggingParseEventPolicies(const FString& Text, TMap<FString, FTCPLoggingEventPolicy>& OutPolicies)
+{
+	bool bValid = true;
+	TArray<FString> Entries;
+	Text.ParseIntoArray(Entries, TEXT(";"));
+	for (const FString& Entry : Entries)
+	{
+		// Parameters never contain ':', event names might
+		FString EventName;
+		FString Params;
+		FTCPLoggingEventPolicy Policy;
+		if (!Entry.Split(TEXT(":"), &EventName, &Params, ESearchCase::CaseSensitive, ESearchDir::FromEnd)
+			|| !ParseEventPolicy(Params, Policy) || EventName.TrimStartAndEnd().IsEmpty())
+		{
+			UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Ignoring malformed analytics event policy (%s)"), *Entry.TrimStartAndEnd());
+			bValid = false;
+			continue;
+		}
+		OutPolicies.Add(EventName.TrimStartAndEnd(), Policy);
+	}
+	return bValid;
+}
+
+FTCPLoggingEventThrottle::FTCPLoggingEventThrottle()
+	: bEnabled(false)
+{
+}
+
+FTCPLoggingEventThrottle::~FTCPLoggingEventThrottle()
+{
+}
+
+void FTCPLoggingEventThrottle::SetPolicies(const TMap<FString, FTCPLoggingEventPolicy>& Policies)
+{
+	TUniquePtr<FTable> NewTable;
+	if (Policies.Num() > 0)
+	{
+		NewTable = MakeUnique<FTable>();
+		NewTable->States = MakeUnique<FTable::FState[]>(Policies.Num());
+		for (const TPair<FString, FTCPLoggingEventPolicy>& Pair : Policies)
+		{
+			const int32 StateIndex = NewTable->NumStates++;
+			FTable::FState& State = NewTable->States[StateIndex];
+			State.EventName = Pair.Key;
+			State.SampleRate = Pair.Value.SampleRate;
+			if (Pair.Value.RatePerSecond > 0.0)
+			{
+				const double IntervalSeconds = 1.0 / Pair.Value.RatePerSecond;
+				State.IntervalCycles = FMath::Max<uint64>((uint64) (IntervalSeconds / FPlatformTime::GetSecondsPerCycle64()), 1);
+				State.ToleranceCycles = (uint64) ((Pair.Value.Burst - 1.0) * (double) State.IntervalCycles);
+			}
+
+			if (Pair.Key == DefaultPolicyName)
+			{
+				NewTable->DefaultState = StateIndex;
+			}
+			else
+			{
+				NewTable->Index.Add(Pair.Key, StateIndex);
+			}
+		}
+	}
+
+	FWriteScopeLock WriteLock(Lock);
+	if (Table.IsValid())
+	{
+		CarryOverCounts(*Table);
+	}
+	Table = MoveTemp(NewTable);
+	bEnabled.store(Table.IsValid(), std::memory_order_release);
+
+	UE_LOG(LogTCPLoggingAnalytics, Display, TEXT("Applied (%d) analytics event policies"), Policies.Num());
+}
+
+bool FTCPLoggingEventThrottle::Admit(const FString& EventName)
+{
+	if (!bEnabled.load(std::memory_order_acquire))
+	{
+		return true;
+	}
+
+	FReadScopeLock ReadLock(Lock);
+	FTable::FState* State = Table.IsValid() ? Table->Find(EventName) : nullptr;
+	if (State == nullptr)
+	{
+		return true;
+	}
+
+	if (State->SampleRate < 1.0)
+	{
+		// Keeps the events where the running total of SampleRate crosses an integer, evenly spaced without a random draw
+		const uint64 Seen = State->Seen.fetch_add(1, std::memory_order_relaxed);
+		if ((uint64) ((double) (Seen + 1) * State->SampleRate) == (uint64) ((double) Seen * State->SampleRate))
+		{
+			State->SampledOut.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+	}
+
+	if (State->IntervalCycles > 0)
+	{
+		// Token bucket in its virtual scheduling form, admitting an event pushes the theoretical arrival time one interval
+		const uint64 Now = FPlatformTime::Cycles64();
+		uint64 Arrival = State->TheoreticalArrival.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			const uint64 Start = FMath::Max(Arrival, Now);
+			if (Start - Now > State->ToleranceCycles)
+			{
+				State->RateLimited.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			if (State->TheoreticalArrival.compare_exchange_weak(Arrival, Start + State->IntervalCycles, std::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+	}
+	return true;
+}
+
+void FTCPLoggingEventThrottle::TakeSuppressedEvents(TArray<FTCPLoggingSuppressedEvents>& Out)
+{
+	FWriteScopeLock WriteLock(Lock);
+	if (Table.IsValid())
+	{
+		CarryOverCounts(*Table);
+	}
+	for (TPair<FString, FTCPLoggingSuppressedEvents>& Pair : CarriedCounts)
+	{
+		Out.Add(MoveTemp(Pair.Value));
+	}
+	CarriedCounts.Reset();
+}
+
+void FTCPLoggingEventThrottle::CarryOverCounts(FTable& Source)
+{
+	for (int32 StateIndex = 0; StateIndex < Source.NumStates; ++StateIndex)
+	{
+		FTable::FState& State = Source.States[StateIndex];
+		const uint64 SampledOut = State.SampledOut.exchange(0, std::memory_order_relaxed);
+		const uint64 RateLimited = State.RateLimited.exchange(0, std::memory_order_relaxed);
+		if (SampledOut == 0 && RateLimited == 0)
+		{
+			continue;
+		}
+
+		FTCPLoggingSuppressedEvents& Counts = CarriedCounts.FindOrAdd(State.EventName);
+		Counts.EventName = State.EventName;
+		Counts.SampledOut += SampledOut;
+		Counts.RateLimited += RateLimited;
+	}
+}
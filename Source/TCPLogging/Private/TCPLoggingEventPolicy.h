@@ -0,0 +1,76 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/ScopeRWLock.h"
+#include "Templates/UniquePtr.h"
+
+#include <atomic>
+
+/** How the provider thins out one event name before it is serialized */
+struct FTCPLoggingEventPolicy
+{
+	/** Fraction of events kept, 1 keeps everything and 0 drops the event entirely */
+	double SampleRate = 1.0;
+	/** Sustained events per second let through after sampling, 0 means unlimited */
+	double RatePerSecond = 0.0;
+	/** Events that may pass back to back before the rate applies */
+	double Burst = 1.0;
+};
+
+/** Events of one name suppressed since the last summary */
+struct FTCPLoggingSuppressedEvents
+{
+	FString EventName;
+	uint64 SampledOut = 0;
+	uint64 RateLimited = 0;
+};
+
+/**
+ * Parses the TCPLoggingEventPolicies config value, policies separated by ';' with each one written as
+ *
+ *   EventName:sample=0.1,rate=20,burst=40
+ *
+ * Every parameter is optional. The name "*" applies to every event without a policy of its own, all of them sharing
+ * one rate limit.
+ * Returns false if any entry is malformed, OutPolicies then only holds the valid ones.
+ */
+bool TCPLoggingParseEventPolicies(const FString& Text, TMap<FString, FTCPLoggingEventPolicy>& OutPolicies);
+
+/**
+ * Applies the event policy table on every RecordEvent call. Admit is safe to call from any thread and, once a
+ * policy table is set, costs one map lookup plus a couple of atomic operations: sampling is deterministic (every
+ * 1/SampleRate-th event is kept) and rate limits are token buckets kept as a single theoretical arrival time.
+ *
+ * The table can be replaced at any time, counts of events suppressed under the old table carry over to the next summary.
+ */
+class FTCPLoggingEventThrottle
+{
+public:
+	FTCPLoggingEventThrottle();
+	~FTCPLoggingEventThrottle();
+
+	/** Replaces the policy table, an empty map turns throttling off */
+	void SetPolicies(const TMap<FString, FTCPLoggingEventPolicy>& Policies);
+
+	/** True if an event with this name should be recorded */
+	bool Admit(const FString& EventName);
+
+	/** Moves the counts of suppressed events into Out, one entry per event name with anything suppressed */
+	void TakeSuppressedEvents(TArray<FTCPLoggingSuppressedEvents>& Out);
+
+private:
+	struct FTable;
+
+	/** Adds the counts of Source to the ones waiting for the next summary. Requires the write lock */
+	void CarryOverCounts(FTable& Source);
+
+	/** Readers only ever take it shared, so recording threads never contend with each other */
+	FRWLock Lock;
+	TUniquePtr<FTable> Table;
+	/** Counts taken out of replaced tables, only touched under the write lock */
+	TMap<FString, FTCPLoggingSuppressedEvents> CarriedCounts;
+	/** Lets Admit skip the lock entirely while no policy is configured */
+	std::atomic<bool> bEnabled;
+};
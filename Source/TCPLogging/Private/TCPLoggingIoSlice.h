@@ -0,0 +1,12 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/** One contiguous piece of a frame or send that is gathered from several places, like an iovec */
+struct FTCPLoggingIoSlice
+{
+	const uint8* Data;
+	int32 Count;
+};
@@ -0,0 +1,288 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "TCPLoggingJsonWriter.h"
+
+#include "TCPLoggingNumberFormat.h"
+#include "TCPLoggingUtf8.h"
+
+FTCPLoggingJsonWriter::FTCPLoggingJsonWriter(TArray<uint8>& InBuffer)
+	: Buffer(InBuffer)
+	, HasElementBits(0)
+	, Depth(0)
+{
+}
+
+void FTCPLoggingJsonWriter::BeginObject()
+{
+	WriteSeparator();
+	WriteByte('{');
+	++Depth;
+	check(Depth < 64);
+	HasElementBits &= ~(1ull << Depth);
+}
+
+void FTCPLoggingJsonWriter::EndObject()
+{
+	check(Depth > 0);
+	--Depth;
+	WriteByte('}');
+}
+
+void FTCPLoggingJsonWriter::BeginArray(FAnsiStringView Key)
+{
+	WriteKey(Key);
+	WriteByte('[');
+	++Depth;
+	check(Depth < 64);
+	HasElementBits &= ~(1ull << Depth);
+}
+
+void FTCPLoggingJsonWriter::EndArray()
+{
+	check(Depth > 0);
+	--Depth;
+	WriteByte(']');
+}
+
+void FTCPLoggingJsonWriter::WriteString(FAnsiStringView Key, const FString& Value)
+{
+	WriteKey(Key);
+	WriteQuoted(*Value, Value.Len());
+}
+
+void FTCPLoggingJsonWriter::WriteAsciiString(FAnsiStringView Key, FAnsiStringView Value)
+{
+	WriteKey(Key);
+	WriteQuoted(Value);
+}
+
+void FTCPLoggingJsonWriter::WriteInteger(FAnsiStringView Key, int64 Value)
+{
+	WriteKey(Key);
+	WriteInt64(Value);
+}
+
+void FTCPLoggingJsonWriter::WriteDouble(FAnsiStringView Key, double Value)
+{
+	WriteKey(Key);
+	WriteFloat64(Value);
+}
+
+void FTCPLoggingJsonWriter::WriteFloat(FAnsiStringView Key, float Value)
+{
+	WriteKey(Key);
+	WriteFloat32(Value);
+}
+
+void FTCPLoggingJsonWriter::WriteBool(FAnsiStringView Key, bool Value)
+{
+	WriteKey(Key);
+	WriteAnsi(Value ? FAnsiStringView("true") : FAnsiStringView("false"));
+}
+
+void FTCPLoggingJsonWriter::WriteNumberText(FAnsiStringView Key, const FString& Value)
+{
+	WriteKey(Key);
+	WriteUtf8(*Value, Value.Len());
+}
+
+void FTCPLoggingJsonWriter::WriteUtf8String(FAnsiStringView Key, FAnsiStringView Value)
+{
+	WriteKey(Key);
+	WriteByte('"');
+	TCPLoggingAppendJsonEscaped(Buffer, Value);
+	WriteByte('"');
+}
+
+void FTCPLoggingJsonWriter::WriteUtf8NumberText(FAnsiStringView Key, FAnsiStringView Value)
+{
+	WriteKey(Key);
+	WriteAnsi(Value);
+}
+
+void FTCPLoggingJsonWriter::WriteStringAttribute(FAnsiStringView Name, const FString& Value)
+{
+	BeginObject();
+	WriteKey("name");
+	WriteQuoted(Name);
+	WriteString("value", Value);
+	EndObject();
+}
+
+void FTCPLoggingJsonWriter::WriteIntegerAttribute(FAnsiStringView Name, int64 Value)
+{
+	BeginObject();
+	WriteKey("name");
+	WriteQuoted(Name);
+	WriteInteger("value", Value);
+	EndObject();
+}
+
+void FTCPLoggingJsonWriter::WriteDoubleAttribute(FAnsiStringView Name, double Value)
+{
+	BeginObject();
+	WriteKey("name");
+	WriteQuoted(Name);
+	WriteDouble("value", Value);
+	EndObject();
+}
+
+void FTCPLoggingJsonWriter::WriteFloatAttribute(FAnsiStringView Name, float Value)
+{
+	BeginObject();
+	WriteKey("name");
+	WriteQuoted(Name);
+	WriteFloat("value", Value);
+	EndObject();
+}
+
+void FTCPLoggingJsonWriter::WriteAttributes(const TArray<FAnalyticsEventAttribute>& Attributes)
+{
+	BeginArray("attributes");
+	for (const FAnalyticsEventAttribute& Attr : Attributes)
+	{
+		BeginObject();
+		WriteString("name", Attr.GetName());
+		if (Attr.IsJsonFragment())
+		{
+			WriteNumberText("value", Attr.GetValue());
+		}
+		else
+		{
+			WriteString("value", Attr.GetValue());
+		}
+		EndObject();
+	}
+	EndArray();
+}
+
+void FTCPLoggingJsonWriter::WriteAttributes(TArrayView<const FTCPLoggingAttribute> Attributes)
+{
+	BeginArray("attributes");
+	for (const FTCPLoggingAttribute& Attr : Attributes)
+	{
+		BeginObject();
+		WriteKey("name");
+		WriteQuoted(Attr.Name);
+		switch (Attr.Type)
+		{
+			case FTCPLoggingAttribute::EType::Integer:
+				WriteInteger("value", Attr.Integer);
+				break;
+			case FTCPLoggingAttribute::EType::Double:
+				WriteDouble("value", Attr.Double);
+				break;
+			case FTCPLoggingAttribute::EType::Float:
+				WriteFloat("value", Attr.Float);
+				break;
+			case FTCPLoggingAttribute::EType::Bool:
+				WriteBool("value", Attr.Bool);
+				break;
+			case FTCPLoggingAttribute::EType::String:
+				WriteString("value", *Attr.String);
+				break;
+		}
+		EndObject();
+	}
+	EndArray();
+}
+
+void FTCPLoggingJsonWriter::EndMessage()
+{
+	check(Depth == 0);
+	WriteByte('\n');
+	HasElementBits = 0;
+}
+
+void FTCPLoggingJsonWriter::SpliceFields(TArray<uint8>& Out, const uint8* Message, int32 Count, const TArray<uint8>& Fields)
+{
+	check(Count >= 2 && Message[0] == '{');
+	Out.Add('{');
+	Out.Append(Fields);
+	if (Fields.Num() > 0 && Message[1] != '}')
+	{
+		Out.Add(',');
+	}
+	Out.Append(Message + 1, Count - 1);
+}
+
+void FTCPLoggingJsonWriter::WriteSeparator()
+{
+	const uint64 Bit = 1ull << Depth;
+	if (HasElementBits & Bit)
+	{
+		WriteByte(',');
+	}
+	HasElementBits |= Bit;
+}
+
+void FTCPLoggingJsonWriter::WriteKey(FAnsiStringView Key)
+{
+	WriteSeparator();
+	WriteQuoted(Key);
+	WriteByte(':');
+}
+
+void FTCPLoggingJsonWriter::WriteAnsi(FAnsiStringView Text)
+{
+	Buffer.Append((const uint8*) Text.GetData(), Text.Len());
+}
+
+void FTCPLoggingJsonWriter::WriteByte(uint8 Byte)
+{
+	Buffer.Add(Byte);
+}
+
+void FTCPLoggingJsonWriter::WriteQuoted(const TCHAR* Text, int32 Len)
+{
+	WriteByte('"');
+	TCPLoggingAppendJsonEscaped(Buffer, Text, Len);
+	WriteByte('"');
+}
+
+void FTCPLoggingJsonWriter::WriteQuoted(FAnsiStringView Text)
+{
+	WriteByte('"');
+	WriteAnsi(Text);
+	WriteByte('"');
+}
+
+void FTCPLoggingJsonWriter::WriteUtf8(const TCHAR* Text, int32 Len)
+{
+	TCPLoggingAppendUtf8(Buffer, Text, Len);
+}
+
+void FTCPLoggingJsonWriter::WriteInt64(int64 Value)
+{
+	ANSICHAR Digits[20];
+	int32 Count = 0;
+	uint64 Magnitude = Value < 0 ? 0 - (uint64) Value : (uint64) Value;
+	do
+	{
+		Digits[Count++] = (ANSICHAR) ('0' + Magnitude % 10);
+		Magnitude /= 10;
+	} while (Magnitude != 0);
+
+	if (Value < 0)
+	{
+		WriteByte('-');
+	}
+	const int32 Start = Buffer.AddUninitialized(Count);
+	uint8* Out = Buffer.GetData() + Start;
+	while (Count > 0)
+	{
+		*Out++ = (uint8) Digits[--Count];
+	}
+}
+
+void FTCPLoggingJsonWriter::WriteFloat64(double Value)
+{
+	ANSICHAR Text[TCPLoggingMaxNumberText];
+	WriteAnsi(TCPLoggingFormatDouble(Value, Text));
+}
+
+void FTCPLoggingJsonWriter::WriteFloat32(float Value)
+{
+	ANSICHAR Text[TCPLoggingMaxNumberText];
+	WriteAnsi(TCPLoggingFormatFloat(Value, Text));
+}
@@ -0,0 +1,96 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "AnalyticsEventAttribute.h"
+#include "Containers/ArrayView.h"
+#include "Containers/StringView.h"
+#include "CoreMinimal.h"
+#include "TCPLoggingAttribute.h"
+
+/**
+ * Streams a single NDJSON line as UTF-8 straight into a byte buffer.
+ * Nothing is formatted into intermediate strings, so once the buffer has grown to fit a typical event
+ * serializing allocates nothing. Separators are tracked per nesting level, callers never write commas.
+ */
+class FTCPLoggingJsonWriter
+{
+public:
+	explicit FTCPLoggingJsonWriter(TArray<uint8>& InBuffer);
+
+	void BeginObject();
+	void EndObject();
+
+	void BeginArray(FAnsiStringView Key);
+	void EndArray();
+
+	void WriteString(FAnsiStringView Key, const FString& Value);
+	/** Writes a constant ASCII string value, for event names known at compile time */
+	void WriteAsciiString(FAnsiStringView Key, FAnsiStringView Value);
+	void WriteInteger(FAnsiStringView Key, int64 Value);
+	void WriteDouble(FAnsiStringView Key, double Value);
+	/** Written at float precision, not as the double it widens to */
+	void WriteFloat(FAnsiStringView Key, float Value);
+	void WriteBool(FAnsiStringView Key, bool Value);
+
+	/** Writes an already formatted number without quoting it */
+	void WriteNumberText(FAnsiStringView Key, const FString& Value);
+
+	/** Variants for values that are already UTF-8 encoded, used when converting the binary protocol back to JSON */
+	void WriteUtf8String(FAnsiStringView Key, FAnsiStringView Value);
+	void WriteUtf8NumberText(FAnsiStringView Key, FAnsiStringView Value);
+
+	/** Writes { "name" : Name, "value" : Value } as the next array element */
+	void WriteStringAttribute(FAnsiStringView Name, const FString& Value);
+	void WriteIntegerAttribute(FAnsiStringView Name, int64 Value);
+	void WriteDoubleAttribute(FAnsiStringView Name, double Value);
+	void WriteFloatAttribute(FAnsiStringView Name, float Value);
+
+	/**
+	 * Writes "attributes" : [ ... ] with one object per attribute. JSON fragments, which is what the engine makes of
+	 * numeric and boolean values, are written unquoted and anything else as a string
+	 */
+	void WriteAttributes(const TArray<FAnalyticsEventAttribute>& Attributes);
+	void WriteAttributes(TArrayView<const FTCPLoggingAttribute> Attributes);
+
+	/** Terminates the line, must follow the closing EndObject */
+	void EndMessage();
+
+	/** Serializes fields once, without the braces around them, for SpliceFields to put into any number of messages */
+	template <typename FuncType>
+	static void SerializeFields(TArray<uint8>& OutFields, FuncType&& WriteFields)
+	{
+		TArray<uint8> Object;
+		FTCPLoggingJsonWriter Writer(Object);
+		Writer.BeginObject();
+		WriteFields(Writer);
+		Writer.EndObject();
+		OutFields.Reset();
+		OutFields.Append(Object.GetData() + 1, Object.Num() - 2);
+	}
+
+	/** Appends a whole line to Out with Fields from SerializeFields inserted ahead of the line's own */
+	static void SpliceFields(TArray<uint8>& Out, const uint8* Message, int32 Count, const TArray<uint8>& Fields);
+
+private:
+	/** Writes a comma if the current container already has an element */
+	void WriteSeparator();
+	void WriteKey(FAnsiStringView Key);
+
+	void WriteAnsi(FAnsiStringView Text);
+	void WriteByte(uint8 Byte);
+	/** Escapes Text while encoding it */
+	void WriteQuoted(const TCHAR* Text, int32 Len);
+	/** Writes Text as is, only for keys and constants known not to need escaping */
+	void WriteQuoted(FAnsiStringView Text);
+	void WriteUtf8(const TCHAR* Text, int32 Len);
+	void WriteInt64(int64 Value);
+	void WriteFloat64(double Value);
+	void WriteFloat32(float Value);
+
+	TArray<uint8>& Buffer;
+
+	/** One bit per nesting level, set once that level has written its first element */
+	uint64 HasElementBits;
+	int32 Depth;
+};
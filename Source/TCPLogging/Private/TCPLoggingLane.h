@@ -0,0 +1,19 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Priority class of a recorded message. Each lane has a staging budget and a batch of its own, so a flood of one
+ * never holds up or pushes out the other.
+ */
+enum class ETCPLoggingLane : uint8
+{
+	/** Purchases and errors. Batched and written ahead of bulk traffic, spooled when the spool is enabled */
+	Critical,
+	/** Everything else, shed first whenever the sender or the collector falls behind */
+	Bulk,
+};
+
+static constexpr int32 TCPLoggingNumLanes = 2;
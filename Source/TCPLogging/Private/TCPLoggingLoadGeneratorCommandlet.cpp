@@ -0,0 +1,347 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "TCPLoggingLoadGeneratorCommandlet.h"
+
+#include "AnalyticsEventAttribute.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "Dom/JsonObject.h"
+#include "HAL/PlatformMisc.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Parse.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+#include "TCPLoggingLog.h"
+#include "TCPLoggingLoopbackSink.h"
+#include "TCPLoggingProvider.h"
+
+#include <atomic>
+
+/** One line of the capture, replayed through RecordEvent */
+struct FTCPLoggingCapturedEvent
+{
+	FString EventName;
+	TArray<FAnalyticsEventAttribute> Attributes;
+};
+
+/** Attribute as the provider would have been given it, numbers stay numbers and integers keep their exact digits */
+static FAnalyticsEventAttribute CapturedAttribute(const FString& Name, const TSharedPtr<FJsonValue>& Value)
+{
+	double Number;
+	if (Value->Type == EJson::Number && Value->TryGetNumber(Number))
+	{
+		if (FMath::Abs(Number) < 9007199254740992.0 && Number == FMath::FloorToDouble(Number))
+		{
+			return FAnalyticsEventAttribute(Name, (int64) Number);
+		}
+		return FAnalyticsEventAttribute(Name, Number);
+	}
+	FString Text;
+	Value->TryGetString(Text);
+	return FAnalyticsEventAttribute(Name, Text);
+}
+
+/**
+ * Reads an NDJSON capture into events. Session.Start lines are skipped since every simulated client starts a session of
+ * its own, lines that are not events are skipped with a warning.
+ */
+static bool LoadCapture(const FString& Path, TArray<FTCPLoggingCapturedEvent>& OutEvents)
+{
+	TArray<FString> Lines;
+	if (!FFileHelper::LoadFileToStringArray(Lines, *Path))
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Error, TEXT("Failed to read capture (%s)"), *Path);
+		return false;
+	}
+
+	int32 Skipped = 0;
+	for (const FString& Line : Lines)
+	{
+		if (Line.IsEmpty())
+		{
+			continue;
+		}
+
+		TSharedPtr<FJsonObject> Object;
+		FString EventName;
+		if (!FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(Line), Object) || !Object.IsValid()
+			|| !Object->TryGetStringField(TEXT("eventName"), EventName))
+		{
+			++Skipped;
+			continue;
+		}
+		if (EventName == TEXT("Session.Start"))
+		{
+			continue;
+		}
+
+		FTCPLoggingCapturedEvent& Event = OutEvents.AddDefaulted_GetRef();
+		Event.EventName = MoveTemp(EventName);
+		const TArray<TSharedPtr<FJsonValue>>* Attributes = nullptr;
+		if (Object->TryGetArrayField(TEXT("attributes"), Attributes))
+		{
+			for (const TSharedPtr<FJsonValue>& Attribute : *Attributes)
+			{
+				const TSharedPtr<FJsonObject>* AttributeObject = nullptr;
+				if (Attribute->TryGetObject(AttributeObject) && (*AttributeObject)->HasField(TEXT("name"))
+					&& (*AttributeObject)->HasField(TEXT("value")))
+				{
+					Event.Attributes.Add(CapturedAttribute(
+						(*AttributeObject)->GetStringField(TEXT("name")), (*AttributeObject)->TryGetField(TEXT("value"))));
+				}
+			}
+		}
+	}
+
+	if (Skipped > 0)
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Skipped (%d) lines of the capture that are not events"), Skipped);
+	}
+	if (OutEvents.Num() == 0)
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Error, TEXT("Capture (%s) holds no events to replay"), *Path);
+		return false;
+	}
+	return true;
+}
+
+/** Replay position of one simulated client */
+struct FTCPLoggingSimulatedClient
+{
+	TSharedPtr<FAnalyticsProviderTCPLogging> Provider;
+	int64 NextEvent = 0;
+	double NextDueSeconds = 0.0;
+};
+
+/** Progress of the whole run, updated by the driver threads and read by the reporting loop */
+struct FTCPLoggingLoadGeneratorProgress
+{
+	std::atomic<uint64> EventsRecorded{0};
+	/** Furthest any client fell behind its schedule, in microseconds */
+	std::atomic<uint64> MaxLagMicroseconds{0};
+	std::atomic<int32> DriversRunning{0};
+};
+
+/**
+ * Replays the capture through the clients DriverIndex, DriverIndex + DriverCount, ... on the calling thread until every
+ * one of them is done. A client that falls behind catches up as fast as the provider accepts events.
+ */
+static void RunLoadGeneratorDriver(TArray<FTCPLoggingSimulatedClient>& Clients, int32 DriverIndex, int32 DriverCount,
+	const TArray<FTCPLoggingCapturedEvent>& Events, double IntervalSeconds, double EndSeconds,
+	FTCPLoggingLoadGeneratorProgress& Progress)
+{
+	const int64 EventsPerClient = EndSeconds > 0.0 ? TNumericLimits<int64>::Max() : Events.Num();
+	for (;;)
+	{
+		const double Now = FPlatformTime::Seconds();
+		if (EndSeconds > 0.0 && Now >= EndSeconds)
+		{
+			break;
+		}
+
+		bool bAnyPending = false;
+		uint64 Recorded = 0;
+		double MaxLag = 0.0;
+		for (int32 Index = DriverIndex; Index < Clients.Num(); Index += DriverCount)
+		{
+			FTCPLoggingSimulatedClient& Client = Clients[Index];
+			if (Client.NextDueSeconds <= Now && Client.NextEvent < EventsPerClient)
+			{
+				MaxLag = FMath::Max(MaxLag, Now - Client.NextDueSeconds);
+			}
+			while (Client.NextDueSeconds <= Now && Client.NextEvent < EventsPerClient)
+			{
+				const FTCPLoggingCapturedEvent& Event = Events[Client.NextEvent % Events.Num()];
+				Client.Provider->RecordEvent(Event.EventName, Event.Attributes);
+				++Client.NextEvent;
+				Client.NextDueSeconds += IntervalSeconds;
+				++Recorded;
+			}
+			bAnyPending |= Client.NextEvent < EventsPerClient;
+		}
+
+		Progress.EventsRecorded.fetch_add(Recorded, std::memory_order_relaxed);
+		const uint64 LagMicroseconds = (uint64) (MaxLag * 1e6);
+		uint64 Previous = Progress.MaxLagMicroseconds.load(std::memory_order_relaxed);
+		while (LagMicroseconds > Previous
+			   && !Progress.MaxLagMicroseconds.compare_exchange_weak(Previous, LagMicroseconds, std::memory_order_relaxed))
+		{
+		}
+
+		if (!bAnyPending)
+		{
+			break;
+		}
+		if (Recorded == 0)
+		{
+			FPlatformProcess::Sleep(0.001f);
+		}
+	}
+	Progress.DriversRunning.fetch_sub(1, std::memory_order_release);
+}
+
+/** Sums what the clients' providers report about back-pressure */
+static void SumBackPressure(const TArray<FTCPLoggingSimulatedClient>& Clients, uint64& OutStagingDropped, uint64& OutWouldBlock,
+	int32& OutMaxBufferedBytes)
+{
+	OutStagingDropped = 0;
+	OutWouldBlock = 0;
+	OutMaxBufferedBytes = 0;
+	for (const FTCPLoggingSimulatedClient& Client : Clients)
+	{
+		const FTCPLoggingSocketWriterStats SocketStats = Client.Provider->GetSocketStats();
+		OutStagingDropped += Client.Provider->GetStagingDroppedCount();
+		OutWouldBlock += SocketStats.WouldBlockCount;
+		OutMaxBufferedBytes = FMath::Max(OutMaxBufferedBytes, SocketStats.HighWaterMark);
+	}
+}
+
+UTCPLoggingLoadGeneratorCommandlet::UTCPLoggingLoadGeneratorCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UTCPLoggingLoadGeneratorCommandlet::Main(const FString& Params)
+{
+	FString CapturePath;
+	if (!FParse::Value(*Params, TEXT("Capture="), CapturePath))
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Error, TEXT("Missing -Capture=<NDJSON file> to replay"));
+		return 1;
+	}
+	TArray<FTCPLoggingCapturedEvent> Events;
+	if (!LoadCapture(CapturePath, Events))
+	{
+		return 1;
+	}
+
+	int32 ClientCount = 100;
+	float EventsPerSecond = 10.0f;
+	float RateMultiplier = 1.0f;
+	float Seconds = 0.0f;
+	int32 DriverCount = FPlatformMisc::NumberOfCoresIncludingHyperthreads();
+	FParse::Value(*Params, TEXT("Clients="), ClientCount);
+	FParse::Value(*Params, TEXT("EventsPerSecond="), EventsPerSecond);
+	FParse::Value(*Params, TEXT("Rate="), RateMultiplier);
+	FParse::Value(*Params, TEXT("Seconds="), Seconds);
+	FParse::Value(*Params, TEXT("DriverThreads="), DriverCount);
+	ClientCount = FMath::Max(ClientCount, 1);
+	DriverCount = FMath::Clamp(DriverCount, 1, ClientCount);
+	const double TargetRate = FMath::Max(EventsPerSecond * RateMultiplier, 0.001f);
+
+	FTCPLoggingSenderSettings Settings;
+	FString FormatText;
+	if (FParse::Value(*Params, TEXT("Protocol="), FormatText) && !LexTryParseString(Settings.PayloadFormat, *FormatText))
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Error, TEXT("Unknown protocol (%s)"), *FormatText);
+		return 1;
+	}
+	if (FParse::Value(*Params, TEXT("Compression="), FormatText) && !LexTryParseString(Settings.Compression, *FormatText))
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Error, TEXT("Unknown compression (%s)"), *FormatText);
+		return 1;
+	}
+
+	FString Host;
+	int32 Port = 0;
+	TUniquePtr<FTCPLoggingLoopbackSink> Sink;
+	if (!FParse::Value(*Params, TEXT("Host="), Host))
+	{
+		Sink = MakeUnique<FTCPLoggingLoopbackSink>();
+		if (!Sink->Start())
+		{
+			return 1;
+		}
+		Host = TEXT("127.0.0.1");
+		Port = Sink->GetPort();
+	}
+	else if (!FParse::Value(*Params, TEXT("Port="), Port))
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Error, TEXT("-Host needs a -Port"));
+		return 1;
+	}
+
+	UE_LOG(LogTCPLoggingAnalytics, Display,
+		TEXT("Replaying (%d) events through (%d) clients at (%.1f) events/s each from (%d) threads, sending to %s:%d"), Events.Num(),
+		ClientCount, TargetRate, DriverCount, Sink.IsValid() ? TEXT("loopback") : *Host, Port);
+
+	// Each client is a full provider instance with its own session, connection and sender thread
+	TArray<FTCPLoggingSimulatedClient> Clients;
+	Clients.SetNum(ClientCount);
+	const double IntervalSeconds = 1.0 / TargetRate;
+	const double StartSeconds = FPlatformTime::Seconds() + 0.5;
+	for (int32 Index = 0; Index < ClientCount; ++Index)
+	{
+		FTCPLoggingSimulatedClient& Client = Clients[Index];
+		Client.Provider = FAnalyticsProviderTCPLogging::CreateInstance(Host, Port, true, false, Settings);
+		Client.Provider->StartSession(TArray<FAnalyticsEventAttribute>());
+		// Spread over one interval so the clients do not record in lockstep
+		Client.NextDueSeconds = StartSeconds + IntervalSeconds * Index / ClientCount;
+	}
+
+	FTCPLoggingLoadGeneratorProgress Progress;
+	Progress.DriversRunning.store(DriverCount, std::memory_order_relaxed);
+	const double EndSeconds = Seconds > 0.0f ? StartSeconds + Seconds : 0.0;
+	TArray<TFuture<void>> Drivers;
+	for (int32 DriverIndex = 0; DriverIndex < DriverCount; ++DriverIndex)
+	{
+		Drivers.Add(Async(EAsyncExecution::Thread, [&, DriverIndex]() {
+			RunLoadGeneratorDriver(Clients, DriverIndex, DriverCount, Events, IntervalSeconds, EndSeconds, Progress);
+		}));
+	}
+
+	uint64 LastRecorded = 0;
+	double LastReportSeconds = StartSeconds;
+	while (Progress.DriversRunning.load(std::memory_order_acquire) > 0)
+	{
+		FPlatformProcess::Sleep(1.0f);
+		const double Now = FPlatformTime::Seconds();
+		const uint64 Recorded = Progress.EventsRecorded.load(std::memory_order_relaxed);
+		uint64 StagingDropped, WouldBlock;
+		int32 MaxBufferedBytes;
+		SumBackPressure(Clients, StagingDropped, WouldBlock, MaxBufferedBytes);
+		UE_LOG(LogTCPLoggingAnalytics, Display,
+			TEXT("%8.0f events/s of %.0f, lag %.1f ms, staging drops %llu, would block %llu, send buffer high water %d bytes"),
+			(Recorded - LastRecorded) / FMath::Max(Now - LastReportSeconds, 0.001), TargetRate * ClientCount,
+			Progress.MaxLagMicroseconds.load(std::memory_order_relaxed) / 1000.0, StagingDropped, WouldBlock, MaxBufferedBytes);
+		LastRecorded = Recorded;
+		LastReportSeconds = Now;
+	}
+	for (TFuture<void>& Driver : Drivers)
+	{
+		Driver.Wait();
+	}
+	const double RecordSeconds = FPlatformTime::Seconds() - StartSeconds;
+
+	uint64 StagingDropped, WouldBlock;
+	int32 MaxBufferedBytes;
+	SumBackPressure(Clients, StagingDropped, WouldBlock, MaxBufferedBytes);
+
+	// Ending a session waits for its sender to write out what is buffered, so end them side by side
+	ParallelFor(Clients.Num(), [&Clients](int32 Index) { Clients[Index].Provider->EndSession(); });
+	const double DrainSeconds = FPlatformTime::Seconds() - StartSeconds - RecordSeconds;
+
+	const uint64 Recorded = Progress.EventsRecorded.load(std::memory_order_relaxed);
+	UE_LOG(LogTCPLoggingAnalytics, Display,
+		TEXT("Recorded (%llu) events in %.1f s, %.0f events/s of %.0f targeted, drained in %.1f s. Max lag %.1f ms"), Recorded,
+		RecordSeconds, Recorded / FMath::Max(RecordSeconds, 0.001), TargetRate * ClientCount, DrainSeconds,
+		Progress.MaxLagMicroseconds.load(std::memory_order_relaxed) / 1000.0);
+	UE_LOG(LogTCPLoggingAnalytics, Display,
+		TEXT("Back-pressure: (%llu) events dropped in staging, (%llu) sends would block, send buffer high water %d of %d bytes"),
+		StagingDropped, WouldBlock, MaxBufferedBytes, Settings.SendBufferBytes);
+
+	if (Sink.IsValid())
+	{
+		// One Session.Start per client on top of the replayed events
+		Sink->WaitForEvents(Recorded - StagingDropped + ClientCount, 10.0);
+		const FTCPLoggingLoopbackStats Stats = Sink->TakeStats();
+		UE_LOG(LogTCPLoggingAnalytics, Display, TEXT("Loopback collector received (%llu) events in (%llu) bytes"), Stats.Events,
+			Stats.BytesReceived);
+	}
+	return 0;
+}
@@ -0,0 +1,30 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+
+#include "TCPLoggingLoadGeneratorCommandlet.generated.h"
+
+/**
+ * Simulates many clients for sizing the collector. Replays a captured NDJSON stream, as the provider writes it, through
+ * independent provider instances that each keep their own session and connection, and reports throughput and
+ * back-pressure once a second and at the end. Without -Host the clients send to an in-process loopback collector.
+ *
+ *   -run=TCPLoggingLoadGenerator -Capture=<file> [-Clients=100] [-EventsPerSecond=10] [-Rate=1.0] [-Seconds=0]
+ *       [-DriverThreads=<cores>] [-Host=<host> -Port=<port>] [-Protocol=json] [-Compression=none]
+ *
+ * EventsPerSecond is the base rate of each client and Rate multiplies it. With Seconds=0 every client replays the
+ * capture once, otherwise the clients loop over it for that long.
+ */
+UCLASS()
+class UTCPLoggingLoadGeneratorCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UTCPLoggingLoadGeneratorCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
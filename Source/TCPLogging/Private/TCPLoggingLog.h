@@ -0,0 +1,12 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Per event lines are VeryVerbose, shipping builds compile them out instead of checking the verbosity at runtime
+#if UE_BUILD_SHIPPING
+DECLARE_LOG_CATEGORY_EXTERN(LogTCPLoggingAnalytics, Display, Log);
+#else
+DECLARE_LOG_CATEGORY_EXTERN(LogTCPLoggingAnalytics, Display, All);
+#endif
@@ -0,0 +1,323 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "TCPLoggingLoopbackSink.h"
+
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/RunnableThread.h"
+#include "IPAddress.h"
+#include "Misc/ScopeLock.h"
+#include "SocketSubsystem.h"
+#include "Sockets.h"
+#include "TCPLoggingBinaryProtocol.h"
+#include "TCPLoggingCompression.h"
+#include "TCPLoggingLog.h"
+
+/** How much the sink reads from a socket at a time */
+static constexpr int32 LoopbackReadSize = 64 * 1024;
+
+struct FTCPLoggingLoopbackSink::FConnection
+{
+	enum class EFormat : uint8
+	{
+		/** Fewer than four bytes seen, can not tell a stream header from NDJSON yet */
+		Unknown,
+		Ndjson,
+		Framed,
+	};
+
+	FSocket* Socket = nullptr;
+	EFormat Format = EFormat::Unknown;
+	/** Leading bytes held back until the format is known */
+	TArray<uint8> Undecided;
+	FTCPLoggingFrameDecoder FrameDecoder;
+	FTCPLoggingBinaryDecoder BinaryDecoder;
+	/** Output of the frame decoder, reused for every read */
+	TArray<uint8> Payload;
+	/** Decoded NDJSON not consumed yet, ends in a partial line if anything */
+	TArray<uint8> Text;
+	/** Ack being written back to a sequenced stream, and how much of it the socket took so far */
+	uint8 Ack[TCPLoggingWireFormat::AckSize];
+	int32 AckBytesSent = TCPLoggingWireFormat::AckSize;
+	uint64 AckedSequence = 0;
+};
+
+/** Position of Needle in Data, or INDEX_NONE */
+static int32 FindBytes(const uint8* Data, int32 Count, const char* Needle, int32 NeedleLen)
+{
+	for (int32 Offset = 0; Offset + NeedleLen <= Count; ++Offset)
+	{
+		if (Data[Offset] == (uint8) Needle[0] && FMemory::Memcmp(Data + Offset, Needle, NeedleLen) == 0)
+		{
+			return Offset;
+		}
+	}
+	return INDEX_NONE;
+}
+
+FTCPLoggingLoopbackSink::FTCPLoggingLoopbackSink()
+	: ListenSocket(nullptr)
+	, Port(0)
+	, EventCount(0)
+	, bStopping(false)
+	, Thread(nullptr)
+{
+}
+
+FTCPLoggingLoopbackSink::~FTCPLoggingLoopbackSink()
+{
+	if (Thread != nullptr)
+	{
+		Stop();
+		Thread->WaitForCompletion();
+		delete Thread;
+		Thread = nullptr;
+	}
+
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	for (const TUniquePtr<FConnection>& Connection : Connections)
+	{
+		Connection->Socket->Close();
+		SocketSubsystem->DestroySocket(Connection->Socket);
+	}
+	if (ListenSocket != nullptr)
+	{
+		ListenSocket->Close();
+		SocketSubsystem->DestroySocket(ListenSocket);
+		ListenSocket = nullptr;
+	}
+}
+
+bool FTCPLoggingLoopbackSink::Start()
+{
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	TSharedRef<FInternetAddr> Address = SocketSubsystem->CreateInternetAddr();
+	Address->SetIp(0x7F000001u);
+	Address->SetPort(0);
+
+	ListenSocket = SocketSubsystem->CreateSocket(NAME_Stream, TEXT("TCPLoggingLoopbackSink"), Address->GetProtocolType());
+	if (ListenSocket == nullptr || !ListenSocket->Bind(*Address) || !ListenSocket->Listen(16))
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Error, TEXT("Failed to start the loopback analytics sink (%s)"),
+			SocketSubsystem->GetSocketError(SocketSubsystem->GetLastErrorCode()));
+		return false;
+	}
+	ListenSocket->SetNonBlocking(true);
+	Port = ListenSocket->GetPortNo();
+
+	Thread = FRunnableThread::Create(this, TEXT("TCPLoggingLoopbackSink"), 0, TPri_Normal);
+	return Thread != nullptr;
+}
+
+FTCPLoggingLoopbackStats FTCPLoggingLoopbackSink::TakeStats()
+{
+	FScopeLock Lock(&StatsLock);
+	FTCPLoggingLoopbackStats Taken = MoveTemp(Stats);
+	Stats = FTCPLoggingLoopbackStats();
+	EventCount.store(0, std::memory_order_relaxed);
+	return Taken;
+}
+
+bool FTCPLoggingLoopbackSink::WaitForEvents(uint64 MinEvents, double TimeoutSeconds) const
+{
+	const double Deadline = FPlatformTime::Seconds() + TimeoutSeconds;
+	while (EventCount.load(std::memory_order_relaxed) < MinEvents)
+	{
+		if (FPlatformTime::Seconds() >= Deadline)
+		{
+			return false;
+		}
+		FPlatformProcess::Sleep(0.001f);
+	}
+	return true;
+}
+
+uint32 FTCPLoggingLoopbackSink::Run()
+{
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	while (!bStopping.load(std::memory_order_relaxed))
+	{
+		bool bHasPending = false;
+		while (ListenSocket->HasPendingConnection(bHasPending) && bHasPending)
+		{
+			FSocket* Accepted = ListenSocket->Accept(TEXT("TCPLoggingLoopbackSinkConnection"));
+			if (Accepted == nullptr)
+			{
+				break;
+			}
+			Accepted->SetNonBlocking(true);
+			Connections.Add(MakeUnique<FConnection>())->Socket = Accepted;
+		}
+
+		bool bReadAny = false;
+		for (int32 Index = Connections.Num() - 1; Index >= 0; --Index)
+		{
+			if (!ReadConnection(*Connections[Index], bReadAny))
+			{
+				Connections[Index]->Socket->Close();
+				SocketSubsystem->DestroySocket(Connections[Index]->Socket);
+				Connections.RemoveAt(Index);
+			}
+		}
+
+		if (!bReadAny)
+		{
+			FPlatformProcess::Sleep(0.0005f);
+		}
+	}
+	return 0;
+}
+
+void FTCPLoggingLoopbackSink::Stop()
+{
+	bStopping.store(true, std::memory_order_relaxed);
+}
+
+bool FTCPLoggingLoopbackSink::ReadConnection(FConnection& Connection, bool& bOutReadAny)
+{
+	uint8 Buffer[LoopbackReadSize];
+	for (;;)
+	{
+		int32 BytesRead = 0;
+		if (!Connection.Socket->Recv(Buffer, LoopbackReadSize, BytesRead))
+		{
+			const ESocketErrors Error = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->GetLastErrorCode();
+			if (Error != SE_EWOULDBLOCK && Error != SE_TRY_AGAIN)
+			{
+				return false;
+			}
+			break;
+		}
+		if (BytesRead <= 0)
+		{
+			break;
+		}
+		bOutReadAny = true;
+
+		{
+			FScopeLock Lock(&StatsLock);
+			Stats.BytesReceived += BytesRead;
+		}
+
+		const uint8* Data = Buffer;
+		int32 Count = BytesRead;
+		if (Connection.Format == FConnection::EFormat::Unknown)
+		{
+			Connection.Undecided.Append(Buffer, BytesRead);
+			if (Connection.Undecided.Num() < 4)
+			{
+				continue;
+			}
+			// NDJSON always opens with '{', anything else must be a stream header
+			Connection.Format = FMemory::Memcmp(Connection.Undecided.GetData(), "TCPL", 4) == 0 ? FConnection::EFormat::Framed
+																								  : FConnection::EFormat::Ndjson;
+			Data = Connection.Undecided.GetData();
+			Count = Connection.Undecided.Num();
+		}
+
+		if (Connection.Format == FConnection::EFormat::Ndjson)
+		{
+			Connection.Text.Append(Data, Count);
+		}
+		else
+		{
+			Connection.Payload.Reset();
+			if (!Connection.FrameDecoder.Decode(Data, Count, Connection.Payload))
+			{
+				return false;
+			}
+			if (Connection.FrameDecoder.GetPayloadFormat() == ETCPLoggingPayloadFormat::Binary)
+			{
+				if (!Connection.BinaryDecoder.Decode(Connection.Payload.GetData(), Connection.Payload.Num(), Connection.Text))
+				{
+					return false;
+				}
+			}
+			else
+			{
+				Connection.Text.Append(Connection.Payload);
+			}
+		}
+		Connection.Undecided.Empty();
+		ConsumeLines(Connection);
+	}
+	return SendAck(Connection);
+}
+
+bool FTCPLoggingLoopbackSink::SendAck(FConnection& Connection)
+{
+	// Everything decoded has been counted, which is as committed as the sink gets
+	const uint64 Sequence = Connection.FrameDecoder.GetLastSequence();
+	if (Connection.AckBytesSent == TCPLoggingWireFormat::AckSize && Connection.FrameDecoder.IsSequenced()
+		&& Sequence > Connection.AckedSequence)
+	{
+		for (int32 Byte = 0; Byte < TCPLoggingWireFormat::AckSize; ++Byte)
+		{
+			Connection.Ack[Byte] = (uint8) (Sequence >> (Byte * 8));
+		}
+		Connection.AckBytesSent = 0;
+		Connection.AckedSequence = Sequence;
+	}
+
+	while (Connection.AckBytesSent < TCPLoggingWireFormat::AckSize)
+	{
+		int32 BytesSent = 0;
+		if (!Connection.Socket->Send(Connection.Ack + Connection.AckBytesSent,
+				TCPLoggingWireFormat::AckSize - Connection.AckBytesSent, BytesSent))
+		{
+			const ESocketErrors Error = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->GetLastErrorCode();
+			return Error == SE_EWOULDBLOCK || Error == SE_TRY_AGAIN;
+		}
+		if (BytesSent <= 0)
+		{
+			break;
+		}
+		Connection.AckBytesSent += BytesSent;
+	}
+	return true;
+}
+
+void FTCPLoggingLoopbackSink::ConsumeLines(FConnection& Connection)
+{
+	// Matches how the JSON writer lays out a numeric attribute
+	const FString MarkerText = FString::Printf(TEXT("\"%s\",\"value\":"), ANSI_TO_TCHAR(LatencyAttributeName));
+	const FTCHARToUTF8 MarkerUtf8(*MarkerText);
+
+	const uint64 Now = FPlatformTime::Cycles64();
+	const uint8* Text = Connection.Text.GetData();
+	int32 LineStart = 0;
+	uint64 Lines = 0;
+	TArray<double, TInlineAllocator<256>> Latencies;
+	for (int32 Index = 0; Index < Connection.Text.Num(); ++Index)
+	{
+		if (Text[Index] != '\n')
+		{
+			continue;
+		}
+
+		++Lines;
+		const int32 Found = FindBytes(Text + LineStart, Index - LineStart, MarkerUtf8.Get(), MarkerUtf8.Length());
+		if (Found != INDEX_NONE)
+		{
+			uint64 Recorded = 0;
+			for (int32 Digit = LineStart + Found + MarkerUtf8.Length(); Digit < Index && Text[Digit] >= '0' && Text[Digit] <= '9'; ++Digit)
+			{
+				Recorded = Recorded * 10 + (Text[Digit] - '0');
+			}
+			if (Recorded != 0 && Recorded <= Now)
+			{
+				Latencies.Add((double) (Now - Recorded) * FPlatformTime::GetSecondsPerCycle64());
+			}
+		}
+		LineStart = Index + 1;
+	}
+	Connection.Text.RemoveAt(0, LineStart, false);
+
+	if (Lines > 0)
+	{
+		FScopeLock Lock(&StatsLock);
+		Stats.Events += Lines;
+		Stats.LatenciesSeconds.Append(Latencies);
+		EventCount.store(Stats.Events, std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,83 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "HAL/Runnable.h"
+#include "Templates/UniquePtr.h"
+
+#include <atomic>
+
+class FRunnableThread;
+class FSocket;
+
+/** What the sink received since it was last reset */
+struct FTCPLoggingLoopbackStats
+{
+	/** Bytes read off the sockets, i.e. what went over the wire */
+	uint64 BytesReceived = 0;
+	/** NDJSON lines after undoing any framing, compression and binary encoding */
+	uint64 Events = 0;
+	/** Record to receipt time of every event carrying a LatencyAttributeName attribute */
+	TArray<double> LatenciesSeconds;
+};
+
+/**
+ * In-process stand-in for the collector, used to benchmark the provider without a network or a real backend.
+ * Listens on an ephemeral loopback port, accepts any number of connections and decodes every stream, framed or not,
+ * back to NDJSON so it can count events and measure their latency. Sequenced streams are acked as soon as their frames
+ * are decoded.
+ */
+class FTCPLoggingLoopbackSink : public FRunnable
+{
+public:
+	/** Events with an attribute of this name whose value is FPlatformTime::Cycles64() at recording get their latency measured */
+	static constexpr const char* LatencyAttributeName = "BenchCycles";
+
+	FTCPLoggingLoopbackSink();
+	virtual ~FTCPLoggingLoopbackSink();
+
+	/** Starts listening, returns false if the socket could not be set up */
+	bool Start();
+
+	/** Port the sink listens on, valid once Start succeeded */
+	int32 GetPort() const
+	{
+		return Port;
+	}
+
+	/** Returns what was received so far and starts counting from zero */
+	FTCPLoggingLoopbackStats TakeStats();
+
+	/** Waits until at least MinEvents were received since the last TakeStats. Returns false on timeout */
+	bool WaitForEvents(uint64 MinEvents, double TimeoutSeconds) const;
+
+	// FRunnable interface
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+	struct FConnection;
+
+	/** Reads whatever the connection has, returns false once it is closed or sent garbage */
+	bool ReadConnection(FConnection& Connection, bool& bOutReadAny);
+
+	/** Writes back the sequence of the last frame decoded on a sequenced stream, returns false once it is closed */
+	bool SendAck(FConnection& Connection);
+
+	/** Counts the complete lines in Connection's decoded text */
+	void ConsumeLines(FConnection& Connection);
+
+	FSocket* ListenSocket;
+	int32 Port;
+	TArray<TUniquePtr<FConnection>> Connections;
+
+	/** Guards Stats, read by the benchmark while the sink thread fills it */
+	mutable FCriticalSection StatsLock;
+	FTCPLoggingLoopbackStats Stats;
+	std::atomic<uint64> EventCount;
+
+	std::atomic<bool> bStopping;
+	FRunnableThread* Thread;
+};
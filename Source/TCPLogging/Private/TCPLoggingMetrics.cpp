@@ -0,0 +1,331 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "TCPLoggingMetrics.h"
+
+#include "HAL/PlatformTime.h"
+#include "Misc/ScopeLock.h"
+#include "TCPLoggingThreadState.h"
+
+#include <cmath>
+
+namespace TCPLoggingHistogram
+{
+	static constexpr int32 SubBucketCount = 16;
+	/** frexp exponents covered, values from 2^-16 up to 2^48 */
+	static constexpr int32 MinExponent = -15;
+	static constexpr int32 MaxExponent = 48;
+	/** Bucket 0 holds zero and negative values */
+	static constexpr int32 BucketCount = 1 + (MaxExponent - MinExponent + 1) * SubBucketCount;
+
+	static int32 GetBucket(double Value)
+	{
+		if (!(Value > 0.0))
+		{
+			return 0;
+		}
+		int32 Exponent;
+		const double Mantissa = std::frexp(Value, &Exponent);
+		if (Exponent < MinExponent)
+		{
+			return 1;
+		}
+		if (Exponent > MaxExponent)
+		{
+			return BucketCount - 1;
+		}
+		const int32 SubBucket = FMath::Min((int32) ((Mantissa - 0.5) * 2.0 * SubBucketCount), SubBucketCount - 1);
+		return 1 + (Exponent - MinExponent) * SubBucketCount + SubBucket;
+	}
+
+	/** Midpoint of a bucket */
+	static double GetBucketValue(int32 Bucket)
+	{
+		if (Bucket == 0)
+		{
+			return 0.0;
+		}
+		const int32 Exponent = MinExponent + (Bucket - 1) / SubBucketCount;
+		const int32 SubBucket = (Bucket - 1) % SubBucketCount;
+		return std::ldexp(0.5 + (SubBucket + 0.5) / (2.0 * SubBucketCount), Exponent);
+	}
+}
+
+struct FTCPLoggingMetrics::FKey
+{
+	FName Name;
+	ETCPLoggingMetricType Type;
+	TArray<FTCPLoggingMetricTag, TInlineAllocator<4>> Tags;
+
+	FKey(FName InName, ETCPLoggingMetricType InType, TArrayView<const FTCPLoggingMetricTag> InTags)
+		: Name(InName)
+		, Type(InType)
+		, Tags(InTags)
+	{
+		// The same tags in another order are the same metric
+		Tags.Sort([](const FTCPLoggingMetricTag& A, const FTCPLoggingMetricTag& B) {
+			const int32 KeyOrder = A.Key.CompareIndexes(B.Key);
+			return KeyOrder != 0 ? KeyOrder < 0 : A.Value.CompareIndexes(B.Value) < 0;
+		});
+	}
+
+	bool operator==(const FKey& Other) const
+	{
+		return Name == Other.Name && Type == Other.Type && Tags == Other.Tags;
+	}
+
+	friend uint32 GetTypeHash(const FKey& Key)
+	{
+		uint32 Hash = HashCombine(GetTypeHash(Key.Name), (uint32) Key.Type);
+		for (const FTCPLoggingMetricTag& Tag : Key.Tags)
+		{
+			Hash = HashCombine(Hash, HashCombine(GetTypeHash(Tag.Key), GetTypeHash(Tag.Value)));
+		}
+		return Hash;
+	}
+};
+
+struct FTCPLoggingMetrics::FValue
+{
+	int64 Count = 0;
+	double Value = 0.0;
+	/** When a gauge was last set, so the newest value wins when shards are merged */
+	uint64 SetCycles = 0;
+	double Min = TNumericLimits<double>::Max();
+	double Max = TNumericLimits<double>::Lowest();
+	/** Histogram only, allocated on the first sample */
+	TArray<uint32> Buckets;
+
+	void Merge(const FValue& Other)
+	{
+		Count += Other.Count;
+		if (SetCycles == 0 && Other.SetCycles == 0)
+		{
+			Value += Other.Value;
+		}
+		else if (Other.SetCycles >= SetCycles)
+		{
+			Value = Other.Value;
+			SetCycles = Other.SetCycles;
+		}
+		Min = FMath::Min(Min, Other.Min);
+		Max = FMath::Max(Max, Other.Max);
+		if (Other.Buckets.Num() > 0)
+		{
+			Buckets.SetNumZeroed(TCPLoggingHistogram::BucketCount);
+			for (int32 Bucket = 0; Bucket < TCPLoggingHistogram::BucketCount; ++Bucket)
+			{
+				Buckets[Bucket] += Other.Buckets[Bucket];
+			}
+		}
+	}
+};
+
+struct FTCPLoggingMetrics::FShard
+{
+	/** Only contended while a flush merges this shard */
+	FCriticalSection Lock;
+	TMap<FKey, FValue> Values;
+	/** The owning thread exited, set under ShardsLock */
+	bool bExited = false;
+};
+
+FTCPLoggingMetrics::FTCPLoggingMetrics(double InIntervalSeconds, FSink&& InSink)
+	: IntervalSeconds(InIntervalSeconds)
+	, Sink(MoveTemp(InSink))
+	, InstanceId(TCPLoggingThreadState::Register([this](void* Shard) { ReleaseShard(static_cast<FShard*>(Shard)); }))
+	, IntervalStartCycles(FPlatformTime::Cycles64())
+	, bPaused(false)
+{
+	NextFlushCycles.store(
+		IntervalStartCycles + (uint64) (IntervalSeconds / FPlatformTime::GetSecondsPerCycle64()), std::memory_order_relaxed);
+}
+
+FTCPLoggingMetrics::~FTCPLoggingMetrics()
+{
+	TCPLoggingThreadState::Unregister(InstanceId);
+}
+
+void FTCPLoggingMetrics::AddCounter(FName Name, int64 Delta, TArrayView<const FTCPLoggingMetricTag> Tags)
+{
+	FShard& Shard = GetShard();
+	{
+		FScopeLock Lock(&Shard.Lock);
+		Shard.Values.FindOrAdd(FKey(Name, ETCPLoggingMetricType::Counter, Tags)).Count += Delta;
+	}
+	FlushIfDue();
+}
+
+void FTCPLoggingMetrics::SetGauge(FName Name, double Value, TArrayView<const FTCPLoggingMetricTag> Tags)
+{
+	FShard& Shard = GetShard();
+	{
+		FScopeLock Lock(&Shard.Lock);
+		FValue& Gauge = Shard.Values.FindOrAdd(FKey(Name, ETCPLoggingMetricType::Gauge, Tags));
+		Gauge.Value = Value;
+		Gauge.SetCycles = FPlatformTime::Cycles64();
+	}
+	FlushIfDue();
+}
+
+void FTCPLoggingMetrics::RecordHistogram(FName Name, double Value, TArrayView<const FTCPLoggingMetricTag> Tags)
+{
+	FShard& Shard = GetShard();
+	{
+		FScopeLock Lock(&Shard.Lock);
+		FValue& Histogram = Shard.Values.FindOrAdd(FKey(Name, ETCPLoggingMetricType::Histogram, Tags));
+		if (Histogram.Buckets.Num() == 0)
+		{
+			Histogram.Buckets.SetNumZeroed(TCPLoggingHistogram::BucketCount);
+		}
+		++Histogram.Buckets[TCPLoggingHistogram::GetBucket(Value)];
+		++Histogram.Count;
+		Histogram.Value += Value;
+		Histogram.Min = FMath::Min(Histogram.Min, Value);
+		Histogram.Max = FMath::Max(Histogram.Max, Value);
+	}
+	FlushIfDue();
+}
+
+FTCPLoggingMetrics::FShard& FTCPLoggingMetrics::GetShard()
+{
+	if (void* Shard = TCPLoggingThreadState::Find(InstanceId))
+	{
+		return *static_cast<FShard*>(Shard);
+	}
+
+	FShard* Shard = nullptr;
+	{
+		FScopeLock Lock(&ShardsLock);
+		Shard = Shards.Add_GetRef(MakeUnique<FShard>()).Get();
+	}
+	TCPLoggingThreadState::Add(InstanceId, Shard);
+	return *Shard;
+}
+
+void FTCPLoggingMetrics::ReleaseShard(FShard* Shard)
+{
+	FScopeLock Lock(&ShardsLock);
+	Shard->bExited = true;
+}
+
+void FTCPLoggingMetrics::FlushIfDue()
+{
+	const uint64 Now = FPlatformTime::Cycles64();
+	uint64 Due = NextFlushCycles.load(std::memory_order_relaxed);
+	if (Now < Due)
+	{
+		return;
+	}
+	if (NextFlushCycles.compare_exchange_strong(
+			Due, Now + (uint64) (IntervalSeconds / FPlatformTime::GetSecondsPerCycle64()), std::memory_order_relaxed))
+	{
+		FScopeLock FlushScope(&FlushLock);
+		if (!bPaused)
+		{
+			FlushLocked();
+		}
+	}
+}
+
+void FTCPLoggingMetrics::SetPaused(bool bInPaused)
+{
+	FScopeLock FlushScope(&FlushLock);
+	bPaused = bInPaused;
+}
+
+void FTCPLoggingMetrics::Flush()
+{
+	FScopeLock FlushScope(&FlushLock);
+	FlushLocked();
+}
+
+void FTCPLoggingMetrics::FlushLocked()
+{
+	TArray<FShard*> ShardsToMerge;
+	TArray<FShard*> ExitedShards;
+	{
+		FScopeLock Lock(&ShardsLock);
+		for (const TUniquePtr<FShard>& Shard : Shards)
+		{
+			ShardsToMerge.Add(Shard.Get());
+			if (Shard->bExited)
+			{
+				ExitedShards.Add(Shard.Get());
+			}
+		}
+	}
+
+	// Take each shard's values under its lock and merge outside it, recording threads only wait for the move
+	TMap<FKey, FValue> Merged;
+	for (FShard* Shard : ShardsToMerge)
+	{
+		TMap<FKey, FValue> Values;
+		{
+			FScopeLock Lock(&Shard->Lock);
+			Values = MoveTemp(Shard->Values);
+			Shard->Values.Reset();
+		}
+		for (TPair<FKey, FValue>& Pair : Values)
+		{
+			FValue* Existing = Merged.Find(Pair.Key);
+			if (Existing == nullptr)
+			{
+				Merged.Add(Pair.Key, MoveTemp(Pair.Value));
+			}
+			else
+			{
+				Existing->Merge(Pair.Value);
+			}
+		}
+	}
+
+	// Nothing writes to the shards of exited threads anymore, so once merged they are done with. Only flushes remove
+	// shards and FlushLock is held, so the pointers are still valid
+	if (ExitedShards.Num() > 0)
+	{
+		FScopeLock Lock(&ShardsLock);
+		Shards.RemoveAll([&ExitedShards](const TUniquePtr<FShard>& Shard) { return ExitedShards.Contains(Shard.Get()); });
+	}
+
+	const uint64 Now = FPlatformTime::Cycles64();
+	const double ElapsedSeconds = (double) (Now - IntervalStartCycles) * FPlatformTime::GetSecondsPerCycle64();
+	IntervalStartCycles = Now;
+	if (Merged.Num() == 0)
+	{
+		return;
+	}
+
+	TArray<FTCPLoggingMetricSnapshot> Snapshots;
+	Snapshots.Reserve(Merged.Num());
+	for (const TPair<FKey, FValue>& Pair : Merged)
+	{
+		FTCPLoggingMetricSnapshot& Snapshot = Snapshots.AddDefaulted_GetRef();
+		Snapshot.Name = Pair.Key.Name;
+		Snapshot.Tags.Append(Pair.Key.Tags);
+		Snapshot.Type = Pair.Key.Type;
+		Snapshot.Count = Pair.Value.Count;
+		Snapshot.Value = Pair.Value.Value;
+		if (Pair.Key.Type != ETCPLoggingMetricType::Histogram || Pair.Value.Count == 0)
+		{
+			continue;
+		}
+
+		Snapshot.Min = Pair.Value.Min;
+		Snapshot.Max = Pair.Value.Max;
+		const TPair<double, double*> Percentiles[] = {
+			{0.5, &Snapshot.P50}, {0.9, &Snapshot.P90}, {0.99, &Snapshot.P99}, {0.999, &Snapshot.P999}};
+		int32 Bucket = 0;
+		int64 Seen = 0;
+		for (const TPair<double, double*>& Percentile : Percentiles)
+		{
+			const int64 Rank = FMath::Max<int64>((int64) std::ceil(Percentile.Key * (double) Pair.Value.Count), 1);
+			while (Seen + Pair.Value.Buckets[Bucket] < Rank)
+			{
+				Seen += Pair.Value.Buckets[Bucket++];
+			}
+			*Percentile.Value = FMath::Clamp(TCPLoggingHistogram::GetBucketValue(Bucket), Snapshot.Min, Snapshot.Max);
+		}
+	}
+
+	Sink(MoveTemp(Snapshots), ElapsedSeconds);
+}
@@ -0,0 +1,91 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "TCPLoggingNumberFormat.h"
+
+namespace TCPLoggingNumberFormat
+{
+	static constexpr double PowersOfTen[] = {1.0, 10.0, 100.0, 1000.0, 10000.0, 100000.0, 1000000.0};
+
+	/** Writes Digits with a decimal point inserted Decimals digits from the right */
+	static FAnsiStringView FormatFixed(int64 Digits, int32 Decimals, ANSICHAR (&Text)[TCPLoggingMaxNumberText])
+	{
+		// Digits is not a multiple of ten unless Decimals is zero, FormatShortest would have stopped one decimal earlier
+		ANSICHAR Reversed[24];
+		int32 Pos = UE_ARRAY_COUNT(Reversed);
+		uint64 Magnitude = Digits < 0 ? 0 - (uint64) Digits : (uint64) Digits;
+		if (Decimals > 0)
+		{
+			for (int32 Decimal = 0; Decimal < Decimals; ++Decimal)
+			{
+				Reversed[--Pos] = (ANSICHAR) ('0' + Magnitude % 10);
+				Magnitude /= 10;
+			}
+			Reversed[--Pos] = '.';
+		}
+		do
+		{
+			Reversed[--Pos] = (ANSICHAR) ('0' + Magnitude % 10);
+			Magnitude /= 10;
+		} while (Magnitude != 0);
+		if (Digits < 0)
+		{
+			Reversed[--Pos] = '-';
+		}
+		const int32 Len = UE_ARRAY_COUNT(Reversed) - Pos;
+		FMemory::Memcpy(Text, Reversed + Pos, Len);
+		Text[Len] = '\0';
+		return FAnsiStringView(Text, Len);
+	}
+
+	/**
+	 * Values whose decimal with at most six decimals and fifteen digits reads back as Value are written as scaled
+	 * integers, with the fewest decimals that do. The powers of ten and the digits are exact doubles, so the division
+	 * rounds like parsing the text does. Everything else goes through printf with the lowest precision from
+	 * MinPrecision to MaxPrecision that reads back as Value
+	 */
+	template <typename FloatType>
+	static FAnsiStringView FormatShortest(
+		FloatType Value, int32 MinPrecision, int32 MaxPrecision, ANSICHAR (&Text)[TCPLoggingMaxNumberText])
+	{
+		if (!FMath::IsFinite(Value))
+		{
+			FCStringAnsi::Strcpy(Text, "null");
+			return FAnsiStringView(Text, 4);
+		}
+
+		for (int32 Decimals = 0; Decimals < (int32) UE_ARRAY_COUNT(PowersOfTen); ++Decimals)
+		{
+			const double Scaled = FMath::RoundToDouble((double) Value * PowersOfTen[Decimals]);
+			if (FMath::Abs(Scaled) >= 1e15)
+			{
+				break;
+			}
+			const int64 Digits = (int64) Scaled;
+			if ((FloatType) ((double) Digits / PowersOfTen[Decimals]) == Value)
+			{
+				return FormatFixed(Digits, Decimals, Text);
+			}
+		}
+
+		for (int32 Precision = MinPrecision;; ++Precision)
+		{
+			const int32 Len = FCStringAnsi::Snprintf(Text, TCPLoggingMaxNumberText, "%.*g", Precision, (double) Value);
+			if (Precision >= MaxPrecision || (FloatType) FCStringAnsi::Atod(Text) == Value)
+			{
+				return FAnsiStringView(Text, FMath::Clamp(Len, 0, TCPLoggingMaxNumberText - 1));
+			}
+		}
+	}
+}
+
+FAnsiStringView TCPLoggingFormatDouble(double Value, ANSICHAR (&Text)[TCPLoggingMaxNumberText])
+{
+	// Seventeen significant digits always read back as the same double
+	return TCPLoggingNumberFormat::FormatShortest(Value, 15, 17, Text);
+}
+
+FAnsiStringView TCPLoggingFormatFloat(float Value, ANSICHAR (&Text)[TCPLoggingMaxNumberText])
+{
+	// Nine significant digits always read back as the same float
+	return TCPLoggingNumberFormat::FormatShortest(Value, 6, 9, Text);
+}
@@ -0,0 +1,20 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "Containers/StringView.h"
+#include "CoreMinimal.h"
+
+/** Room for any text TCPLoggingFormatDouble or TCPLoggingFormatFloat produce, terminator included */
+static constexpr int32 TCPLoggingMaxNumberText = 32;
+
+/**
+ * Formats Value as JSON number text into Text and returns a view of it, "null" for NaN and infinity, which JSON
+ * cannot represent. The text always reads back as the same double. Values that are a decimal with at most six
+ * decimals, most of what games record, are written with the fewest decimals that do without going through printf,
+ * anything else with the fewest significant digits that do, e.g. 0.1 + 0.2 as 0.30000000000000004.
+ */
+FAnsiStringView TCPLoggingFormatDouble(double Value, ANSICHAR (&Text)[TCPLoggingMaxNumberText]);
+
+/** The same at float precision, so a float such as 4.99f comes out as 4.99 rather than its widened binary value */
+FAnsiStringView TCPLoggingFormatFloat(float Value, ANSICHAR (&Text)[TCPLoggingMaxNumberText]);
@@ -5,48 +5,132 @@
 #include "Analytics.h"
 #include "AnalyticsEventAttribute.h"
 #include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
 #include "Interfaces/IAnalyticsProvider.h"
+#include "TCPLoggingBinaryWriter.h"
+#include "TCPLoggingBufferPool.h"
+#include "TCPLoggingEventPolicy.h"
+#include "TCPLoggingJsonWriter.h"
+#include "TCPLoggingLog.h"
+#include "TCPLoggingMetrics.h"
+#include "TCPLoggingSender.h"
+#include "TCPLoggingStaging.h"
+#include "TCPLoggingStats.h"
+#include "Templates/UniquePtr.h"
+
+#include <atomic>
+#include <initializer_list>
 
 class Error;
 
+/**
+ * Every Record* call may come from any thread. Recording serializes into the calling thread's staging buffer and never
+ * touches the sender, so it does not race with the session being started or ended elsewhere.
+ */
 class FAnalyticsProviderTCPLogging : public IAnalyticsProvider
 {
 public:
-	/** Tracks whether we need to start the session or restart it */
-	bool bHasSessionStarted;
+	/** Tracks whether we need to start the session or restart it, read by every recording thread */
+	std::atomic<bool> bHasSessionStarted;
 	/** Id representing the user the analytics are recording for */
 	FString UserId;
 	/** Unique Id representing the session the analytics are recording for */
 	FString SessionId;
+	/** Id of the device, only sent when session guids are generated */
+	FString DeviceId;
 
 	FString Host;
 	int32 Port;
 
 	bool bGenerateSessionGuid;
+	/** Every event carries timestampUs, see WriteTimestamp */
 	bool bTimeStampEvents;
 
+	/** Batching thresholds handed to the sender on every session start */
+	FTCPLoggingSenderSettings SenderSettings;
+
+	/** Instance the module hands out by default, see Create. CreateInstance makes independent ones next to it */
 	static TSharedPtr<IAnalyticsProvider> Provider;
 
 protected:
-	// TSharedRef<FInternetAddr> Addr;
-	FSocket* Socket;
+	/** Staging chunks are allocated from here, the sender hands them back once batched */
+	FTCPLoggingBufferPool BufferPool;
+	/** Per thread staging buffers the sender collects recorded messages from, outlives every session */
+	FTCPLoggingStaging Staging;
+
+	/** Background thread that connects to the collector and writes staged messages, alive during a session */
+	TUniquePtr<FTCPLoggingSender> Sender;
+	/** Serializes starting, ending and flushing the session, recording never takes it */
+	mutable FCriticalSection SessionLock;
+
+	/** Chunks the staging budget buys, zero for an unbounded pool */
+	static int32 GetSlabChunks(const FTCPLoggingSenderSettings& InSenderSettings);
+
+	/** Chunk buffers kept for reuse */
+	static constexpr int32 MaxPooledChunks = 256;
+	/** Headroom over the chunk size so the message closing a chunk rarely has to go into the next one */
+	static constexpr int32 MessageBufferSize = 512;
+	/** Without a slab, oversize chunks of unusually large events beyond this are freed rather than pooled */
+	static constexpr int32 MaxPooledMessageBufferSize = 64 * 1024;
+
+	/** Longest FlushEvents will block waiting for the sender to write out pending batches */
+	static constexpr double FlushTimeoutSeconds = 2.0;
+
+	/** Sampling and rate limits applied to RecordEvent */
+	FTCPLoggingEventThrottle EventThrottle;
+	/** Cycle count after which the next RecordEvent reports what the throttle suppressed */
+	std::atomic<uint64> NextSuppressedSummaryCycles;
 
+	/** Staging drops already reported to the collector, per lane */
+	std::atomic<uint64> ReportedDroppedCounts[TCPLoggingNumLanes];
+
+	/** How often suppressed and dropped event counts are reported while events keep being recorded */
+	static constexpr double SuppressedSummaryIntervalSeconds = 60.0;
+
+	/** Staging drops already logged, per lane, and the cycle count after which the next log line may be written */
+	std::atomic<uint64> LoggedDroppedCounts[TCPLoggingNumLanes];
+	std::atomic<uint64> NextDropLogCycles;
+
+	/** Drops happen when recording outpaces the sender, so they are logged at most this often rather than per event */
+	static constexpr double DropLogIntervalSeconds = 5.0;
+
+	/** Epoch microseconds at a cycle count of zero, captured at session start */
+	std::atomic<int64> TimestampEpochOffsetUs;
+	const double MicrosecondsPerCycle;
+
+	/** Counters, gauges and histograms, reported as TCPLogging.Metrics events once per interval */
+	FTCPLoggingMetrics Metrics;
+
+	static constexpr double MetricsIntervalSeconds = 10.0;
+	/** A larger interval is split over several events so none of them outgrows a batch */
+	static constexpr int32 MaxMetricsPerEvent = 64;
 
 public:
-	FAnalyticsProviderTCPLogging(const FString HostName, int32 Port, bool bGenerateSessionGuid, bool bTimeStampEvents);
+	FAnalyticsProviderTCPLogging(const FString HostName, int32 Port, bool bGenerateSessionGuid, bool bTimeStampEvents,
+		const FTCPLoggingSenderSettings& InSenderSettings);
 	virtual ~FAnalyticsProviderTCPLogging();
 
-	static TSharedPtr<IAnalyticsProvider> Create(
-		const FString HostName, int32 Port, bool bGenerateSessionGuid, bool bTimeStampEvents)
+	/** Returns the shared default instance, creating it on first use. Later calls ignore their arguments */
+	static TSharedPtr<IAnalyticsProvider> Create(const FString HostName, int32 Port, bool bGenerateSessionGuid, bool bTimeStampEvents,
+		const FTCPLoggingSenderSettings& InSenderSettings)
 	{
 		if (!Provider.IsValid())
 		{
-			Provider = TSharedPtr<IAnalyticsProvider>(
-				new FAnalyticsProviderTCPLogging(HostName, Port, bGenerateSessionGuid, bTimeStampEvents));
+			Provider = CreateInstance(HostName, Port, bGenerateSessionGuid, bTimeStampEvents, InSenderSettings);
 		}
 		return Provider;
 	}
 
+	/**
+	 * Creates an instance independent of the default one and of any other, with its own session, staging and sender
+	 * thread. Any number of them can record concurrently in one process.
+	 */
+	static TSharedPtr<FAnalyticsProviderTCPLogging> CreateInstance(const FString HostName, int32 Port, bool bGenerateSessionGuid,
+		bool bTimeStampEvents, const FTCPLoggingSenderSettings& InSenderSettings)
+	{
+		return MakeShareable(new FAnalyticsProviderTCPLogging(HostName, Port, bGenerateSessionGuid, bTimeStampEvents, InSenderSettings));
+	}
+
 	static void Destroy()
 	{
 		Provider.Reset();
@@ -56,6 +140,32 @@ public:
 	virtual void EndSession() override;
 	virtual void FlushEvents() override;
 
+	/** Send buffer usage of the current session, including the high water mark */
+	FTCPLoggingSocketWriterStats GetSocketStats() const;
+
+	/** Events dropped so far because the recording thread had too much waiting for the sender, or by the overflow policy */
+	uint64 GetStagingDroppedCount() const
+	{
+		return Staging.GetDroppedCount();
+	}
+
+	uint64 GetStagingDroppedCount(ETCPLoggingLane Lane) const
+	{
+		return Staging.GetDroppedCount(Lane);
+	}
+
+	/**
+	 * Replaces the per event name sampling and rate limits, in the TCPLoggingEventPolicies format.
+	 * Safe to call at any time from any thread, an empty string removes every policy.
+	 */
+	void SetEventPolicies(const FString& PolicyText);
+
+	/** Aggregates metrics for the current session, anything recorded outside a session is discarded at flush */
+	FTCPLoggingMetrics& GetMetrics()
+	{
+		return Metrics;
+	}
+
 	virtual void SetUserID(const FString& InUserID) override;
 	virtual FString GetUserID() const override;
 
@@ -64,6 +174,12 @@ public:
 
 	virtual void RecordEvent(const FString& EventName, const TArray<FAnalyticsEventAttribute>& Attributes) override;
 
+	/**
+	 * RecordEvent with attributes that keep their type, e.g. RecordEvent(Name, {{"Level", 3}, {"Progress", 0.5}}).
+	 * Numbers go straight from their value into the staging buffer, nothing is formatted into an FString.
+	 */
+	void RecordEvent(const FString& EventName, std::initializer_list<FTCPLoggingAttribute> Attributes);
+
 	virtual void RecordItemPurchase(const FString& ItemId, const FString& Currency, int PerItemCost, int ItemQuantity) override;
 
 	virtual void RecordCurrencyPurchase(const FString& GameCurrencyType, int GameCurrencyAmount, const FString& RealCurrencyType,
@@ -82,5 +198,96 @@ public:
 		const FString& ProgressType, const FString& ProgressHierarchy, const TArray<FAnalyticsEventAttribute>& EventAttrs) override;
 
 protected:
-	void SendJSON(FString& serialized);
+	/**
+	 * Runs Serialize with the writer for the configured protocol, FTCPLoggingJsonWriter or FTCPLoggingBinaryWriter.
+	 * Both share one interface, so every event is described once whichever format goes on the wire.
+	 */
+	template <typename FuncType>
+	void SerializeMessage(TArray<uint8>& Message, FuncType&& Serialize) const
+	{
+		if (SenderSettings.PayloadFormat == ETCPLoggingPayloadFormat::Binary)
+		{
+			FTCPLoggingBinaryWriter Writer(Message);
+			Serialize(Writer);
+			Writer.EndMessage();
+		}
+		else
+		{
+			FTCPLoggingJsonWriter Writer(Message);
+			Serialize(Writer);
+			Writer.EndMessage();
+		}
+	}
+
+	/**
+	 * Writes when the event was recorded as "timestampUs", epoch microseconds, if bTimeStampEvents is set.
+	 * Costs one cycle counter read and a multiply-add on the recording thread, nothing is formatted as a date.
+	 */
+	template <typename WriterType>
+	void WriteTimestamp(WriterType& Writer) const
+	{
+		if (bTimeStampEvents)
+		{
+			const double CyclesUs = (double) FPlatformTime::Cycles64() * MicrosecondsPerCycle;
+			Writer.WriteInteger("timestampUs", TimestampEpochOffsetUs.load(std::memory_order_relaxed) + (int64) CyclesUs);
+		}
+	}
+
+	/**
+	 * Serializes an event into the calling thread's staging buffer for the sender, never blocks on the socket.
+	 * Critical messages (purchases and errors) reach the disk spool, when it is enabled, once the sender collects them.
+	 */
+	template <typename FuncType>
+	void RecordMessage(ETCPLoggingLane Lane, FuncType&& Serialize)
+	{
+		const bool bCritical = Lane == ETCPLoggingLane::Critical;
+		const bool bStaged = Staging.Stage(Lane, [&](TArray<uint8>& Message) {
+			SCOPE_CYCLE_COUNTER(STAT_TCPLogging_SerializeEvent);
+			TRACE_CPUPROFILER_EVENT_SCOPE(TCPLogging_SerializeEvent);
+			SerializeMessage(Message, Serialize);
+		});
+		if (bStaged)
+		{
+			INC_DWORD_STAT(STAT_TCPLogging_EventsRecorded);
+			CSV_CUSTOM_STAT(TCPLogging, EventsRecorded, 1, ECsvCustomStatOp::Accumulate);
+			if (bCritical)
+			{
+				INC_DWORD_STAT(STAT_TCPLogging_CriticalEventsRecorded);
+				CSV_CUSTOM_STAT(TCPLogging, CriticalEventsRecorded, 1, ECsvCustomStatOp::Accumulate);
+			}
+		}
+		else if (bCritical)
+		{
+			INC_DWORD_STAT(STAT_TCPLogging_EventsDropped);
+			INC_DWORD_STAT(STAT_TCPLogging_CriticalEventsDropped);
+			CSV_CUSTOM_STAT(TCPLogging, EventsDropped, 1, ECsvCustomStatOp::Accumulate);
+			CSV_CUSTOM_STAT(TCPLogging, CriticalEventsDropped, 1, ECsvCustomStatOp::Accumulate);
+			LogDroppedEventsIfDue();
+		}
+		else
+		{
+			INC_DWORD_STAT(STAT_TCPLogging_EventsDropped);
+			CSV_CUSTOM_STAT(TCPLogging, EventsDropped, 1, ECsvCustomStatOp::Accumulate);
+			LogDroppedEventsIfDue();
+		}
+	}
+
+	/** Logs how many events staging dropped since the last line, at most once per DropLogIntervalSeconds */
+	void LogDroppedEventsIfDue();
+
+	/** Body of both RecordEvent overloads, Attributes is anything the writers' WriteAttributes takes */
+	template <typename AttributesType>
+	void RecordEventWithAttributes(const FString& EventName, const AttributesType& Attributes);
+
+	/** Records the summary of suppressed events if the interval has elapsed, only one thread wins when several race */
+	void RecordSuppressedSummaryIfDue();
+
+	/**
+	 * Records one TCPLogging.EventsSuppressed event per event name the throttle dropped since the last summary, and a
+	 * TCPLogging.EventsDropped event if staging dropped any
+	 */
+	void RecordSuppressedSummary();
+
+	/** Sink of Metrics, records one interval as TCPLogging.Metrics events */
+	void RecordMetrics(TArray<FTCPLoggingMetricSnapshot>&& Snapshots, double IntervalSeconds);
 };
@@ -0,0 +1,126 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Templates/UniquePtr.h"
+
+#include <atomic>
+
+/**
+ * Fixed capacity lock-free queue with any number of producers and consumers.
+ * Every slot is allocated up front so enqueueing never touches the allocator, and a full queue
+ * rejects new items instead of growing.
+ */
+template <typename ElementType>
+class TTCPLoggingBoundedQueue
+{
+public:
+	explicit TTCPLoggingBoundedQueue(uint32 InCapacity)
+	{
+		const uint32 Capacity = FMath::RoundUpToPowerOfTwo(FMath::Max<uint32>(InCapacity, 2));
+		Mask = Capacity - 1;
+		Cells = MakeUnique<FCell[]>(Capacity);
+		for (uint32 Index = 0; Index < Capacity; ++Index)
+		{
+			Cells[Index].Sequence.store(Index, std::memory_order_relaxed);
+		}
+		EnqueuePos.store(0, std::memory_order_relaxed);
+		DequeuePos.store(0, std::memory_order_relaxed);
+	}
+
+	UE_NONCOPYABLE(TTCPLoggingBoundedQueue);
+
+	/** Adds an item to the queue. Safe to call from any thread. Returns false if the queue is full */
+	bool Enqueue(ElementType&& Item)
+	{
+		uint64 Pos = EnqueuePos.load(std::memory_order_relaxed);
+		FCell* Cell;
+		for (;;)
+		{
+			Cell = &Cells[Pos & Mask];
+			const uint64 Sequence = Cell->Sequence.load(std::memory_order_acquire);
+			const int64 Diff = (int64) Sequence - (int64) Pos;
+			if (Diff == 0)
+			{
+				if (EnqueuePos.compare_exchange_weak(Pos, Pos + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (Diff < 0)
+			{
+				return false;
+			}
+			else
+			{
+				Pos = EnqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+		Cell->Item = MoveTemp(Item);
+		Cell->Sequence.store(Pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Removes the oldest item from the queue. Safe to call from any thread. Returns false if the queue is empty */
+	bool Dequeue(ElementType& OutItem)
+	{
+		uint64 Pos = DequeuePos.load(std::memory_order_relaxed);
+		FCell* Cell;
+		for (;;)
+		{
+			Cell = &Cells[Pos & Mask];
+			const uint64 Sequence = Cell->Sequence.load(std::memory_order_acquire);
+			const int64 Diff = (int64) Sequence - (int64) (Pos + 1);
+			if (Diff == 0)
+			{
+				if (DequeuePos.compare_exchange_weak(Pos, Pos + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (Diff < 0)
+			{
+				return false;
+			}
+			else
+			{
+				Pos = DequeuePos.load(std::memory_order_relaxed);
+			}
+		}
+		OutItem = MoveTemp(Cell->Item);
+		Cell->Sequence.store(Pos + Mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Approximate number of queued items, only exact when no producer is active */
+	int32 Num() const
+	{
+		const uint64 Enqueued = EnqueuePos.load(std::memory_order_relaxed);
+		const uint64 Dequeued = DequeuePos.load(std::memory_order_relaxed);
+		return Enqueued > Dequeued ? (int32) (Enqueued - Dequeued) : 0;
+	}
+
+	bool IsEmpty() const
+	{
+		return Num() == 0;
+	}
+
+	int32 Capacity() const
+	{
+		return (int32) (Mask + 1);
+	}
+
+private:
+	struct FCell
+	{
+		std::atomic<uint64> Sequence;
+		ElementType Item;
+	};
+
+	TUniquePtr<FCell[]> Cells;
+	uint64 Mask;
+
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint64> EnqueuePos;
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint64> DequeuePos;
+};
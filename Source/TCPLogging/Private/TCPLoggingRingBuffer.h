@@ -0,0 +1,175 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TCPLoggingIoSlice.h"
+
+/**
+ * Fixed capacity byte FIFO backed by a single power of two allocation.
+ * Positions are tracked as ever increasing 64 bit offsets so callers can remember where a frame started
+ * and the buffer only moves data to cut bytes out of the middle. Reading and releasing are separate: bytes that have been
+ * read stay in the buffer until released, so a reader can rewind and read them again. Not thread safe.
+ */
+class FTCPLoggingRingBuffer
+{
+public:
+	explicit FTCPLoggingRingBuffer(int32 InCapacity)
+		: ReleasePos(0)
+		, ReadPos(0)
+		, WritePos(0)
+		, HighWaterMark(0)
+	{
+		const uint32 Capacity = FMath::RoundUpToPowerOfTwo((uint32) FMath::Max(InCapacity, 64));
+		Storage.SetNumUninitialized(Capacity);
+		Mask = Capacity - 1;
+	}
+
+	/** Copies as much of Data as fits, returns the number of bytes written */
+	int32 Write(const uint8* Data, int32 Count)
+	{
+		Count = FMath::Min(Count, Space());
+		const uint32 Start = (uint32) (WritePos & Mask);
+		const int32 FirstPart = FMath::Min(Count, Capacity() - (int32) Start);
+		FMemory::Memcpy(Storage.GetData() + Start, Data, FirstPart);
+		FMemory::Memcpy(Storage.GetData(), Data + FirstPart, Count - FirstPart);
+		WritePos += Count;
+		HighWaterMark = FMath::Max(HighWaterMark, NumRetained());
+		return Count;
+	}
+
+	/** Longest run of unread bytes that is contiguous in memory, starting at the read position */
+	const uint8* PeekContiguous(int32& OutCount) const
+	{
+		const uint32 Start = (uint32) (ReadPos & Mask);
+		OutCount = FMath::Min(Num(), Capacity() - (int32) Start);
+		return Storage.GetData() + Start;
+	}
+
+	/**
+	 * Fills OutSlices with the first Count unread bytes, which are in at most two pieces since they wrap around at most
+	 * once. Returns the number of pieces, zero if Count is zero or the ring is empty
+	 */
+	int32 PeekSlices(int32 Count, FTCPLoggingIoSlice OutSlices[2]) const
+	{
+		Count = FMath::Min(Count, Num());
+		int32 FirstPart = 0;
+		const uint8* First = PeekContiguous(FirstPart);
+		FirstPart = FMath::Min(FirstPart, Count);
+		int32 NumSlices = 0;
+		if (FirstPart > 0)
+		{
+			OutSlices[NumSlices++] = FTCPLoggingIoSlice{First, FirstPart};
+		}
+		if (Count > FirstPart)
+		{
+			OutSlices[NumSlices++] = FTCPLoggingIoSlice{Storage.GetData(), Count - FirstPart};
+		}
+		return NumSlices;
+	}
+
+	/** Advances the read position once bytes have been sent, they stay retained until released */
+	void Consume(int32 Count)
+	{
+		check(Count <= Num());
+		ReadPos += Count;
+	}
+
+	/** Frees everything before Position for new writes. Position must not be past the read position */
+	void Release(uint64 Position)
+	{
+		check(Position >= ReleasePos && Position <= ReadPos);
+		ReleasePos = Position;
+	}
+
+	/** Moves the read position back to the oldest retained byte */
+	void Rewind()
+	{
+		ReadPos = ReleasePos;
+	}
+
+	/**
+	 * Cuts Count unread bytes out at Position by moving the ones written after them back, the only operation that moves
+	 * data. Position must not be before the read position.
+	 */
+	void Remove(uint64 Position, int32 Count)
+	{
+		check(Position >= ReadPos && Position + Count <= WritePos);
+		// Every retained byte maps to its own index, so copying forward never overwrites a byte before it was moved
+		for (uint64 From = Position + Count, To = Position; From < WritePos;)
+		{
+			const uint32 FromIndex = (uint32) (From & Mask);
+			const uint32 ToIndex = (uint32) (To & Mask);
+			const int32 Run = FMath::Min3((int32) (WritePos - From), Capacity() - (int32) FromIndex, Capacity() - (int32) ToIndex);
+			FMemory::Memmove(Storage.GetData() + ToIndex, Storage.GetData() + FromIndex, Run);
+			From += Run;
+			To += Run;
+		}
+		WritePos -= Count;
+	}
+
+	/** Discards everything, keeping the allocation */
+	void Reset()
+	{
+		ReleasePos = ReadPos = WritePos;
+	}
+
+	/** Bytes not read yet */
+	int32 Num() const
+	{
+		return (int32) (WritePos - ReadPos);
+	}
+
+	/** Bytes not released yet, including ones already read */
+	int32 NumRetained() const
+	{
+		return (int32) (WritePos - ReleasePos);
+	}
+
+	int32 Space() const
+	{
+		return Capacity() - NumRetained();
+	}
+
+	int32 Capacity() const
+	{
+		return (int32) (Mask + 1);
+	}
+
+	bool IsEmpty() const
+	{
+		return WritePos == ReadPos;
+	}
+
+	/** Logical offset of the oldest retained byte */
+	uint64 GetReleasePosition() const
+	{
+		return ReleasePos;
+	}
+
+	/** Logical offset of the next byte to be read */
+	uint64 GetReadPosition() const
+	{
+		return ReadPos;
+	}
+
+	/** Logical offset the next write will land at */
+	uint64 GetWritePosition() const
+	{
+		return WritePos;
+	}
+
+	/** Most bytes ever retained at once */
+	int32 GetHighWaterMark() const
+	{
+		return HighWaterMark;
+	}
+
+private:
+	TArray<uint8> Storage;
+	uint32 Mask;
+	uint64 ReleasePos;
+	uint64 ReadPos;
+	uint64 WritePos;
+	int32 HighWaterMark;
+};
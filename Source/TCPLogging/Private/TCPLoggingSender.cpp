@@ -0,0 +1,958 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "TCPLoggingSender.h"
+
+#include "HAL/Event.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/Timespan.h"
+#include "SocketSubsystem.h"
+#include "Sockets.h"
+#include "TCPLoggingBinaryProtocol.h"
+#include "TCPLoggingBinaryWriter.h"
+#include "TCPLoggingConnection.h"
+#include "TCPLoggingDatagram.h"
+#include "TCPLoggingJsonWriter.h"
+#include "TCPLoggingLog.h"
+#include "TCPLoggingSpool.h"
+#include "TCPLoggingStaging.h"
+#include "TCPLoggingStats.h"
+
+/** Upper bound on how long the sender sleeps when nothing wakes it */
+static constexpr uint32 SenderIdleWaitMs = 100;
+
+/** How long the sender blocks on socket writability at a time while the collector applies backpressure */
+static constexpr double WritableWaitSeconds = 0.01;
+
+/** One collector connection with everything that has to follow it from one connection to the next */
+struct FTCPLoggingSender::FLink
+{
+	FLink(FTCPLoggingEndpointSet& Endpoints, TArray<int32>&& Order, const FTCPLoggingSenderSettings& Settings)
+		: Connection(Endpoints, MoveTemp(Order), Settings)
+		, Writer(Settings.SendBufferBytes, Settings.bAcknowledge ? FMath::Max(Settings.AckWindowFrames, 1) : 0)
+		, bResendDictionary(false)
+		, bWasConnected(false)
+		, OutageDroppedCount(0)
+		, AckBytesRead(0)
+		, LastAckTime(0.0)
+	{
+	}
+
+	FTCPLoggingConnection Connection;
+	/** Buffers batch bytes the socket has not accepted yet */
+	FTCPLoggingSocketWriter Writer;
+	/** String dictionary of the binary protocol, it only grows over the session */
+	FTCPLoggingBinaryEncoder BinaryEncoder;
+	/** Set when the collector may have missed definitions, the next frame then starts with the whole dictionary */
+	bool bResendDictionary;
+	bool bWasConnected;
+	/** Messages dropped since the connection was lost, reported once it is back */
+	int32 OutageDroppedCount;
+	/** Ack the collector has only sent part of so far */
+	uint8 AckBytes[TCPLoggingWireFormat::AckSize];
+	int32 AckBytesRead;
+	/** When the last ack arrived, or the first frame waiting for one was appended */
+	double LastAckTime;
+};
+
+FTCPLoggingSender::FTCPLoggingSender(TArray<FTCPLoggingEndpoint>&& InEndpoints, const FString& SessionKey, TArray<uint8>&& Preamble,
+	TArray<uint8>&& Envelope, FTCPLoggingStaging& InStaging, const FTCPLoggingSenderSettings& InSettings)
+	: Staging(InStaging)
+	, Settings(InSettings)
+	, Endpoints(MoveTemp(InEndpoints), Settings.ReconnectBaseDelaySeconds, Settings.ReconnectMaxDelaySeconds)
+	, bConnected(false)
+	, bConnecting(true)
+	, Encoder(Settings.Compression, Settings.PayloadFormat, Settings.bAcknowledge)
+	, ReplayMarker(0)
+	, DatagramStartTime(0.0)
+	, NextSequence(1)
+	, bStopping(false)
+	, FlushRequested(0)
+	, FlushCompleted(0)
+	, FlushEvent(FPlatformProcess::GetSynchEventFromPool(false))
+	, Thread(nullptr)
+{
+	// Gathered batches only copy enveloped messages
+	const bool bCopiesMessages = IsFramed() || Envelope.Num() > 0;
+	for (int32 Lane = 0; Lane < TCPLoggingNumLanes; ++Lane)
+	{
+		if (bCopiesMessages)
+		{
+			Batches[Lane].Data.Reserve(Settings.MaxBatchBytes * 2);
+		}
+		RetentionDroppedCounts[Lane].store(0, std::memory_order_relaxed);
+	}
+	SessionPreamble = MoveTemp(Preamble);
+	SessionEnvelope = MoveTemp(Envelope);
+	if (Settings.bSpoolEnabled)
+	{
+		// Every segment starts with the preamble so a replay in a later session is attributed to this one
+		Spool = MakeUnique<FTCPLoggingSpool>(Settings.SpoolDirectory, Settings.SpoolMaxBytes, Settings.PayloadFormat, SessionPreamble);
+	}
+
+	// Every link walks the session's ring order from a different starting point, so they land on different collectors
+	TArray<int32> RingOrder;
+	Endpoints.GetRingOrder(SessionKey, RingOrder);
+	const int32 LinkCount = Settings.Balancing == ETCPLoggingBalancing::LeastOutstandingBytes
+		? FMath::Clamp(Settings.MaxConnections, 1, Endpoints.Num())
+		: 1;
+	for (int32 Index = 0; Index < LinkCount; ++Index)
+	{
+		TArray<int32> Order;
+		for (int32 Step = 0; Step < RingOrder.Num(); ++Step)
+		{
+			Order.Add(RingOrder[(Index + Step) % RingOrder.Num()]);
+		}
+		Links.Add(MakeUnique<FLink>(Endpoints, MoveTemp(Order), Settings));
+		RefreshPreamble(*Links.Last());
+	}
+
+	if (Settings.Transport == ETCPLoggingTransport::Udp)
+	{
+		Datagrams = MakeUnique<FTCPLoggingDatagramWriter>(SessionKey, Settings.PayloadFormat, Settings.MaxDatagramBytes);
+	}
+
+	// Created last so Run never sees a partially constructed sender
+	Thread = FRunnableThread::Create(this, TEXT("TCPLoggingSender"), 0, TPri_BelowNormal);
+}
+
+FTCPLoggingSender::~FTCPLoggingSender()
+{
+	if (Thread != nullptr)
+	{
+		Stop();
+		Thread->WaitForCompletion();
+		delete Thread;
+		Thread = nullptr;
+	}
+	FPlatformProcess::ReturnSynchEventToPool(FlushEvent);
+	FlushEvent = nullptr;
+}
+
+ETCPLoggingFlushResult FTCPLoggingSender::Flush(double TimeoutSeconds)
+{
+	if (!IsConnected() && !bConnecting.load(std::memory_order_relaxed))
+	{
+		return ETCPLoggingFlushResult::NotConnected;
+	}
+
+	const uint64 Request = FlushRequested.fetch_add(1, std::memory_order_acq_rel) + 1;
+	Staging.Interrupt();
+
+	const double EndTime = FPlatformTime::Seconds() + TimeoutSeconds;
+	while (FlushCompleted.load(std::memory_order_acquire) < Request)
+	{
+		const double Remaining = EndTime - FPlatformTime::Seconds();
+		if (Remaining <= 0.0)
+		{
+			return ETCPLoggingFlushResult::TimedOut;
+		}
+		// Several threads may be flushing at once, so never wait long on the shared event
+		FlushEvent->Wait(FMath::Clamp((uint32) (Remaining * 1000.0), 1u, 10u));
+	}
+	// The sender also completes requests once every attempt to connect has failed
+	return IsConnected() ? ETCPLoggingFlushResult::Flushed : ETCPLoggingFlushResult::NotConnected;
+}
+
+FTCPLoggingSocketWriterStats FTCPLoggingSender::GetSocketStats() const
+{
+	FTCPLoggingSocketWriterStats Total;
+	for (const TUniquePtr<FLink>& Link : Links)
+	{
+		const FTCPLoggingSocketWriterStats Stats = Link->Writer.GetStats();
+		Total.BytesSent += Stats.BytesSent;
+		Total.SendCalls += Stats.SendCalls;
+		Total.PartialSends += Stats.PartialSends;
+		Total.WouldBlockCount += Stats.WouldBlockCount;
+		Total.ReplayedFrames += Stats.ReplayedFrames;
+		Total.BufferedBytes += Stats.BufferedBytes;
+		Total.HighWaterMark = FMath::Max(Total.HighWaterMark, Stats.HighWaterMark);
+		Total.Capacity += Stats.Capacity;
+	}
+	return Total;
+}
+
+bool FTCPLoggingSender::TickLink(FLink& Link, double Now)
+{
+	const bool bIsConnected = Link.Connection.Tick(Now);
+	if (bIsConnected && !Link.bWasConnected)
+	{
+		if (Link.OutageDroppedCount > 0)
+		{
+			UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Dropped (%d) analytics events while disconnected from the collector"),
+				Link.OutageDroppedCount);
+			Link.OutageDroppedCount = 0;
+		}
+		if (Settings.PayloadFormat == ETCPLoggingPayloadFormat::Binary)
+		{
+			// The new connection has to learn every string the retained frames may reference
+			RefreshPreamble(Link);
+		}
+		Link.AckBytesRead = 0;
+		Link.LastAckTime = Now;
+	}
+	Link.bWasConnected = bIsConnected;
+	return bIsConnected;
+}
+
+FTCPLoggingSender::FLink& FTCPLoggingSender::ChooseLink(uint64 Marker)
+{
+	if (Marker != 0 || Links.Num() == 1)
+	{
+		return *Links[0];
+	}
+
+	// Connected links first, the one with the least unsent bytes wins. While all are down the retention is spread evenly
+	FLink* Best = nullptr;
+	int32 BestBytes = 0;
+	for (const TUniquePtr<FLink>& Link : Links)
+	{
+		const int32 Bytes = Link->Writer.GetCapacity() - Link->Writer.GetFreeSpace();
+		const bool bBetter = Best == nullptr || (Link->bWasConnected && !Best->bWasConnected)
+			|| (Link->bWasConnected == Best->bWasConnected && Bytes < BestBytes);
+		if (bBetter)
+		{
+			Best = Link.Get();
+			BestBytes = Bytes;
+		}
+	}
+	return *Best;
+}
+
+uint32 FTCPLoggingSender::Run()
+{
+	while (!bStopping.load(std::memory_order_acquire))
+	{
+		const double TickTime = FPlatformTime::Seconds();
+		bool bIsConnected = false;
+		bool bIsConnecting = false;
+		for (const TUniquePtr<FLink>& Link : Links)
+		{
+			bIsConnected |= TickLink(*Link, TickTime);
+			bIsConnecting |= Link->Connection.IsConnecting();
+		}
+		bConnected.store(bIsConnected, std::memory_order_relaxed);
+		bConnecting.store(bIsConnecting, std::memory_order_relaxed);
+
+		const uint64 Request = FlushRequested.load(std::memory_order_acquire);
+		const bool bFlushRequested = Request != FlushCompleted.load(std::memory_order_relaxed);
+
+		// Batches keep forming while disconnected, they are retained in the socket writer until the connection is back
+		DrainStaging();
+
+		const double Now = FPlatformTime::Seconds();
+		if (bFlushRequested)
+		{
+			SendAllBatches();
+			SendDatagram();
+		}
+		else
+		{
+			SendBatchIfStale(Now);
+		}
+
+		if (!bIsConnected)
+		{
+			// Flushes wait for a connection on its way, with every collector backing off there is nothing to wait for
+			if (!bIsConnecting)
+			{
+				CompleteFlushRequests();
+			}
+			Staging.Sleep(GetWaitTimeMs(Now));
+			continue;
+		}
+
+		bool bLostAny = false;
+		FLink* Backlogged = nullptr;
+		for (const TUniquePtr<FLink>& Link : Links)
+		{
+			if (!Link->bWasConnected)
+			{
+				continue;
+			}
+			if (!PumpSocket(*Link, 0.0))
+			{
+				bLostAny = true;
+			}
+			else if ((Link->Writer.HasPending() || Link->Writer.HasUnacknowledged())
+					 && (Backlogged == nullptr || Link->Writer.GetFreeSpace() < Backlogged->Writer.GetFreeSpace()))
+			{
+				Backlogged = Link.Get();
+			}
+		}
+		if (bLostAny)
+		{
+			continue;
+		}
+
+		if (Backlogged != nullptr)
+		{
+			// A collector is applying backpressure, sleep until its socket can take more instead of on the wake event
+			PumpSocket(*Backlogged, WritableWaitSeconds);
+			continue;
+		}
+
+		if (bFlushRequested)
+		{
+			FlushCompleted.store(Request, std::memory_order_release);
+			FlushEvent->Trigger();
+		}
+
+		if (ReplaySpool())
+		{
+			continue;
+		}
+
+		bool bReconnecting = false;
+		for (const TUniquePtr<FLink>& Link : Links)
+		{
+			if (!Link->bWasConnected)
+			{
+				continue;
+			}
+			if (!IsPeerAlive(*Link))
+			{
+				HandleConnectionLost(*Link);
+				bReconnecting = true;
+			}
+			else if (Link->Connection.ShouldFailBack(Now))
+			{
+				// Only while idle, so nothing is replayed on the way back
+				Link->Connection.FailBack(Now);
+				Link->Writer.Rewind();
+				Link->bWasConnected = false;
+				bReconnecting = true;
+			}
+		}
+		if (bReconnecting)
+		{
+			continue;
+		}
+
+		Staging.WaitForMessages(GetWaitTimeMs(Now), [this]() {
+			return FlushRequested.load(std::memory_order_acquire) == FlushCompleted.load(std::memory_order_relaxed);
+		});
+	}
+
+	// Anything recorded before the session ended still goes out if there is somewhere to send it
+	DrainStaging();
+	SendAllBatches();
+	SendDatagram();
+	const double Deadline = FPlatformTime::Seconds() + Settings.ShutdownTimeoutSeconds;
+	for (const TUniquePtr<FLink>& Link : Links)
+	{
+		while (Link->Connection.IsConnected() && (Link->Writer.HasPending() || Link->Writer.HasUnacknowledged())
+			   && FPlatformTime::Seconds() < Deadline
+			   && PumpSocket(*Link, WritableWaitSeconds))
+		{
+		}
+	}
+	const int32 UnsentBytes = GetSocketStats().BufferedBytes;
+	if (UnsentBytes > 0)
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Discarding (%d) unsent analytics bytes at shutdown"), UnsentBytes);
+	}
+	CompleteFlushRequests();
+	return 0;
+}
+
+void FTCPLoggingSender::Stop()
+{
+	bStopping.store(true, std::memory_order_release);
+	Staging.Interrupt();
+}
+
+void FTCPLoggingSender::CompleteFlushRequests()
+{
+	FlushCompleted.store(FlushRequested.load(std::memory_order_acquire), std::memory_order_release);
+	FlushEvent->Trigger();
+}
+
+void FTCPLoggingSender::DrainStaging()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(TCPLogging_DrainStaging);
+	Staging.Collect(StagedChunks);
+
+	int32 StagedEvents = 0;
+	for (const FTCPLoggingStagedChunk& Chunk : StagedChunks)
+	{
+		StagedEvents += Chunk.MessageEnds.Num();
+	}
+	SET_DWORD_STAT(STAT_TCPLogging_StagedEvents, StagedEvents);
+	CSV_CUSTOM_STAT(TCPLogging, StagedEvents, StagedEvents, ECsvCustomStatOp::Set);
+
+	// Plain NDJSON goes on the wire as staged, so its batches are gathered rather than copied together
+	const bool bGather = !IsFramed();
+	for (FTCPLoggingStagedChunk& Chunk : StagedChunks)
+	{
+		const bool bCritical = Chunk.Lane == ETCPLoggingLane::Critical;
+		if (!bCritical)
+		{
+			// Critical chunks are collected first, their batch goes into the socket writer ahead of any bulk one
+			SendBatch(ETCPLoggingLane::Critical);
+		}
+
+		FBatch& Batch = Batches[(int32) Chunk.Lane];
+		bool bChunkInBatch = false;
+		int32 Start = 0;
+		for (const uint32 MessageEnd : Chunk.MessageEnds)
+		{
+			const int32 End = (int32) MessageEnd;
+			const int32 Offset = Start;
+			const uint8* Message = Chunk.Data.GetData() + Start;
+			int32 Count = End - Start;
+			Start = End;
+			const bool bEnveloped = SessionEnvelope.Num() > 0;
+			if (bEnveloped)
+			{
+				EnvelopedMessage.Reset();
+				if (Settings.PayloadFormat == ETCPLoggingPayloadFormat::Binary)
+				{
+					FTCPLoggingBinaryWriter::SpliceFields(EnvelopedMessage, Message, Count, SessionEnvelope);
+				}
+				else
+				{
+					FTCPLoggingJsonWriter::SpliceFields(EnvelopedMessage, Message, Count, SessionEnvelope);
+				}
+				Message = EnvelopedMessage.GetData();
+				Count = EnvelopedMessage.Num();
+			}
+
+			if (!bCritical && Datagrams.IsValid() && Count <= Datagrams->GetMaxMessageBytes())
+			{
+				AppendDatagram(Message, Count);
+				continue;
+			}
+
+			if (Batch.EventCount == 0)
+			{
+				Batch.StartTime = FPlatformTime::Seconds();
+				Batch.StagedCycles = Chunk.FirstStagedCycles;
+			}
+			if (!bGather)
+			{
+				Batch.Data.Append(Message, Count);
+			}
+			else if (bEnveloped)
+			{
+				Batch.Gather(nullptr, Batch.Data.Num(), Count);
+				Batch.Data.Append(Message, Count);
+			}
+			else
+			{
+				Batch.Gather(Chunk.Data.GetData(), Offset, Count);
+				bChunkInBatch = true;
+			}
+			Batch.Bytes += Count;
+			++Batch.EventCount;
+			if (bCritical && Spool.IsValid())
+			{
+				Spool->Append(Message, Count);
+			}
+
+			if (Batch.Bytes >= Settings.MaxBatchBytes || Batch.EventCount >= Settings.MaxBatchEvents)
+			{
+				SendBatch(Chunk.Lane);
+				bChunkInBatch = false;
+			}
+		}
+		if (bChunkInBatch)
+		{
+			// Moving the chunk leaves its data where the batch's slices point
+			Batch.Chunks.Add(MoveTemp(Chunk));
+		}
+		else
+		{
+			Staging.ReleaseChunk(MoveTemp(Chunk));
+		}
+	}
+	StagedChunks.Reset();
+
+	// Critical messages hit the disk right away rather than when their batch is written out
+	if (Spool.IsValid())
+	{
+		Spool->Flush();
+	}
+
+	// Critical batches never wait for more events to join them
+	SendBatch(ETCPLoggingLane::Critical);
+}
+
+void FTCPLoggingSender::SendBatchIfStale(double Now)
+{
+	for (int32 Lane = 0; Lane < TCPLoggingNumLanes; ++Lane)
+	{
+		if (Batches[Lane].EventCount > 0 && Now - Batches[Lane].StartTime >= Settings.MaxBatchLatencySeconds)
+		{
+			SendBatch((ETCPLoggingLane) Lane);
+		}
+	}
+	if (Datagrams.IsValid() && Datagrams->GetPendingEvents() > 0 && Now - DatagramStartTime >= Settings.MaxBatchLatencySeconds)
+	{
+		SendDatagram();
+	}
+}
+
+void FTCPLoggingSender::AppendDatagram(const uint8* Message, int32 Count)
+{
+	if (!Datagrams->CanAppend(Count))
+	{
+		SendDatagram();
+	}
+	if (Datagrams->GetPendingEvents() == 0)
+	{
+		DatagramStartTime = FPlatformTime::Seconds();
+	}
+	Datagrams->Append(Message, Count);
+}
+
+void FTCPLoggingSender::SendDatagram()
+{
+	if (!Datagrams.IsValid() || Datagrams->GetPendingEvents() == 0)
+	{
+		return;
+	}
+
+	const FInternetAddr* Destination = nullptr;
+	for (const TUniquePtr<FLink>& Link : Links)
+	{
+		Destination = Link->Connection.GetPeerAddress();
+		if (Destination != nullptr)
+		{
+			break;
+		}
+	}
+
+	const int32 EventCount = Datagrams->GetPendingEvents();
+	bool bSent = false;
+	if (Destination != nullptr)
+	{
+		bSent = Datagrams->Send(*Destination);
+	}
+	else
+	{
+		Datagrams->Discard();
+	}
+	if (!bSent)
+	{
+		// Best effort by design, not counted against the retention buffer
+		INC_DWORD_STAT_BY(STAT_TCPLogging_EventsDropped, EventCount);
+		CSV_CUSTOM_STAT(TCPLogging, EventsDropped, EventCount, ECsvCustomStatOp::Accumulate);
+	}
+}
+
+void FTCPLoggingSender::SendBatch(ETCPLoggingLane Lane)
+{
+	FBatch& Batch = Batches[(int32) Lane];
+	if (Batch.EventCount == 0)
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_TCPLogging_SendBatch);
+	TRACE_CPUPROFILER_EVENT_SCOPE(TCPLogging_SendBatch);
+	// Only critical messages are spooled
+	const uint64 Marker = Lane == ETCPLoggingLane::Critical && Spool.IsValid() ? Spool->TakeMarker() : 0;
+	FLink& Link = ChooseLink(Marker);
+	FTCPLoggingSocketWriter& Writer = Link.Writer;
+	FOutgoingFrame Frame;
+	if (Batch.Slices.Num() > 0)
+	{
+		GatheredSlices.Reset();
+		for (const FBatchSlice& Slice : Batch.Slices)
+		{
+			const uint8* Base = Slice.Base != nullptr ? Slice.Base : Batch.Data.GetData();
+			GatheredSlices.Add(FTCPLoggingIoSlice{Base + Slice.Offset, Slice.Count});
+		}
+		Frame.Gathered = GatheredSlices;
+		Frame.Bytes = Batch.Bytes;
+	}
+	else
+	{
+		Frame = FOutgoingFrame::FromEncoded(EncodeForWire(Link, Batch.Data));
+	}
+	if (Frame.Bytes > Writer.GetCapacity())
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Dropped batch of (%d) analytics events, (%d) bytes exceed the send buffer"),
+			Batch.EventCount, Frame.Bytes);
+		CountDroppedEvents(Lane, Batch.EventCount);
+		RetainSpooledFrame(Marker);
+		Link.bResendDictionary |= Link.Connection.IsConnected();
+	}
+	else if (Lane == ETCPLoggingLane::Bulk)
+	{
+		AppendBulkFrame(Link, Frame, Batch.EventCount, Batch.StagedCycles);
+	}
+	else
+	{
+		const double Deadline = FPlatformTime::Seconds() + Settings.ShutdownTimeoutSeconds;
+		while (!AppendFrame(Link, Frame, Batch.EventCount, Lane, Marker, Batch.StagedCycles))
+		{
+			// While connected, wait for the collector to drain some of the ring buffer
+			const bool bGaveUp = bStopping.load(std::memory_order_relaxed) && FPlatformTime::Seconds() >= Deadline;
+			if (!bGaveUp && PumpSocket(Link, WritableWaitSeconds))
+			{
+				continue;
+			}
+
+			// Disconnected, make room by discarding the oldest retained batch so the newest events survive the outage.
+			// Bulk batches go first, a critical one only once no bulk one is left
+			ETCPLoggingLane DroppedLane = ETCPLoggingLane::Bulk;
+			uint64 DroppedMarker = 0;
+			int32 DroppedEvents = Writer.DropOldestFrame(DroppedLane, DroppedMarker);
+			if (DroppedEvents == INDEX_NONE)
+			{
+				DroppedLane = ETCPLoggingLane::Critical;
+				DroppedEvents = Writer.DropOldestFrame(DroppedLane, DroppedMarker);
+			}
+			if (DroppedEvents == INDEX_NONE)
+			{
+				UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Dropped batch of (%d) analytics events, send buffer is full"),
+					Batch.EventCount);
+				CountDroppedEvents(Lane, Batch.EventCount);
+				Link.OutageDroppedCount += Batch.EventCount;
+				RetainSpooledFrame(Marker);
+				break;
+			}
+			RetainSpooledFrame(DroppedMarker);
+			// A discarded frame may have defined strings later frames on this connection refer to
+			Link.bResendDictionary |= Link.Connection.IsConnected();
+			CountDroppedEvents(DroppedLane, DroppedEvents);
+			Link.OutageDroppedCount += DroppedEvents;
+		}
+	}
+
+	// Keep the allocations around for the next batch
+	Batch.Data.Reset();
+	Batch.Slices.Reset();
+	for (FTCPLoggingStagedChunk& Chunk : Batch.Chunks)
+	{
+		Staging.ReleaseChunk(MoveTemp(Chunk));
+	}
+	Batch.Chunks.Reset();
+	Batch.Bytes = 0;
+	Batch.EventCount = 0;
+}
+
+void FTCPLoggingSender::SendAllBatches()
+{
+	SendBatch(ETCPLoggingLane::Critical);
+	SendBatch(ETCPLoggingLane::Bulk);
+}
+
+void FTCPLoggingSender::AppendBulkFrame(FLink& Link, const FOutgoingFrame& Frame, int32 EventCount, uint64 StagedCycles)
+{
+	FTCPLoggingSocketWriter& Writer = Link.Writer;
+	const int32 BulkCapacity = Writer.GetCapacity() - FMath::Min(Settings.CriticalSendBufferBytes, Writer.GetCapacity() / 2);
+	const auto Fits = [&Writer, &Frame, BulkCapacity]() {
+		return Writer.GetBufferedBytes(ETCPLoggingLane::Bulk) + Frame.Bytes <= BulkCapacity
+			&& Frame.Bytes <= Writer.GetFreeSpace();
+	};
+
+	while (!Fits())
+	{
+		// Frames queued behind the oldest one may refer to strings it defines, so a live connection only sheds the new one.
+		// A new connection starts from a dictionary snapshot, so while disconnected the oldest bulk frames go instead
+		int32 DroppedEvents = INDEX_NONE;
+		uint64 DroppedMarker = 0;
+		if (!Link.Connection.IsConnected())
+		{
+			DroppedEvents = Writer.DropOldestFrame(ETCPLoggingLane::Bulk, DroppedMarker);
+		}
+		if (DroppedEvents == INDEX_NONE)
+		{
+			UE_LOG(LogTCPLoggingAnalytics, Verbose, TEXT("Shed batch of (%d) bulk analytics events, send buffer is backed up"),
+				EventCount);
+			CountDroppedEvents(ETCPLoggingLane::Bulk, EventCount);
+			if (Link.Connection.IsConnected())
+			{
+				// The shed frame may have defined strings the next one refers to
+				Link.bResendDictionary = true;
+			}
+			else
+			{
+				Link.OutageDroppedCount += EventCount;
+			}
+			return;
+		}
+		CountDroppedEvents(ETCPLoggingLane::Bulk, DroppedEvents);
+		Link.OutageDroppedCount += DroppedEvents;
+	}
+	AppendFrame(Link, Frame, EventCount, ETCPLoggingLane::Bulk, 0, StagedCycles);
+}
+
+bool FTCPLoggingSender::AppendFrame(
+	FLink& Link, const FOutgoingFrame& Frame, int32 EventCount, ETCPLoggingLane Lane, uint64 Marker, uint64 StagedCycles)
+{
+	uint64 Sequence = 0;
+	if (Settings.bAcknowledge)
+	{
+		// Numbered as it enters the ring rather than when encoded, so sequences follow the order frames go out in
+		check(Frame.Encoded != nullptr);
+		Sequence = NextSequence;
+		Encoder.StampSequence(*Frame.Encoded, Sequence);
+		if (!Link.Writer.HasUnacknowledged())
+		{
+			Link.LastAckTime = FPlatformTime::Seconds();
+		}
+	}
+	FTCPLoggingIoSlice Whole{nullptr, 0};
+	TArrayView<const FTCPLoggingIoSlice> Slices = Frame.Gathered;
+	if (Frame.Encoded != nullptr)
+	{
+		Whole = FTCPLoggingIoSlice{Frame.Encoded->GetData(), Frame.Encoded->Num()};
+		Slices = MakeArrayView(&Whole, 1);
+	}
+	if (!Link.Writer.AppendFrame(Slices, EventCount, Lane, Marker, StagedCycles, Sequence))
+	{
+		return false;
+	}
+	NextSequence += Sequence != 0 ? 1 : 0;
+	return true;
+}
+
+bool FTCPLoggingSender::IsFramed() const
+{
+	return Settings.Compression != ETCPLoggingCompression::None || Settings.PayloadFormat == ETCPLoggingPayloadFormat::Binary
+		|| Settings.bAcknowledge;
+}
+
+TArray<uint8>& FTCPLoggingSender::EncodeForWire(FLink& Link, TArray<uint8>& Data)
+{
+	if (!IsFramed())
+	{
+		return Data;
+	}
+
+	const TArray<uint8>* Payload = &Data;
+	if (Settings.PayloadFormat == ETCPLoggingPayloadFormat::Binary)
+	{
+		BinaryScratch.Reset();
+		if (Link.bResendDictionary)
+		{
+			Link.BinaryEncoder.WriteDictionary(BinaryScratch);
+			Link.bResendDictionary = false;
+		}
+		if (!Link.BinaryEncoder.Encode(Data.GetData(), Data.Num(), BinaryScratch))
+		{
+			// Only possible if a writer produced a broken record, sending it would desynchronize the collector
+			UE_LOG(LogTCPLoggingAnalytics, Error, TEXT("Discarding (%d) bytes of malformed binary analytics records"), Data.Num());
+			BinaryScratch.Reset();
+			Link.bResendDictionary = true;
+		}
+		Payload = &BinaryScratch;
+	}
+
+	EncodedFrame.Reset();
+	Encoder.EncodeFrame(Payload->GetData(), Payload->Num(), EncodedFrame);
+	return EncodedFrame;
+}
+
+void FTCPLoggingSender::RefreshPreamble(FLink& Link)
+{
+	if (!IsFramed())
+	{
+		Link.Writer.SetPreamble(CopyTemp(SessionPreamble));
+		return;
+	}
+
+	// The stream header tells the collector which codec and payload format follow, it is repeated on every connection
+	TArray<uint8> WirePreamble;
+	Encoder.WriteStreamHeader(WirePreamble);
+	if (Settings.PayloadFormat == ETCPLoggingPayloadFormat::Binary)
+	{
+		BinaryScratch.Reset();
+		Link.BinaryEncoder.WriteDictionary(BinaryScratch);
+		Link.BinaryEncoder.Encode(SessionPreamble.GetData(), SessionPreamble.Num(), BinaryScratch);
+		Encoder.EncodeFrame(BinaryScratch.GetData(), BinaryScratch.Num(), WirePreamble);
+		// The snapshot covers everything defined so far
+		Link.bResendDictionary = false;
+	}
+	else
+	{
+		Encoder.EncodeFrame(SessionPreamble.GetData(), SessionPreamble.Num(), WirePreamble);
+	}
+	Link.Writer.SetPreamble(MoveTemp(WirePreamble));
+}
+
+bool FTCPLoggingSender::PumpSocket(FLink& Link, double WaitSeconds)
+{
+	FSocket* Socket = Link.Connection.GetSocket();
+	if (Socket == nullptr)
+	{
+		return false;
+	}
+
+	if (Settings.bAcknowledge && !ReadAcks(Link, *Socket))
+	{
+		return false;
+	}
+
+	const ETCPLoggingSendResult Result =
+		WaitSeconds > 0.0 ? Link.Writer.WaitAndSend(*Socket, WaitSeconds) : Link.Writer.Send(*Socket);
+	CommitSpooledFrames(Link);
+	SET_DWORD_STAT(STAT_TCPLogging_BufferedBytes, GetSocketStats().BufferedBytes);
+	if (Result == ETCPLoggingSendResult::Error)
+	{
+		HandleConnectionLost(Link);
+		return false;
+	}
+	return true;
+}
+
+bool FTCPLoggingSender::ReadAcks(FLink& Link, FSocket& Socket)
+{
+	uint64 Acked = 0;
+	// Only read once the socket is readable: a read that then returns nothing, whether Recv reports it as success or
+	// as a failure with a stale error code, is the collector closing the connection and not an empty receive buffer
+	while (Socket.Wait(ESocketWaitConditions::WaitForRead, FTimespan::Zero()))
+	{
+		int32 BytesRead = 0;
+		if (!Socket.Recv(Link.AckBytes + Link.AckBytesRead, TCPLoggingWireFormat::AckSize - Link.AckBytesRead, BytesRead)
+			|| BytesRead == 0)
+		{
+			UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Analytics collector connection lost while reading acks"));
+			HandleConnectionLost(Link);
+			return false;
+		}
+		Link.AckBytesRead += BytesRead;
+		if (Link.AckBytesRead == TCPLoggingWireFormat::AckSize)
+		{
+			Acked = 0;
+			for (int32 Byte = 0; Byte < TCPLoggingWireFormat::AckSize; ++Byte)
+			{
+				Acked |= (uint64) Link.AckBytes[Byte] << (Byte * 8);
+			}
+			Link.AckBytesRead = 0;
+		}
+	}
+
+	const double Now = FPlatformTime::Seconds();
+	if (Acked != 0)
+	{
+		// Acks are cumulative, only the latest one read matters
+		Link.Writer.Acknowledge(Acked);
+		Link.LastAckTime = Now;
+		CommitSpooledFrames(Link);
+	}
+	else if (Link.Writer.HasUnacknowledged() && Now - Link.LastAckTime > Settings.AckTimeoutSeconds)
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Analytics collector sent no ack for %.1f seconds, reconnecting"),
+			Now - Link.LastAckTime);
+		HandleConnectionLost(Link);
+		return false;
+	}
+	return true;
+}
+
+void FTCPLoggingSender::CountDroppedEvents(ETCPLoggingLane Lane, int32 EventCount)
+{
+	RetentionDroppedCounts[(int32) Lane].fetch_add(EventCount, std::memory_order_relaxed);
+	INC_DWORD_STAT_BY(STAT_TCPLogging_EventsDropped, EventCount);
+	CSV_CUSTOM_STAT(TCPLogging, EventsDropped, EventCount, ECsvCustomStatOp::Accumulate);
+	if (Lane == ETCPLoggingLane::Critical)
+	{
+		INC_DWORD_STAT_BY(STAT_TCPLogging_CriticalEventsDropped, EventCount);
+		CSV_CUSTOM_STAT(TCPLogging, CriticalEventsDropped, EventCount, ECsvCustomStatOp::Accumulate);
+	}
+}
+
+void FTCPLoggingSender::CommitSpooledFrames(FLink& Link)
+{
+	if (Spool.IsValid())
+	{
+		Link.Writer.ConsumeSentMarkers([this](uint64 Marker) { Spool->Commit(Marker); });
+	}
+}
+
+void FTCPLoggingSender::RetainSpooledFrame(uint64 Marker)
+{
+	if (Spool.IsValid() && Marker != 0)
+	{
+		Spool->Retain(Marker);
+	}
+}
+
+bool FTCPLoggingSender::ReplaySpool()
+{
+	// Replayed frames carry spool markers, so like every marked frame they take the first link
+	FLink& Link = *Links[0];
+	if (!Spool.IsValid() || !Link.bWasConnected)
+	{
+		return false;
+	}
+
+	if (ReplayChunk.Num() == 0)
+	{
+		if (!Spool->ReadReplayChunk(Settings.MaxBatchBytes, ReplayChunk, ReplayMarker))
+		{
+			return false;
+		}
+		if (IsFramed())
+		{
+			ReplayChunk = EncodeForWire(Link, ReplayChunk);
+		}
+	}
+
+	if (ReplayChunk.Num() > Link.Writer.GetCapacity())
+	{
+		// A single message larger than the whole send buffer can never go out, let the spool forget it
+		UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Skipping (%d) byte spooled analytics message"), ReplayChunk.Num());
+		Spool->Commit(ReplayMarker);
+	}
+	else if (!AppendFrame(Link, FOutgoingFrame::FromEncoded(ReplayChunk), 0, ETCPLoggingLane::Critical, ReplayMarker, 0))
+	{
+		return false;
+	}
+	ReplayChunk.Reset();
+	return true;
+}
+
+void FTCPLoggingSender::HandleConnectionLost(FLink& Link)
+{
+	Link.Writer.Rewind();
+	UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Retaining (%d) buffered analytics bytes for replay after reconnecting"),
+		Link.Writer.GetStats().BufferedBytes);
+
+	Link.Connection.Disconnect(FPlatformTime::Seconds());
+	Link.bWasConnected = false;
+}
+
+bool FTCPLoggingSender::IsPeerAlive(FLink& Link)
+{
+	FSocket* Socket = Link.Connection.GetSocket();
+	if (Socket == nullptr)
+	{
+		return false;
+	}
+
+	// Non-blocking peek: fails on an orderly close or a reset, succeeds with nothing read while the connection is healthy
+	uint8 Byte = 0;
+	int32 BytesRead = 0;
+	return Socket->Recv(&Byte, 1, BytesRead, ESocketReceiveFlags::Peek);
+}
+
+uint32 FTCPLoggingSender::GetWaitTimeMs(double Now) const
+{
+	double Remaining = SenderIdleWaitMs / 1000.0;
+	for (const FBatch& Batch : Batches)
+	{
+		if (Batch.EventCount > 0)
+		{
+			Remaining = FMath::Min(Remaining, Batch.StartTime + Settings.MaxBatchLatencySeconds - Now);
+		}
+	}
+	if (Datagrams.IsValid() && Datagrams->GetPendingEvents() > 0)
+	{
+		Remaining = FMath::Min(Remaining, DatagramStartTime + Settings.MaxBatchLatencySeconds - Now);
+	}
+	for (const TUniquePtr<FLink>& Link : Links)
+	{
+		if (!Link->bWasConnected)
+		{
+			Remaining = FMath::Min(Remaining, Link->Connection.GetPollDelay(Now));
+		}
+	}
+	return (uint32) FMath::Clamp(Remaining * 1000.0, 1.0, (double) SenderIdleWaitMs);
+}
@@ -0,0 +1,298 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "TCPLoggingEndpoints.h"
+#include "TCPLoggingIoSlice.h"
+#include "TCPLoggingSenderSettings.h"
+#include "TCPLoggingSocketWriter.h"
+#include "TCPLoggingStaging.h"
+#include "Templates/UniquePtr.h"
+
+#include <atomic>
+
+class FEvent;
+class FRunnableThread;
+class FSocket;
+class FTCPLoggingDatagramWriter;
+class FTCPLoggingSpool;
+
+enum class ETCPLoggingFlushResult : uint8
+{
+	Flushed,
+	TimedOut,
+	/** No connection was up, nor on its way, to flush to */
+	NotConnected,
+};
+
+/**
+ * Background thread that owns all socket I/O for the provider.
+ * Record* calls only serialize into the staging buffer of their thread and this thread collects them for the socket,
+ * so no network syscall ever happens on the recording thread. Resolving and connecting also happen here, messages
+ * recorded before the connection is up simply wait in staging.
+ *
+ * A lost connection is detected from failed sends or from the peer closing it while idle. The sender then reconnects
+ * with backoff while batches keep accumulating in the socket writer's ring buffer, oldest dropped first once it is
+ * full, and on reconnect the preamble and every unfinished batch are replayed in order.
+ *
+ * With the spool enabled, critical messages are also appended to disk as they are batched and only deleted once sent,
+ * so they survive a crash or an outage longer than the ring buffer can cover. Spooled messages an earlier run never
+ * sent are replayed whenever the connection is otherwise idle.
+ *
+ * With several collectors configured the session is hashed onto one of them and fails over along the ring, or with
+ * LeastOutstandingBytes the sender keeps a few connections and writes each batch to the least backed up one. Every
+ * connection has its own send buffer and, in binary mode, its own string dictionary. Frames carrying spooled messages
+ * always take the first connection so the spool sees them committed in order.
+ *
+ * Plain NDJSON batches are not copied together: they are gathered from the staged chunks the messages were serialized
+ * into, which the batch holds on to until it is in the socket writer, and copied straight into the writer's ring.
+ * Framed batches are concatenated for the encoder.
+ *
+ * Critical and bulk messages are batched separately. Critical batches are written as soon as they are collected and
+ * ahead of bulk ones, and bulk frames may only fill the send buffer up to a reserve kept for critical ones. Bulk frames
+ * never make the sender wait for the collector: past their share the new batch is shed while connected, and the oldest
+ * bulk frames while disconnected.
+ *
+ * With the udp transport, bulk events skip the batches and go out packed into datagrams instead, to
+ * the collector the first connected link goes to. They are dropped while no link is connected.
+ *
+ * A non-empty envelope holds fields serialized once for the whole session, they are spliced into every message as it
+ * is batched so each one names its session and user without the recording thread writing them.
+ */
+class FTCPLoggingSender : public FRunnable
+{
+public:
+	/**
+	 * Preamble is written at the start of every connection, ahead of any recorded message.
+	 * SessionKey picks the session's place on the endpoint ring. Envelope comes from SerializeFields of the writer
+	 * matching the payload format, or is empty.
+	 */
+	FTCPLoggingSender(TArray<FTCPLoggingEndpoint>&& InEndpoints, const FString& SessionKey, TArray<uint8>&& Preamble,
+		TArray<uint8>&& Envelope, FTCPLoggingStaging& InStaging, const FTCPLoggingSenderSettings& InSettings);
+	virtual ~FTCPLoggingSender();
+
+	/**
+	 * Blocks until everything staged before the call has been written to the socket, and acked if acks are on, or the
+	 * timeout expires. A connection that is still being set up is waited for within the same timeout, the call only
+	 * returns right away if every collector is backing off.
+	 */
+	ETCPLoggingFlushResult Flush(double TimeoutSeconds);
+
+	/** True while at least one collector connection is established */
+	bool IsConnected() const
+	{
+		return bConnected.load(std::memory_order_relaxed);
+	}
+
+	/** Ring buffer and send counters summed over every connection, the high water mark is the highest. Safe to call from any thread */
+	FTCPLoggingSocketWriterStats GetSocketStats() const;
+
+	/** Number of messages discarded for lack of send buffer, while disconnected or shed as bulk */
+	uint64 GetRetentionDroppedCount() const
+	{
+		return GetRetentionDroppedCount(ETCPLoggingLane::Critical) + GetRetentionDroppedCount(ETCPLoggingLane::Bulk);
+	}
+
+	uint64 GetRetentionDroppedCount(ETCPLoggingLane Lane) const
+	{
+		return RetentionDroppedCounts[(int32) Lane].load(std::memory_order_relaxed);
+	}
+
+	// FRunnable interface
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+	struct FLink;
+
+	/** A frame on its way into a socket writer */
+	struct FOutgoingFrame
+	{
+		/** Frame encoded into one buffer, sequenced frames get their number stamped into it. Null if gathered */
+		TArray<uint8>* Encoded = nullptr;
+		/** Pieces of a gathered frame, in order */
+		TArrayView<const FTCPLoggingIoSlice> Gathered;
+		int32 Bytes = 0;
+
+		static FOutgoingFrame FromEncoded(TArray<uint8>& Frame)
+		{
+			FOutgoingFrame Outgoing;
+			Outgoing.Encoded = &Frame;
+			Outgoing.Bytes = Frame.Num();
+			return Outgoing;
+		}
+	};
+
+	/** Advances the link's connection, preparing it for replay when it has just come up. Returns true if connected */
+	bool TickLink(FLink& Link, double Now);
+
+	/** Link the next batch goes to, frames with a spool marker always take the first one */
+	FLink& ChooseLink(uint64 Marker);
+
+	/** Moves staged messages into the batch of their lane, writing a batch out whenever a threshold is hit */
+	void DrainStaging();
+
+	/** Writes the batches and datagram that have been waiting longer than the latency threshold */
+	void SendBatchIfStale(double Now);
+
+	/** Adds a message to the pending datagram, sending that first if the message does not fit */
+	void AppendDatagram(const uint8* Message, int32 Count);
+
+	/** Sends the pending datagram, or drops it if no collector is connected */
+	void SendDatagram();
+
+	/** Moves the lane's batch into the socket writer and starts a new one */
+	void SendBatch(ETCPLoggingLane Lane);
+
+	/** Writes out every batch, critical first */
+	void SendAllBatches();
+
+	/** Appends a bulk frame within the bulk share of the link's send buffer, shedding frames rather than waiting */
+	void AppendBulkFrame(FLink& Link, const FOutgoingFrame& Frame, int32 EventCount, uint64 StagedCycles);
+
+	/** Appends a frame to the link's socket writer, numbering it first when acks are on. False if it did not fit */
+	bool AppendFrame(
+		FLink& Link, const FOutgoingFrame& Frame, int32 EventCount, ETCPLoggingLane Lane, uint64 Marker, uint64 StagedCycles);
+
+	/** True when the connection carries the framed format rather than plain NDJSON */
+	bool IsFramed() const;
+
+	/**
+	 * Data as it goes on the wire to Link: itself for plain NDJSON, otherwise one frame encoded into EncodedFrame.
+	 * Binary records have their strings interned in the link's dictionary on the way.
+	 */
+	TArray<uint8>& EncodeForWire(FLink& Link, TArray<uint8>& Data);
+
+	/** Rebuilds what the socket writer sends first on a connection, including the dictionary snapshot in binary mode */
+	void RefreshPreamble(FLink& Link);
+
+	/**
+	 * Hands the link's buffered bytes to its socket, waiting up to WaitSeconds for it to become writable.
+	 * Returns false if there is no connection or it was lost.
+	 */
+	bool PumpSocket(FLink& Link, double WaitSeconds);
+
+	/**
+	 * Reads whatever acks the collector sent without blocking and releases the frames they cover. Drops the connection
+	 * and returns false if it was lost, or if frames have waited longer than the ack timeout.
+	 */
+	bool ReadAcks(FLink& Link, FSocket& Socket);
+
+	/** Drops the connection and rewinds the socket writer so unfinished batches are replayed on the next one */
+	void HandleConnectionLost(FLink& Link);
+
+	/** Counts events discarded for lack of buffer space, in the lane's retention counter and the stats */
+	void CountDroppedEvents(ETCPLoggingLane Lane, int32 EventCount);
+
+	/** Reports frames that went out to the spool so it can delete what the collector has */
+	void CommitSpooledFrames(FLink& Link);
+
+	/** Marks the spooled messages of a dropped frame as still needed */
+	void RetainSpooledFrame(uint64 Marker);
+
+	/** Appends the next chunk of spooled messages from an earlier run. Returns false if there was nothing to append */
+	bool ReplaySpool();
+
+	/** Peeks at the idle socket to notice the collector closing the connection before the next send does */
+	bool IsPeerAlive(FLink& Link);
+
+	/** How long the sender may sleep before the current batch goes stale or a disconnected link may retry */
+	uint32 GetWaitTimeMs(double Now) const;
+
+	/** Marks every outstanding flush request as done */
+	void CompleteFlushRequests();
+
+	/** Where recording threads leave their messages, owned by the provider and outliving the sender */
+	FTCPLoggingStaging& Staging;
+	const FTCPLoggingSenderSettings Settings;
+
+	/** Collectors and their health, shared by every link */
+	FTCPLoggingEndpointSet Endpoints;
+	/** One per connection, fixed for the sender's lifetime. Only the sender thread touches them besides their stats */
+	TArray<TUniquePtr<FLink>> Links;
+	std::atomic<bool> bConnected;
+	/** True while any link is resolving or connecting, and before the first attempt has started */
+	std::atomic<bool> bConnecting;
+	FTCPLoggingFrameEncoder Encoder;
+	/** Scratch space for compressed frames, reused for every batch */
+	TArray<uint8> EncodedFrame;
+	/** Session start message as serialized by the provider, before any wire encoding */
+	TArray<uint8> SessionPreamble;
+	/** Fields spliced into every recorded message, see the class comment */
+	TArray<uint8> SessionEnvelope;
+	/** Scratch space for one message with the envelope spliced in */
+	TArray<uint8> EnvelopedMessage;
+
+	/** Scratch space for binary records, reused for every batch */
+	TArray<uint8> BinaryScratch;
+
+	/** Chunks taken from staging, kept around so collecting does not allocate */
+	TArray<FTCPLoggingStagedChunk> StagedChunks;
+
+	/** Null unless the disk spool is enabled, only touched by the sender thread */
+	TUniquePtr<FTCPLoggingSpool> Spool;
+	/** Replay chunk read from the spool that did not fit in the socket writer yet */
+	TArray<uint8> ReplayChunk;
+	uint64 ReplayMarker;
+
+	/** A message, or a run of adjacent ones, of a gathered batch. Base is the chunk it is in, or null for Data */
+	struct FBatchSlice
+	{
+		const uint8* Base;
+		int32 Offset;
+		int32 Count;
+	};
+
+	/** Messages of one lane accumulated for the next socket write, only touched by the sender thread */
+	struct FBatch
+	{
+		/** Every message of a framed batch, and the enveloped ones of a gathered batch */
+		TArray<uint8> Data;
+		/** Messages of a gathered batch in order */
+		TArray<FBatchSlice> Slices;
+		/** Staged chunks Slices point into, handed back to staging once the batch is in the socket writer */
+		TArray<FTCPLoggingStagedChunk> Chunks;
+		int32 Bytes = 0;
+		int32 EventCount = 0;
+		/** Time the first message was picked up */
+		double StartTime = 0.0;
+		/** When the first message was staged by its recording thread */
+		uint64 StagedCycles = 0;
+
+		/** Adds a message to the gathered ones, extending the last slice if the message directly follows it */
+		void Gather(const uint8* Base, int32 Offset, int32 Count)
+		{
+			if (Slices.Num() > 0 && Slices.Last().Base == Base && Slices.Last().Offset + Slices.Last().Count == Offset)
+			{
+				Slices.Last().Count += Count;
+			}
+			else
+			{
+				Slices.Add(FBatchSlice{Base, Offset, Count});
+			}
+		}
+	};
+	FBatch Batches[TCPLoggingNumLanes];
+	/** Scratch space for the slices of a gathered batch, reused for every batch */
+	TArray<FTCPLoggingIoSlice> GatheredSlices;
+
+	/** Null unless the udp transport is enabled */
+	TUniquePtr<FTCPLoggingDatagramWriter> Datagrams;
+	/** Time the first message of the pending datagram was picked up */
+	double DatagramStartTime;
+
+	/** Sequence the next frame gets when acks are on. Counts across links, so it is unique for the whole session */
+	uint64 NextSequence;
+
+	std::atomic<bool> bStopping;
+	std::atomic<uint64> RetentionDroppedCounts[TCPLoggingNumLanes];
+
+	/** Flush requests are numbered, the sender publishes the last request number it fully wrote out */
+	std::atomic<uint64> FlushRequested;
+	std::atomic<uint64> FlushCompleted;
+	FEvent* FlushEvent;
+
+	FRunnableThread* Thread;
+};
@@ -0,0 +1,93 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TCPLoggingCompression.h"
+#include "TCPLoggingDatagram.h"
+#include "TCPLoggingEndpoints.h"
+#include "TCPLoggingStaging.h"
+
+/** Tunables for how the sender connects and groups queued messages into socket writes */
+struct FTCPLoggingSenderSettings
+{
+	/** Recording threads hand their messages to the sender in chunks of about this many bytes */
+	int32 StagingChunkBytes = 4 * 1024;
+	/** A thread with this many bytes waiting for the sender drops new events until the sender catches up */
+	int32 MaxStagedBytesPerThread = 1024 * 1024;
+	/** The same for critical events, which only other critical events of the thread count against */
+	int32 MaxCriticalStagedBytesPerThread = 1024 * 1024;
+	/**
+	 * Memory every thread's staged events may take together, preallocated as a slab of staging chunks when the provider
+	 * is created so recording never allocates. Zero leaves it unbounded, chunks are then allocated as needed
+	 */
+	int32 StagingBudgetBytes = 0;
+	/** What gives way once the staging budget is used up */
+	ETCPLoggingOverflowPolicy OverflowPolicy = ETCPLoggingOverflowPolicy::DropNewest;
+	/** Longest the Block policy holds up a recording thread */
+	double OverflowBlockSeconds = 0.005;
+	/** A batch is written once it holds at least this many bytes */
+	int32 MaxBatchBytes = 16 * 1024;
+	/** A batch is written once it holds this many events */
+	int32 MaxBatchEvents = 256;
+	/** A batch is never held back longer than this after its first event arrived */
+	double MaxBatchLatencySeconds = 0.25;
+
+	/**
+	 * Size of the ring buffer between batches and the socket. Batches wait for space when the collector falls behind,
+	 * and it also retains batches while disconnected, dropping the oldest once full
+	 */
+	int32 SendBufferBytes = 256 * 1024;
+	/**
+	 * Part of the send buffer bulk frames may never fill, so critical ones always find room behind at most this much
+	 * bulk data. Capped at half the send buffer
+	 */
+	int32 CriticalSendBufferBytes = 64 * 1024;
+	/**
+	 * Number every frame and keep it until the collector acknowledged it, rather than until the kernel took it, so a
+	 * lost connection replays exactly what may not have been committed. Switches to the framed format
+	 */
+	bool bAcknowledge = false;
+	/** Frames that may wait for an ack at once, the next one is held back until the oldest is acknowledged */
+	int32 AckWindowFrames = 32;
+	/** A connection whose oldest unacknowledged frame waits this long for an ack is treated as lost */
+	double AckTimeoutSeconds = 10.0;
+	/** Codec for batches on the wire, anything but None switches to the framed format in TCPLoggingCompression.h */
+	ETCPLoggingCompression Compression = ETCPLoggingCompression::None;
+	/** Encoding of events, also decides which writer the provider serializes with. Binary is always framed */
+	ETCPLoggingPayloadFormat PayloadFormat = ETCPLoggingPayloadFormat::Json;
+	/** Udp sends bulk events as datagrams to the collector the TCP connection goes to */
+	ETCPLoggingTransport Transport = ETCPLoggingTransport::Tcp;
+	/** Every event carries sessionId, deviceId and userId, serialized once per session and spliced in by the sender */
+	bool bSessionEnvelope = false;
+	/** Largest datagram of the udp transport, kept below common path MTUs so nothing is fragmented */
+	int32 MaxDatagramBytes = 1200;
+	/** How long ending a session may keep writing already recorded events to a slow collector */
+	double ShutdownTimeoutSeconds = 2.0;
+
+	/** Collectors to spread sessions over, the provider's Host and Port are the only one when this is empty */
+	TArray<FTCPLoggingEndpoint> Endpoints;
+	/** How batches are spread when there are several endpoints */
+	ETCPLoggingBalancing Balancing = ETCPLoggingBalancing::ConsistentHash;
+	/** Connections a sender keeps with LeastOutstandingBytes, each to a different endpoint and with a send buffer of its own */
+	int32 MaxConnections = 2;
+
+	/** Give up on a host name lookup or connection attempt that has not completed after this long */
+	double ConnectTimeoutSeconds = 5.0;
+	/**
+	 * Delay before the first retry after a failed resolve or connect, doubled on every consecutive failure.
+	 * With several endpoints it is also the cooldown of a failed endpoint, and a connection only backs off once all are down
+	 */
+	double ReconnectBaseDelaySeconds = 0.5;
+	/** Upper bound on the retry delay */
+	double ReconnectMaxDelaySeconds = 30.0;
+	/** How long a resolved collector address is reused before resolving the host name again */
+	double HostCacheSeconds = 300.0;
+
+	/** Write critical messages to disk until the collector has received them, and replay what an earlier run left behind */
+	bool bSpoolEnabled = false;
+	/** Where spool segments live, every process sharing a directory replays the others' segments */
+	FString SpoolDirectory;
+	/** Disk budget for the spool, the oldest segments are evicted beyond it */
+	int64 SpoolMaxBytes = 64 * 1024 * 1024;
+};
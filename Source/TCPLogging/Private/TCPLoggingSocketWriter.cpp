@@ -0,0 +1,370 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "TCPLoggingSocketWriter.h"
+
+#include "Misc/Timespan.h"
+#include "SocketSubsystem.h"
+#include "Sockets.h"
+#include "HAL/PlatformTime.h"
+#include "TCPLoggingLog.h"
+#include "TCPLoggingStats.h"
+
+#if TCPLOGGING_VECTORED_SEND
+#include "BSDSockets/SocketsBSD.h"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/**
+ * The platform socket subsystem hands out FSocketBSD on Linux, but a replacement subsystem might not, and SendVectored's
+ * cast would be undefined behavior then. Every subsystem built on the engine's BSD sockets names its API after them
+ */
+static bool UsesBSDSockets()
+{
+	const ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	return SocketSubsystem != nullptr && FCString::Strifind(SocketSubsystem->GetSocketAPIName(), TEXT("BSD")) != nullptr;
+}
+#endif
+
+FTCPLoggingSocketWriter::FTCPLoggingSocketWriter(int32 Capacity, int32 InAckWindowFrames)
+	: Ring(Capacity)
+	, FirstFrame(0)
+	, LaneBytes{}
+	, AckWindowFrames(InAckWindowFrames)
+	, AckedSequence(0)
+	, PreambleOffset(0)
+	, BytesSent(0)
+	, SendCalls(0)
+	, PartialSends(0)
+	, WouldBlockCount(0)
+	, ReplayedFrames(0)
+	, BufferedBytes(0)
+	, HighWaterMark(0)
+#if TCPLOGGING_VECTORED_SEND
+	, bVectoredSend(UsesBSDSockets())
+#endif
+{
+}
+
+void FTCPLoggingSocketWriter::SetPreamble(TArray<uint8>&& InPreamble)
+{
+	Preamble = MoveTemp(InPreamble);
+	PreambleOffset = 0;
+}
+
+bool FTCPLoggingSocketWriter::AppendFrame(TArrayView<const FTCPLoggingIoSlice> Slices, int32 EventCount, ETCPLoggingLane Lane,
+	uint64 Marker, uint64 StagedCycles, uint64 Sequence)
+{
+	int32 Count = 0;
+	for (const FTCPLoggingIoSlice& Slice : Slices)
+	{
+		Count += Slice.Count;
+	}
+	if (Count > Ring.Space())
+	{
+		return false;
+	}
+	for (const FTCPLoggingIoSlice& Slice : Slices)
+	{
+		Ring.Write(Slice.Data, Slice.Count);
+	}
+	Frames.Add(FFrame{Ring.GetWritePosition(), Count, EventCount, Marker, StagedCycles, Sequence, Lane});
+	LaneBytes[(int32) Lane] += Count;
+
+	PublishBufferedBytes();
+	HighWaterMark.store(Ring.GetHighWaterMark(), std::memory_order_relaxed);
+	return true;
+}
+
+int32 FTCPLoggingSocketWriter::DropOldestFrame(ETCPLoggingLane Lane, uint64& OutMarker)
+{
+	OutMarker = 0;
+	if (Ring.GetReadPosition() != Ring.GetReleasePosition())
+	{
+		return INDEX_NONE;
+	}
+	int32 Index = FirstFrame;
+	while (Index < Frames.Num() && Frames[Index].Lane != Lane)
+	{
+		++Index;
+	}
+	if (Index >= Frames.Num())
+	{
+		return INDEX_NONE;
+	}
+
+	const FFrame Frame = Frames[Index];
+	if (Index == FirstFrame)
+	{
+		Ring.Consume((int32) (Frame.EndPos - Ring.GetReadPosition()));
+		Ring.Release(Frame.EndPos);
+		ForgetOldestFrame();
+	}
+	else
+	{
+		// Frames of the other lane are ahead of it, close the gap it leaves behind them
+		Ring.Remove(Frame.EndPos - Frame.Bytes, Frame.Bytes);
+		for (int32 Later = Index + 1; Later < Frames.Num(); ++Later)
+		{
+			Frames[Later].EndPos -= Frame.Bytes;
+		}
+		LaneBytes[(int32) Lane] -= Frame.Bytes;
+		Frames.RemoveAt(Index, 1, false);
+	}
+	PublishBufferedBytes();
+	OutMarker = Frame.Marker;
+	return Frame.EventCount;
+}
+
+void FTCPLoggingSocketWriter::ConsumeSentMarkers(TFunctionRef<void(uint64)> Visitor)
+{
+	for (const uint64 Marker : SentMarkers)
+	{
+		Visitor(Marker);
+	}
+	SentMarkers.Reset();
+}
+
+void FTCPLoggingSocketWriter::Acknowledge(uint64 Sequence)
+{
+	if (Sequence <= AckedSequence)
+	{
+		return;
+	}
+	AckedSequence = Sequence;
+	ReleaseSentFrames();
+	PublishBufferedBytes();
+}
+
+ETCPLoggingSendResult FTCPLoggingSocketWriter::Send(FSocket& Socket)
+{
+	ETCPLoggingSendResult Result = ETCPLoggingSendResult::Idle;
+	const uint64 SendLimit = GetSendLimit();
+	for (;;)
+	{
+		// The preamble goes first, whatever of it is left shares the send with the frames behind it
+		FTCPLoggingIoSlice Slices[MaxSendSlices];
+		int32 NumSlices = 0;
+		const int32 PreambleLeft = Preamble.Num() - PreambleOffset;
+		if (PreambleLeft > 0)
+		{
+			Slices[NumSlices++] = FTCPLoggingIoSlice{Preamble.GetData() + PreambleOffset, PreambleLeft};
+		}
+		if (Ring.GetReadPosition() < SendLimit)
+		{
+			NumSlices += Ring.PeekSlices((int32) (SendLimit - Ring.GetReadPosition()), Slices + NumSlices);
+		}
+		if (NumSlices == 0)
+		{
+			break;
+		}
+
+		int32 AmountSent = 0;
+		Result = SendSlices(Socket, Slices, NumSlices, AmountSent);
+		const int32 PreambleSent = FMath::Min(AmountSent, FMath::Max(PreambleLeft, 0));
+		PreambleOffset += PreambleSent;
+		Ring.Consume(AmountSent - PreambleSent);
+		if (Result != ETCPLoggingSendResult::Idle)
+		{
+			break;
+		}
+	}
+
+	ReleaseSentFrames();
+	PublishBufferedBytes();
+	return Result;
+}
+
+ETCPLoggingSendResult FTCPLoggingSocketWriter::SendSlices(
+	FSocket& Socket, const FTCPLoggingIoSlice* Slices, int32 NumSlices, int32& OutSent)
+{
+#if TCPLOGGING_VECTORED_SEND
+	if (bVectoredSend && NumSlices > 1 && Socket.GetSocketType() == SOCKTYPE_Streaming)
+	{
+		return SendVectored(Socket, Slices, NumSlices, OutSent);
+	}
+#endif
+
+	// One send per slice, the next only goes out once the kernel took the previous one whole
+	OutSent = 0;
+	for (int32 Index = 0; Index < NumSlices; ++Index)
+	{
+		int32 AmountSent = 0;
+		const ETCPLoggingSendResult Result = SendBytes(Socket, Slices[Index].Data, Slices[Index].Count, AmountSent);
+		OutSent += AmountSent;
+		if (Result != ETCPLoggingSendResult::Idle)
+		{
+			return Result;
+		}
+	}
+	return ETCPLoggingSendResult::Idle;
+}
+
+ETCPLoggingSendResult FTCPLoggingSocketWriter::SendBytes(FSocket& Socket, const uint8* Data, int32 Count, int32& OutSent)
+{
+	OutSent = 0;
+	const bool bSucceeded = Socket.Send(Data, Count, OutSent);
+	return CompleteSend(bSucceeded, Count, OutSent);
+}
+
+#if TCPLOGGING_VECTORED_SEND
+ETCPLoggingSendResult FTCPLoggingSocketWriter::SendVectored(
+	FSocket& Socket, const FTCPLoggingIoSlice* Slices, int32 NumSlices, int32& OutSent)
+{
+	check(NumSlices <= MaxSendSlices);
+	iovec Vectors[MaxSendSlices];
+	int32 Count = 0;
+	for (int32 Index = 0; Index < NumSlices; ++Index)
+	{
+		Vectors[Index].iov_base = (void*) Slices[Index].Data;
+		Vectors[Index].iov_len = Slices[Index].Count;
+		Count += Slices[Index].Count;
+	}
+	msghdr Message = {};
+	Message.msg_iov = Vectors;
+	Message.msg_iovlen = NumSlices;
+
+	// Only called once UsesBSDSockets confirmed the socket is an FSocketBSD, errors land in errno like for its own sends
+	const SOCKET NativeSocket = static_cast<FSocketBSD&>(Socket).GetNativeSocket();
+	const ssize_t Sent = sendmsg(NativeSocket, &Message, MSG_NOSIGNAL);
+	OutSent = Sent > 0 ? (int32) Sent : 0;
+	return CompleteSend(Sent >= 0, Count, OutSent);
+}
+#endif
+
+ETCPLoggingSendResult FTCPLoggingSocketWriter::CompleteSend(bool bSucceeded, int32 Count, int32& OutSent)
+{
+	SendCalls.fetch_add(1, std::memory_order_relaxed);
+	INC_DWORD_STAT(STAT_TCPLogging_SendCalls);
+	CSV_CUSTOM_STAT(TCPLogging, SendCalls, 1, ECsvCustomStatOp::Accumulate);
+	if (!bSucceeded)
+	{
+		OutSent = 0;
+		ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+		const ESocketErrors Error = SocketSubsystem->GetLastErrorCode();
+		if (Error == SE_EWOULDBLOCK || Error == SE_TRY_AGAIN || Error == SE_NO_ERROR)
+		{
+			WouldBlockCount.fetch_add(1, std::memory_order_relaxed);
+			return ETCPLoggingSendResult::Pending;
+		}
+		UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Analytics socket send failed (%s)"), SocketSubsystem->GetSocketError(Error));
+		return ETCPLoggingSendResult::Error;
+	}
+
+	OutSent = FMath::Clamp(OutSent, 0, Count);
+	BytesSent.fetch_add(OutSent, std::memory_order_relaxed);
+	INC_DWORD_STAT_BY(STAT_TCPLogging_BytesSent, OutSent);
+	CSV_CUSTOM_STAT(TCPLogging, BytesSent, OutSent, ECsvCustomStatOp::Accumulate);
+	if (OutSent < Count)
+	{
+		// The kernel buffer is full, the tail goes out on the next writable notification
+		PartialSends.fetch_add(1, std::memory_order_relaxed);
+		return ETCPLoggingSendResult::Pending;
+	}
+	return ETCPLoggingSendResult::Idle;
+}
+
+ETCPLoggingSendResult FTCPLoggingSocketWriter::WaitAndSend(FSocket& Socket, double TimeoutSeconds)
+{
+	if (!HasPending() && !HasUnacknowledged())
+	{
+		return ETCPLoggingSendResult::Idle;
+	}
+	if (PreambleOffset >= Preamble.Num() && Ring.GetReadPosition() >= GetSendLimit())
+	{
+		// Nothing may go out before the next ack, a peer that closed the connection also wakes this up
+		Socket.Wait(ESocketWaitConditions::WaitForRead, FTimespan::FromSeconds(TimeoutSeconds));
+		return ETCPLoggingSendResult::Pending;
+	}
+	if (!Socket.Wait(ESocketWaitConditions::WaitForWrite, FTimespan::FromSeconds(TimeoutSeconds)))
+	{
+		// Not writable in time, make sure that is backpressure and not a dead connection
+		if (Socket.GetConnectionState() == SCS_ConnectionError)
+		{
+			return ETCPLoggingSendResult::Error;
+		}
+		return ETCPLoggingSendResult::Pending;
+	}
+	return Send(Socket);
+}
+
+void FTCPLoggingSocketWriter::Rewind()
+{
+	ReplayedFrames.fetch_add(Frames.Num() - FirstFrame, std::memory_order_relaxed);
+	Ring.Rewind();
+	PreambleOffset = 0;
+	PublishBufferedBytes();
+}
+
+void FTCPLoggingSocketWriter::ReleaseSentFrames()
+{
+	const uint64 ReadPos = Ring.GetReadPosition();
+	while (FirstFrame < Frames.Num() && Frames[FirstFrame].EndPos <= ReadPos
+		   && (AckWindowFrames == 0 || Frames[FirstFrame].Sequence <= AckedSequence))
+	{
+		const FFrame& Frame = Frames[FirstFrame];
+		Ring.Release(Frame.EndPos);
+		if (Frame.Marker != 0)
+		{
+			SentMarkers.Add(Frame.Marker);
+		}
+		INC_DWORD_STAT_BY(STAT_TCPLogging_EventsSent, Frame.EventCount);
+		CSV_CUSTOM_STAT(TCPLogging, EventsSent, Frame.EventCount, ECsvCustomStatOp::Accumulate);
+		if (Frame.Lane == ETCPLoggingLane::Critical)
+		{
+			INC_DWORD_STAT_BY(STAT_TCPLogging_CriticalEventsSent, Frame.EventCount);
+			CSV_CUSTOM_STAT(TCPLogging, CriticalEventsSent, Frame.EventCount, ECsvCustomStatOp::Accumulate);
+		}
+		if (Frame.StagedCycles != 0)
+		{
+			const float LatencyMs =
+				(float) ((double) (FPlatformTime::Cycles64() - Frame.StagedCycles) * FPlatformTime::GetSecondsPerCycle64() * 1000.0);
+			SET_FLOAT_STAT(STAT_TCPLogging_RecordToWireMs, LatencyMs);
+			CSV_CUSTOM_STAT(TCPLogging, RecordToWireMs, LatencyMs, ECsvCustomStatOp::Max);
+		}
+		ForgetOldestFrame();
+	}
+
+	// Compact once the stale prefix dominates so the array stays proportional to what is buffered
+	if (FirstFrame > 64 && FirstFrame * 2 > Frames.Num())
+	{
+		Frames.RemoveAt(0, FirstFrame, false);
+		FirstFrame = 0;
+	}
+}
+
+uint64 FTCPLoggingSocketWriter::GetSendLimit() const
+{
+	// Frames are released in order, so the unacknowledged ones are exactly those from FirstFrame on
+	const int32 LastInWindow = FirstFrame + AckWindowFrames - 1;
+	if (AckWindowFrames == 0 || LastInWindow >= Frames.Num())
+	{
+		return Ring.GetWritePosition();
+	}
+	return Frames[LastInWindow].EndPos;
+}
+
+void FTCPLoggingSocketWriter::ForgetOldestFrame()
+{
+	const FFrame& Frame = Frames[FirstFrame++];
+	LaneBytes[(int32) Frame.Lane] -= Frame.Bytes;
+}
+
+void FTCPLoggingSocketWriter::PublishBufferedBytes()
+{
+	BufferedBytes.store(Ring.NumRetained(), std::memory_order_relaxed);
+}
+
+FTCPLoggingSocketWriterStats FTCPLoggingSocketWriter::GetStats() const
+{
+	FTCPLoggingSocketWriterStats Stats;
+	Stats.BytesSent = BytesSent.load(std::memory_order_relaxed);
+	Stats.SendCalls = SendCalls.load(std::memory_order_relaxed);
+	Stats.PartialSends = PartialSends.load(std::memory_order_relaxed);
+	Stats.WouldBlockCount = WouldBlockCount.load(std::memory_order_relaxed);
+	Stats.ReplayedFrames = ReplayedFrames.load(std::memory_order_relaxed);
+	Stats.BufferedBytes = BufferedBytes.load(std::memory_order_relaxed);
+	Stats.HighWaterMark = HighWaterMark.load(std::memory_order_relaxed);
+	Stats.Capacity = Ring.Capacity();
+	return Stats;
+}
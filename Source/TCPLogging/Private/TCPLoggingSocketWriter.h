@@ -0,0 +1,206 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "Containers/ArrayView.h"
+#include "CoreMinimal.h"
+#include "TCPLoggingIoSlice.h"
+#include "TCPLoggingLane.h"
+#include "TCPLoggingRingBuffer.h"
+#include "Templates/Function.h"
+
+#include <atomic>
+
+class FSocket;
+
+/** Counters describing how the socket keeps up with the data handed to it */
+struct FTCPLoggingSocketWriterStats
+{
+	/** Bytes accepted by the kernel */
+	uint64 BytesSent = 0;
+	/** Calls to FSocket::Send */
+	uint64 SendCalls = 0;
+	/** Sends that accepted fewer bytes than offered */
+	uint64 PartialSends = 0;
+	/** Sends rejected because the kernel buffer was full */
+	uint64 WouldBlockCount = 0;
+	/** Batches rewound for replay after losing the connection */
+	uint64 ReplayedFrames = 0;
+	/** Bytes waiting in the ring buffer right now, sent or not */
+	int32 BufferedBytes = 0;
+	/** Most bytes ever waiting in the ring buffer */
+	int32 HighWaterMark = 0;
+	int32 Capacity = 0;
+};
+
+enum class ETCPLoggingSendResult : uint8
+{
+	/** Everything buffered has been handed to the kernel */
+	Idle,
+	/** Bytes remain because the socket is not writable yet */
+	Pending,
+	/** The connection failed */
+	Error,
+};
+
+/**
+ * Sits between the batches and a non-blocking socket. Each batch is appended to a fixed size ring buffer as one
+ * frame and sent from there, partial sends only consume what the kernel accepted so the unsent tail simply goes
+ * out on the next call and the NDJSON stream is never truncated no matter how much backpressure the collector applies.
+ *
+ * A frame stays in the ring until it has been sent completely. When the connection drops the writer rewinds to the
+ * oldest incomplete frame so every batch the old connection did not finish is replayed, in order, on the next one,
+ * preceded by the session preamble.
+ *
+ * With an acknowledgement window, sequenced frames stay in the ring until the collector acknowledged them instead, so
+ * a rewind replays everything it may not have committed. At most the window's worth of frames is unacknowledged at a
+ * time, the next one waits for an ack, which keeps acks pipelined without letting the collector fall arbitrarily behind.
+ *
+ * Frames are gathered into the ring from wherever their pieces are, and everything ready to go out, the rest of the
+ * preamble and the ring's contents on both sides of the wrap, leaves in one vectored send where the platform has one
+ * (sendmsg on Linux, as long as the platform's sockets are the engine's BSD ones) and in one send per piece elsewhere.
+ */
+class FTCPLoggingSocketWriter
+{
+public:
+	/** AckWindowFrames of 0 releases frames as soon as they are sent */
+	explicit FTCPLoggingSocketWriter(int32 Capacity, int32 InAckWindowFrames = 0);
+
+	/** Bytes sent at the start of every connection, ahead of any buffered frame */
+	void SetPreamble(TArray<uint8>&& InPreamble);
+
+	/**
+	 * Buffers a whole batch, copying Slices into the ring in order as one frame. Returns false without buffering
+	 * anything if it does not fit.
+	 * A non-zero Marker is handed back through ConsumeSentMarkers once the frame has been sent completely.
+	 * StagedCycles is when its oldest event was recorded, if known, and feeds the record to wire latency stat.
+	 * A non-zero Sequence is the frame's sequence number on a sequenced stream, it is then kept until acknowledged.
+	 */
+	bool AppendFrame(TArrayView<const FTCPLoggingIoSlice> Slices, int32 EventCount, ETCPLoggingLane Lane, uint64 Marker = 0,
+		uint64 StagedCycles = 0, uint64 Sequence = 0);
+
+	/**
+	 * Discards Lane's oldest frame to make room, even from behind frames of the other lane, only possible while nothing
+	 * has been sent since the last rewind. Returns the number of events dropped, or INDEX_NONE if nothing could be dropped.
+	 */
+	int32 DropOldestFrame(ETCPLoggingLane Lane, uint64& OutMarker);
+
+	/** Calls Visitor with the marker of every frame sent completely (or acknowledged) since the last call, in order */
+	void ConsumeSentMarkers(TFunctionRef<void(uint64)> Visitor);
+
+	/** The collector committed every frame up to and including Sequence, releases the ones already sent */
+	void Acknowledge(uint64 Sequence);
+
+	/** Sends as much as the socket accepts without blocking */
+	ETCPLoggingSendResult Send(FSocket& Socket);
+
+	/**
+	 * Waits up to TimeoutSeconds for the socket to become writable, then sends. While the acknowledgement window is
+	 * full it waits for the socket to become readable instead, for the caller to read the ack.
+	 */
+	ETCPLoggingSendResult WaitAndSend(FSocket& Socket, double TimeoutSeconds);
+
+	/** Prepares for a new connection after the old one was lost: preamble first, then every incomplete frame */
+	void Rewind();
+
+	bool HasPending() const
+	{
+		return PreambleOffset < Preamble.Num() || !Ring.IsEmpty();
+	}
+
+	/** True while sequenced frames wait to be sent or acknowledged */
+	bool HasUnacknowledged() const
+	{
+		return AckWindowFrames > 0 && FirstFrame < Frames.Num();
+	}
+
+	int32 GetCapacity() const
+	{
+		return Ring.Capacity();
+	}
+
+	/** Bytes of Lane's frames still in the ring, sent or not. Only for the sender thread */
+	int32 GetBufferedBytes(ETCPLoggingLane Lane) const
+	{
+		return LaneBytes[(int32) Lane];
+	}
+
+	/** Largest frame AppendFrame would accept right now */
+	int32 GetFreeSpace() const
+	{
+		return Ring.Space();
+	}
+
+	/** Snapshot of the counters, safe to call from any thread */
+	FTCPLoggingSocketWriterStats GetStats() const;
+
+private:
+	/** The preamble and the two sides of the ring's wrap */
+	static constexpr int32 MaxSendSlices = 3;
+
+	/** Sends the slices in order, returns the result and how many bytes the kernel took */
+	ETCPLoggingSendResult SendSlices(FSocket& Socket, const FTCPLoggingIoSlice* Slices, int32 NumSlices, int32& OutSent);
+
+	/** Sends Count bytes, returns the result and how many the kernel took */
+	ETCPLoggingSendResult SendBytes(FSocket& Socket, const uint8* Data, int32 Count, int32& OutSent);
+
+#if TCPLOGGING_VECTORED_SEND
+	/** All slices in a single sendmsg on the socket's native handle */
+	ETCPLoggingSendResult SendVectored(FSocket& Socket, const FTCPLoggingIoSlice* Slices, int32 NumSlices, int32& OutSent);
+#endif
+
+	/** Counts a send of Count bytes that took OutSent of them, or failed, and classifies the outcome */
+	ETCPLoggingSendResult CompleteSend(bool bSucceeded, int32 Count, int32& OutSent);
+
+	/** Releases every frame the read position has moved past, and with acknowledgements every acknowledged one */
+	void ReleaseSentFrames();
+
+	/** Logical ring position sending has to stop at until more frames are acknowledged */
+	uint64 GetSendLimit() const;
+
+	void PublishBufferedBytes();
+
+	struct FFrame
+	{
+		/** Logical ring position just past the last byte of the frame */
+		uint64 EndPos;
+		int32 Bytes;
+		int32 EventCount;
+		uint64 Marker;
+		uint64 StagedCycles;
+		uint64 Sequence;
+		ETCPLoggingLane Lane;
+	};
+
+	/** Removes the oldest frame from the lane accounting once it left the ring */
+	void ForgetOldestFrame();
+
+	FTCPLoggingRingBuffer Ring;
+
+	/** Frames in ring order, entries before FirstFrame are stale and compacted away periodically */
+	TArray<FFrame> Frames;
+	int32 FirstFrame;
+	int32 LaneBytes[TCPLoggingNumLanes];
+
+	const int32 AckWindowFrames;
+	/** Highest sequence the collector acknowledged */
+	uint64 AckedSequence;
+
+	/** Markers of frames sent since the last ConsumeSentMarkers */
+	TArray<uint64> SentMarkers;
+
+	TArray<uint8> Preamble;
+	int32 PreambleOffset;
+
+	std::atomic<uint64> BytesSent;
+	std::atomic<uint64> SendCalls;
+	std::atomic<uint64> PartialSends;
+	std::atomic<uint64> WouldBlockCount;
+	std::atomic<uint64> ReplayedFrames;
+	std::atomic<int32> BufferedBytes;
+	std::atomic<int32> HighWaterMark;
+#if TCPLOGGING_VECTORED_SEND
+	/** The platform's sockets are FSocketBSD, whose native handle SendVectored needs */
+	const bool bVectoredSend;
+#endif
+};
@@ -0,0 +1,441 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "TCPLoggingSpool.h"
+
+#include "Async/MappedFileHandle.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "HAL/PlatformProcess.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Guid.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "TCPLoggingLog.h"
+
+/** Bounds on the size a segment grows to before rotating, an eighth of the disk budget in between */
+static constexpr int64 MinSegmentBytes = 64 * 1024;
+static constexpr int64 MaxSegmentBytes = 16 * 1024 * 1024;
+
+static constexpr int32 SpoolFileHeaderSize = 8;
+static constexpr uint8 SpoolVersion = 1;
+
+static uint32 ReadRecordSize(const uint8* Data)
+{
+	return (uint32) Data[0] | ((uint32) Data[1] << 8) | ((uint32) Data[2] << 16) | ((uint32) Data[3] << 24);
+}
+
+static void AppendRecordSize(TArray<uint8>& Out, uint32 Size)
+{
+	const uint8 Bytes[4] = {(uint8) Size, (uint8) (Size >> 8), (uint8) (Size >> 16), (uint8) (Size >> 24)};
+	Out.Append(Bytes, 4);
+}
+
+static uint64 MakeSpoolMarker(uint32 SegmentId, int64 Offset)
+{
+	return ((uint64) SegmentId << 32) | (uint64) (uint32) Offset;
+}
+
+/** Prefixes of the spools alive in this process, a lock file naming this process is only live if its prefix is here */
+static FCriticalSection LiveSpoolsLock;
+static TSet<FString> LiveSpoolPrefixes;
+
+static bool IsSpoolPrefixLive(const FString& Prefix)
+{
+	FScopeLock Lock(&LiveSpoolsLock);
+	return LiveSpoolPrefixes.Contains(Prefix);
+}
+
+/** Prefix a segment file name was written under: everything before its last dash */
+static FString GetSegmentPrefix(const FString& FileName)
+{
+	const FString BaseName = FPaths::GetBaseFilename(FileName);
+	int32 Dash = INDEX_NONE;
+	return BaseName.FindLastChar(TEXT('-'), Dash) ? BaseName.Left(Dash) : BaseName;
+}
+
+FTCPLoggingSpool::FTCPLoggingSpool(const FString& InDirectory, int64 InMaxBytes, ETCPLoggingPayloadFormat InPayloadFormat,
+	const TArray<uint8>& InSegmentHeader)
+	: Directory(InDirectory)
+	, MaxBytes(InMaxBytes)
+	, SegmentBytes(FMath::Clamp(InMaxBytes / 8, MinSegmentBytes, MaxSegmentBytes))
+	, PayloadFormat(InPayloadFormat)
+	, SegmentHeader(InSegmentHeader)
+	, NextSegmentId(1)
+	, ActiveId(0)
+	, bMarkerPending(false)
+	, ReplayIndex(0)
+	, ReplayOffset(0)
+	, ReplayHeaderSize(0)
+	, EvictedBytes(0)
+{
+	FPlatformFileManager::Get().GetPlatformFile().CreateDirectoryTree(*Directory);
+
+	// The lock goes down before any file is claimed or written, so another spool never takes this one's files
+	RunPrefix = FString::Printf(TEXT("%s-%u-%s"), *FDateTime::UtcNow().ToString(TEXT("%Y%m%d-%H%M%S")),
+		FPlatformProcess::GetCurrentProcessId(), *FGuid::NewGuid().ToString(EGuidFormats::Digits));
+	LockPath = Directory / (RunPrefix + TEXT(".lock"));
+	if (!FFileHelper::SaveStringToFile(LexToString(FPlatformProcess::GetCurrentProcessId()), *LockPath))
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Unable to create analytics spool lock %s"), *LockPath);
+	}
+	{
+		FScopeLock Lock(&LiveSpoolsLock);
+		LiveSpoolPrefixes.Add(RunPrefix);
+	}
+
+	ClaimOrphanedSegments();
+}
+
+FTCPLoggingSpool::~FTCPLoggingSpool()
+{
+	Flush();
+	ReleaseReplayMapping();
+
+	// Everything not committed by now stays on disk for the next session
+	if (ActiveId != 0)
+	{
+		const int32 Index = FindSegment(ActiveId);
+		CloseActiveSegment();
+		DeleteIfCommitted(Index);
+	}
+
+	// What is left is orphaned from here on, for the next spool to claim
+	{
+		FScopeLock Lock(&LiveSpoolsLock);
+		LiveSpoolPrefixes.Remove(RunPrefix);
+	}
+	FPlatformFileManager::Get().GetPlatformFile().DeleteFile(*LockPath);
+}
+
+void FTCPLoggingSpool::ClaimOrphanedSegments()
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+
+	// Segments are listed before locks: a spool creates its lock before its first segment, so an owned segment
+	// always shows up with its owner's lock
+	TArray<FString> FileNames;
+	IFileManager::Get().FindFiles(FileNames, *(Directory / TEXT("*.spool")), true, false);
+	FileNames.Sort();
+	TArray<FString> LockNames;
+	IFileManager::Get().FindFiles(LockNames, *(Directory / TEXT("*.lock")), true, false);
+
+	TSet<FString> LivePrefixes;
+	const uint32 ProcessId = FPlatformProcess::GetCurrentProcessId();
+	for (const FString& LockName : LockNames)
+	{
+		const FString Prefix = FPaths::GetBaseFilename(LockName);
+		if (Prefix == RunPrefix)
+		{
+			continue;
+		}
+		FString OwnerText;
+		uint32 OwnerId = 0;
+		const bool bHasOwner =
+			FFileHelper::LoadFileToString(OwnerText, *(Directory / LockName)) && LexTryParseString(OwnerId, *OwnerText);
+		const bool bLive = bHasOwner
+			&& (OwnerId == ProcessId ? IsSpoolPrefixLive(Prefix) : FPlatformProcess::IsApplicationRunning(OwnerId));
+		if (bLive)
+		{
+			LivePrefixes.Add(Prefix);
+		}
+		else
+		{
+			// Left behind by a crash, its segments are up for grabs
+			PlatformFile.DeleteFile(*(Directory / LockName));
+		}
+	}
+
+	// Whatever an earlier run left behind was never received, queue it up for replay in the order it was written
+	for (const FString& FileName : FileNames)
+	{
+		if (LivePrefixes.Contains(GetSegmentPrefix(FileName)))
+		{
+			continue;
+		}
+		const FString Path = Directory / FileName;
+		const int64 Size = PlatformFile.FileSize(*Path);
+		if (Size <= 0)
+		{
+			PlatformFile.DeleteFile(*Path);
+			continue;
+		}
+
+		// Claimed ones sort ahead of the segments this spool writes itself, in case it leaves both behind
+		const uint32 Id = NextSegmentId++;
+		const FString ClaimedPath = Directory / FString::Printf(TEXT("%s-a%06u.spool"), *RunPrefix, Id);
+		if (!PlatformFile.MoveFile(*ClaimedPath, *Path))
+		{
+			// Another spool claimed it first
+			continue;
+		}
+		Segments.Add(FSegment{ClaimedPath, Id, Size, 0, false, true});
+	}
+	if (Segments.Num() > 0)
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Log, TEXT("Replaying (%d) analytics spool segments from %s"), Segments.Num(), *Directory);
+	}
+}
+
+void FTCPLoggingSpool::Append(const uint8* Data, int32 Count)
+{
+	AppendRecordSize(Staged, (uint32) Count);
+	Staged.Append(Data, Count);
+}
+
+void FTCPLoggingSpool::Flush()
+{
+	if (Staged.Num() == 0)
+	{
+		return;
+	}
+
+	// Make room by evicting the oldest segments, the active one is never evicted since it is about to be written
+	const int64 NewBytes = Staged.Num() + (ActiveId == 0 ? SpoolFileHeaderSize + 4 + SegmentHeader.Num() : 0);
+	while (GetTotalBytes() + NewBytes > MaxBytes)
+	{
+		const int32 Victim = Segments.IndexOfByPredicate([this](const FSegment& Segment) { return Segment.Id != ActiveId; });
+		if (Victim == INDEX_NONE)
+		{
+			break;
+		}
+		const int64 Lost = Segments[Victim].Size - Segments[Victim].Committed;
+		EvictedBytes += Lost;
+		UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Analytics spool is over its (%lld) byte budget, evicting (%lld) unsent bytes"),
+			MaxBytes, Lost);
+		DeleteSegment(Victim);
+	}
+
+	if (ActiveId == 0 && !OpenActiveSegment())
+	{
+		EvictedBytes += Staged.Num();
+		Staged.Reset();
+		return;
+	}
+
+	FSegment& Active = Segments[FindSegment(ActiveId)];
+	if (!ActiveFile->Write(Staged.GetData(), Staged.Num()))
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Failed to write (%d) bytes to analytics spool %s"), Staged.Num(), *Active.Path);
+		EvictedBytes += Staged.Num();
+	}
+	else
+	{
+		Active.Size += Staged.Num();
+		bMarkerPending = true;
+	}
+	Staged.Reset();
+}
+
+uint64 FTCPLoggingSpool::TakeMarker()
+{
+	Flush();
+	if (!bMarkerPending)
+	{
+		return 0;
+	}
+	bMarkerPending = false;
+
+	const FSegment& Active = Segments[FindSegment(ActiveId)];
+	const uint64 Marker = MakeSpoolMarker(Active.Id, Active.Size);
+	if (Active.Size >= SegmentBytes)
+	{
+		CloseActiveSegment();
+	}
+	return Marker;
+}
+
+void FTCPLoggingSpool::Commit(uint64 Marker)
+{
+	const int32 Index = FindSegment((uint32) (Marker >> 32));
+	if (Index == INDEX_NONE)
+	{
+		return;
+	}
+	FSegment& Segment = Segments[Index];
+	Segment.Committed = FMath::Max(Segment.Committed, (int64) (uint32) Marker);
+	DeleteIfCommitted(Index);
+}
+
+void FTCPLoggingSpool::Retain(uint64 Marker)
+{
+	const int32 Index = FindSegment((uint32) (Marker >> 32));
+	if (Index != INDEX_NONE)
+	{
+		Segments[Index].bRetain = true;
+	}
+}
+
+bool FTCPLoggingSpool::ReadReplayChunk(int32 MaxChunkBytes, TArray<uint8>& OutChunk, uint64& OutMarker)
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	while (HasReplayPending())
+	{
+		FSegment& Segment = Segments[ReplayIndex];
+		if (!ReplayRegion.IsValid())
+		{
+			ReplayFile.Reset(PlatformFile.OpenMapped(*Segment.Path));
+			if (ReplayFile.IsValid())
+			{
+				ReplayRegion.Reset(ReplayFile->MapRegion(0, Segment.Size));
+			}
+			if (!ReplayRegion.IsValid())
+			{
+				// Leave it for a later run rather than lose it
+				UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Unable to map analytics spool segment %s"), *Segment.Path);
+				ReleaseReplayMapping();
+				Segment.bRetain = true;
+				++ReplayIndex;
+				continue;
+			}
+
+			// Only replay what this run can send as is, segments in the other payload format wait for a run that uses it
+			const uint8* Data = ReplayRegion->GetMappedPtr();
+			const bool bValidHeader = Segment.Size >= SpoolFileHeaderSize + 4 && FMemory::Memcmp(Data, "TLSP", 4) == 0
+				&& Data[4] == SpoolVersion;
+			if (bValidHeader && Data[5] != (uint8) PayloadFormat)
+			{
+				ReleaseReplayMapping();
+				Segment.bRetain = true;
+				++ReplayIndex;
+				continue;
+			}
+			const int64 PreambleEnd = bValidHeader ? SpoolFileHeaderSize + 4 + (int64) ReadRecordSize(Data + SpoolFileHeaderSize) : 0;
+			ReplayHeaderSize = bValidHeader && PreambleEnd <= Segment.Size ? PreambleEnd : Segment.Size;
+			ReplayOffset = ReplayHeaderSize;
+			Segment.Committed = ReplayHeaderSize;
+		}
+
+		// Whole messages only, a write torn by a crash leaves an incomplete tail that is skipped
+		const uint8* Data = ReplayRegion->GetMappedPtr();
+		int64 End = ReplayOffset;
+		int64 PayloadBytes = 0;
+		while (Segment.Size - End >= 4)
+		{
+			const int64 RecordSize = ReadRecordSize(Data + End);
+			if (RecordSize > Segment.Size - End - 4)
+			{
+				break;
+			}
+			if (End > ReplayOffset && ReplayHeaderSize + PayloadBytes + RecordSize > MaxChunkBytes)
+			{
+				break;
+			}
+			End += 4 + RecordSize;
+			PayloadBytes += RecordSize;
+		}
+
+		if (End == ReplayOffset)
+		{
+			// Segment exhausted, it is deleted once the collector has everything that was replayed from it
+			Segment.Size = ReplayOffset;
+			ReleaseReplayMapping();
+			DeleteIfCommitted(ReplayIndex++);
+			continue;
+		}
+
+		OutChunk.Reset();
+		const int32 PreambleOffset = SpoolFileHeaderSize + 4;
+		OutChunk.Append(Data + PreambleOffset, (int32) (ReplayHeaderSize - PreambleOffset));
+		for (int64 Offset = ReplayOffset; Offset < End;)
+		{
+			const int32 RecordSize = (int32) ReadRecordSize(Data + Offset);
+			OutChunk.Append(Data + Offset + 4, RecordSize);
+			Offset += 4 + RecordSize;
+		}
+		// Switch the collector back to the current session for whatever follows the replayed messages
+		OutChunk.Append(SegmentHeader);
+		OutMarker = MakeSpoolMarker(Segment.Id, End);
+		ReplayOffset = End;
+		return true;
+	}
+	return false;
+}
+
+int32 FTCPLoggingSpool::FindSegment(uint32 Id) const
+{
+	return Segments.IndexOfByPredicate([Id](const FSegment& Segment) { return Segment.Id == Id; });
+}
+
+bool FTCPLoggingSpool::OpenActiveSegment()
+{
+	const uint32 Id = NextSegmentId++;
+	const FString Path = Directory / FString::Printf(TEXT("%s-b%06u.spool"), *RunPrefix, Id);
+
+	TArray<uint8> Header;
+	const uint8 FileHeader[SpoolFileHeaderSize] = {'T', 'L', 'S', 'P', SpoolVersion, (uint8) PayloadFormat, 0, 0};
+	Header.Append(FileHeader, SpoolFileHeaderSize);
+	AppendRecordSize(Header, (uint32) SegmentHeader.Num());
+	Header.Append(SegmentHeader);
+
+	ActiveFile.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*Path));
+	if (!ActiveFile.IsValid() || !ActiveFile->Write(Header.GetData(), Header.Num()))
+	{
+		UE_LOG(LogTCPLoggingAnalytics, Warning, TEXT("Unable to create analytics spool segment %s"), *Path);
+		ActiveFile.Reset();
+		return false;
+	}
+
+	Segments.Add(FSegment{Path, Id, Header.Num(), Header.Num(), false, false});
+	ActiveId = Id;
+	return true;
+}
+
+void FTCPLoggingSpool::CloseActiveSegment()
+{
+	ActiveFile.Reset();
+	ActiveId = 0;
+}
+
+void FTCPLoggingSpool::DeleteSegment(int32 Index)
+{
+	const FSegment& Segment = Segments[Index];
+	if (Segment.Id == ActiveId)
+	{
+		CloseActiveSegment();
+	}
+	if (Index == ReplayIndex)
+	{
+		ReleaseReplayMapping();
+	}
+	else if (Index < ReplayIndex)
+	{
+		--ReplayIndex;
+	}
+
+	FPlatformFileManager::Get().GetPlatformFile().DeleteFile(*Segment.Path);
+	Segments.RemoveAt(Index);
+}
+
+void FTCPLoggingSpool::DeleteIfCommitted(int32 Index)
+{
+	if (Index == INDEX_NONE)
+	{
+		return;
+	}
+	const FSegment& Segment = Segments[Index];
+	// A replay segment still being read has not reached its final size yet
+	const bool bReading = Index == ReplayIndex && ReplayRegion.IsValid();
+	if (Segment.Committed >= Segment.Size && !Segment.bRetain && !bReading)
+	{
+		DeleteSegment(Index);
+	}
+}
+
+void FTCPLoggingSpool::ReleaseReplayMapping()
+{
+	ReplayRegion.Reset();
+	ReplayFile.Reset();
+	ReplayOffset = 0;
+	ReplayHeaderSize = 0;
+}
+
+int64 FTCPLoggingSpool::GetTotalBytes() const
+{
+	int64 Total = 0;
+	for (const FSegment& Segment : Segments)
+	{
+		Total += Segment.Size;
+	}
+	return Total;
+}
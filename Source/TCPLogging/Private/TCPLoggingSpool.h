@@ -0,0 +1,133 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TCPLoggingCompression.h"
+#include "Templates/UniquePtr.h"
+
+class IFileHandle;
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/**
+ * Append-only on-disk log of durable messages, split into segment files that each start with the session preamble.
+ * A segment is an 8 byte file header ('T' 'L' 'S' 'P', version, ETCPLoggingPayloadFormat, 2 reserved bytes) followed by
+ * length-prefixed messages (uint32 LE), so JSON and binary messages are spooled alike.
+ * Messages are staged in memory and appended to the active segment once per batch, the data then lives in the OS page
+ * cache and survives the process crashing. A segment is deleted as soon as the collector has received all of it, so
+ * whatever is still on disk when the next session starts is exactly what never made it, and gets replayed.
+ *
+ * Several spools may share a directory, in one process or several. Every spool names its files after a prefix unique
+ * to it and keeps a <prefix>.lock file holding its process id while it lives. On startup it only takes over segments
+ * whose owner is gone, i.e. without a lock file or with one naming a process that no longer runs, by renaming them
+ * to its own prefix. Renaming is atomic, so each orphaned segment is claimed by exactly one spool.
+ *
+ * Positions handed out are opaque markers naming a segment and an offset in it. The sender attaches them to the frames
+ * it sends and reports them back through Commit once a frame is out, or Retain if the frame had to be dropped.
+ * Only used by the sender thread.
+ */
+class FTCPLoggingSpool
+{
+public:
+	FTCPLoggingSpool(const FString& InDirectory, int64 InMaxBytes, ETCPLoggingPayloadFormat InPayloadFormat,
+		const TArray<uint8>& InSegmentHeader);
+	~FTCPLoggingSpool();
+
+	UE_NONCOPYABLE(FTCPLoggingSpool);
+
+	/** Stages a durable message, it reaches the disk on the next Flush */
+	void Append(const uint8* Data, int32 Count);
+
+	/** Writes staged messages to the active segment, evicting the oldest segments to stay within the disk budget */
+	void Flush();
+
+	/**
+	 * Flushes and returns a marker covering everything written since the previous call, or 0 if nothing was.
+	 * Rotates to a new segment once the active one is large enough, so a marker never spans two files.
+	 */
+	uint64 TakeMarker();
+
+	/** The collector has received everything up to Marker */
+	void Commit(uint64 Marker);
+
+	/** Data up to Marker was dropped from memory, keep its segment for the next session to replay */
+	void Retain(uint64 Marker);
+
+	/** True while segments left behind by an earlier run are waiting to be replayed */
+	bool HasReplayPending() const
+	{
+		return ReplayIndex < Segments.Num() && Segments[ReplayIndex].bReplay;
+	}
+
+	/**
+	 * Reads the next chunk of an earlier run's segment: its preamble, as many whole messages as fit in MaxChunkBytes
+	 * (at least one), then the current preamble again, all concatenated without length prefixes.
+	 * Segments written in another payload format are left for a run using that format.
+	 * Returns false once there is nothing left to replay.
+	 */
+	bool ReadReplayChunk(int32 MaxChunkBytes, TArray<uint8>& OutChunk, uint64& OutMarker);
+
+	/** Bytes of durable messages evicted to respect the disk budget */
+	int64 GetEvictedBytes() const
+	{
+		return EvictedBytes;
+	}
+
+private:
+	struct FSegment
+	{
+		FString Path;
+		uint32 Id;
+		int64 Size;
+		/** Everything before this offset reached the collector */
+		int64 Committed;
+		/** Some of it was dropped before being sent, never delete it during this run */
+		bool bRetain;
+		/** Left behind by an earlier run */
+		bool bReplay;
+	};
+
+	/** Claims the segments no live spool owns, oldest first, and queues them for replay */
+	void ClaimOrphanedSegments();
+	int32 FindSegment(uint32 Id) const;
+	bool OpenActiveSegment();
+	void CloseActiveSegment();
+	void DeleteSegment(int32 Index);
+	/** Deletes the segment once everything in it was received, unless it must be kept */
+	void DeleteIfCommitted(int32 Index);
+	void ReleaseReplayMapping();
+	int64 GetTotalBytes() const;
+
+	FString Directory;
+	int64 MaxBytes;
+	/** Active segments rotate at this size */
+	int64 SegmentBytes;
+	ETCPLoggingPayloadFormat PayloadFormat;
+	TArray<uint8> SegmentHeader;
+
+	/** Oldest first, replay segments ahead of the ones written by this run */
+	TArray<FSegment> Segments;
+	uint32 NextSegmentId;
+	/** Prefix for the file names of this spool's segments, unique to it and sorting after every earlier run */
+	FString RunPrefix;
+	/** Marks RunPrefix as owned for as long as this spool lives */
+	FString LockPath;
+
+	TUniquePtr<IFileHandle> ActiveFile;
+	uint32 ActiveId;
+	/** Messages appended since the last Flush */
+	TArray<uint8> Staged;
+	/** Flushed since the last TakeMarker */
+	bool bMarkerPending;
+
+	/** Next replay segment to read and the read offset into it */
+	int32 ReplayIndex;
+	int64 ReplayOffset;
+	TUniquePtr<IMappedFileHandle> ReplayFile;
+	TUniquePtr<IMappedFileRegion> ReplayRegion;
+	/** Offset just past the replay segment's preamble record */
+	int64 ReplayHeaderSize;
+
+	int64 EvictedBytes;
+};
@@ -0,0 +1,335 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "TCPLoggingStaging.h"
+
+#include "HAL/Event.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/ScopeLock.h"
+#include "TCPLoggingStats.h"
+#include "TCPLoggingThreadState.h"
+
+struct FTCPLoggingStaging::FSlot
+{
+	/** Taken by the owning thread for every message and by the sender when it collects */
+	FCriticalSection Lock;
+	/** Full chunks followed by the one still being filled, per lane */
+	TArray<FTCPLoggingStagedChunk> Chunks[TCPLoggingNumLanes];
+	int32 StagedBytes[TCPLoggingNumLanes] = {};
+	/** Lets the sender check for work without taking every lock */
+	std::atomic<bool> bHasMessages{false};
+	/** The message being staged, only touched by the owning thread */
+	TArray<uint8> Message;
+	/** The owning thread exited, set under SlotsLock */
+	bool bExited = false;
+};
+
+bool LexTryParseString(ETCPLoggingOverflowPolicy& OutPolicy, const TCHAR* Text)
+{
+	for (ETCPLoggingOverflowPolicy Policy : {ETCPLoggingOverflowPolicy::DropNewest, ETCPLoggingOverflowPolicy::DropOldest,
+			 ETCPLoggingOverflowPolicy::DropByPriority, ETCPLoggingOverflowPolicy::Block})
+	{
+		if (FCString::Stricmp(Text, LexToString(Policy)) == 0)
+		{
+			OutPolicy = Policy;
+			return true;
+		}
+	}
+	return false;
+}
+
+const TCHAR* LexToString(ETCPLoggingOverflowPolicy Policy)
+{
+	switch (Policy)
+	{
+		case ETCPLoggingOverflowPolicy::DropOldest:
+			return TEXT("dropoldest");
+		case ETCPLoggingOverflowPolicy::DropByPriority:
+			return TEXT("priority");
+		case ETCPLoggingOverflowPolicy::Block:
+			return TEXT("block");
+		default:
+			return TEXT("dropnewest");
+	}
+}
+
+/** A chunk takes messages until it holds about ChunkBytes, and never one it has no room for without reallocating */
+static bool HasRoom(const FTCPLoggingStagedChunk& Chunk, int32 ChunkBytes, int32 Size)
+{
+	return Chunk.Data.Num() < ChunkBytes && Chunk.Data.Num() + Size <= Chunk.Data.Max()
+		&& Chunk.MessageEnds.Num() < Chunk.MessageEnds.Max();
+}
+
+FTCPLoggingStaging::FTCPLoggingStaging(FTCPLoggingBufferPool& InBufferPool, int32 InChunkBytes, int32 InMaxStagedBytesPerThread,
+	int32 InMaxCriticalStagedBytesPerThread, ETCPLoggingOverflowPolicy InOverflowPolicy, double InOverflowBlockSeconds)
+	: BufferPool(InBufferPool)
+	, ChunkBytes(InChunkBytes)
+	, OverflowPolicy(InOverflowPolicy)
+	, OverflowBlockSeconds(InOverflowBlockSeconds)
+	, InstanceId(TCPLoggingThreadState::Register([this](void* Slot) { ReleaseSlot(static_cast<FSlot*>(Slot)); }))
+	, WakeEvent(FPlatformProcess::GetSynchEventFromPool(false))
+	, bWaiting(false)
+{
+	MaxStagedBytesPerThread[(int32) ETCPLoggingLane::Critical] = InMaxCriticalStagedBytesPerThread;
+	MaxStagedBytesPerThread[(int32) ETCPLoggingLane::Bulk] = InMaxStagedBytesPerThread;
+	for (std::atomic<uint64>& DroppedCount : DroppedCounts)
+	{
+		DroppedCount.store(0, std::memory_order_relaxed);
+	}
+}
+
+FTCPLoggingStaging::~FTCPLoggingStaging()
+{
+	TCPLoggingThreadState::Unregister(InstanceId);
+	FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+	WakeEvent = nullptr;
+}
+
+bool FTCPLoggingStaging::Stage(ETCPLoggingLane Lane, TFunctionRef<void(TArray<uint8>& Message)> Serialize)
+{
+	const int32 LaneIndex = (int32) Lane;
+	FSlot& Slot = GetSlot();
+	{
+		// Only this thread adds to its staged bytes, so a lane with room now still has it once the message is serialized
+		FScopeLock Lock(&Slot.Lock);
+		if (Slot.StagedBytes[LaneIndex] >= MaxStagedBytesPerThread[LaneIndex])
+		{
+			DroppedCounts[LaneIndex].fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+	}
+
+	// Serialized aside, the message's size decides which chunk it goes into since chunks never grow
+	TArray<uint8>& Message = Slot.Message;
+	Message.Reset();
+	Serialize(Message);
+	const int32 Size = Message.Num();
+	const bool bOversize = Size > BufferPool.GetChunkCapacity();
+
+	FTCPLoggingStagedChunk SpareChunk;
+	bool bHasSpareChunk = false;
+	for (;;)
+	{
+		FScopeLock Lock(&Slot.Lock);
+		TArray<FTCPLoggingStagedChunk>& Chunks = Slot.Chunks[LaneIndex];
+		if (bOversize || Chunks.Num() == 0 || !HasRoom(Chunks.Last(), ChunkBytes, Size))
+		{
+			if (!bHasSpareChunk)
+			{
+				// Reclaiming locks other slots, and blocking must not hold up the sender, so neither happens under ours
+				Lock.Unlock();
+				if (!(bOversize ? BufferPool.AcquireOversize(Size, SpareChunk) : AcquireChunk(Lane, SpareChunk)))
+				{
+					DroppedCounts[LaneIndex].fetch_add(1, std::memory_order_relaxed);
+					return false;
+				}
+				bHasSpareChunk = true;
+				continue;
+			}
+			FTCPLoggingStagedChunk& NewChunk = Chunks.Add_GetRef(MoveTemp(SpareChunk));
+			NewChunk.Lane = Lane;
+			NewChunk.FirstStagedCycles = FPlatformTime::Cycles64();
+		}
+		FTCPLoggingStagedChunk& Chunk = Chunks.Last();
+		Chunk.Data.Append(Message);
+		Chunk.MessageEnds.Add((uint32) Chunk.Data.Num());
+		Slot.StagedBytes[LaneIndex] += Size;
+		Slot.bHasMessages.store(true, std::memory_order_relaxed);
+		break;
+	}
+	if (bOversize)
+	{
+		Message.Empty();
+	}
+
+	// Pairs with the fence in WaitForMessages so either we see the sender waiting or it sees our message
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (bWaiting.load(std::memory_order_relaxed) && bWaiting.exchange(false, std::memory_order_acq_rel))
+	{
+		WakeEvent->Trigger();
+	}
+	return true;
+}
+
+void FTCPLoggingStaging::Collect(TArray<FTCPLoggingStagedChunk>& Out)
+{
+	FScopeLock SlotsScope(&SlotsLock);
+	int32 CriticalEnd = Out.Num();
+	bool bAnyExited = false;
+	for (const TUniquePtr<FSlot>& Slot : Slots)
+	{
+		bAnyExited |= Slot->bExited;
+		if (!Slot->bHasMessages.load(std::memory_order_relaxed))
+		{
+			continue;
+		}
+
+		FScopeLock Lock(&Slot->Lock);
+		for (FTCPLoggingStagedChunk& Chunk : Slot->Chunks[(int32) ETCPLoggingLane::Critical])
+		{
+			Out.Insert(MoveTemp(Chunk), CriticalEnd++);
+		}
+		for (FTCPLoggingStagedChunk& Chunk : Slot->Chunks[(int32) ETCPLoggingLane::Bulk])
+		{
+			Out.Add(MoveTemp(Chunk));
+		}
+		for (int32 Lane = 0; Lane < TCPLoggingNumLanes; ++Lane)
+		{
+			Slot->Chunks[Lane].Reset();
+			Slot->StagedBytes[Lane] = 0;
+		}
+		Slot->bHasMessages.store(false, std::memory_order_relaxed);
+	}
+
+	// Whatever the exited threads staged has just been collected
+	if (bAnyExited)
+	{
+		Slots.RemoveAll([](const TUniquePtr<FSlot>& Slot) { return Slot->bExited; });
+	}
+}
+
+void FTCPLoggingStaging::ReleaseChunk(FTCPLoggingStagedChunk&& Chunk)
+{
+	BufferPool.Release(MoveTemp(Chunk));
+}
+
+void FTCPLoggingStaging::Reset()
+{
+	TArray<FTCPLoggingStagedChunk> Discarded;
+	Collect(Discarded);
+	for (FTCPLoggingStagedChunk& Chunk : Discarded)
+	{
+		ReleaseChunk(MoveTemp(Chunk));
+	}
+}
+
+bool FTCPLoggingStaging::HasStaged() const
+{
+	FScopeLock SlotsScope(&SlotsLock);
+	for (const TUniquePtr<FSlot>& Slot : Slots)
+	{
+		if (Slot->bHasMessages.load(std::memory_order_relaxed))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void FTCPLoggingStaging::WaitForMessages(uint32 WaitMs, TFunctionRef<bool()> CanSleep)
+{
+	bWaiting.store(true, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	// A recording thread may have staged a message since the sender last collected
+	if (!HasStaged() && CanSleep())
+	{
+		WakeEvent->Wait(WaitMs);
+	}
+	bWaiting.store(false, std::memory_order_relaxed);
+}
+
+void FTCPLoggingStaging::Sleep(uint32 WaitMs)
+{
+	WakeEvent->Wait(WaitMs);
+}
+
+void FTCPLoggingStaging::Interrupt()
+{
+	WakeEvent->Trigger();
+}
+
+FTCPLoggingStaging::FSlot& FTCPLoggingStaging::GetSlot()
+{
+	if (void* Slot = TCPLoggingThreadState::Find(InstanceId))
+	{
+		return *static_cast<FSlot*>(Slot);
+	}
+
+	FSlot* Slot = nullptr;
+	{
+		FScopeLock Lock(&SlotsLock);
+		Slot = Slots.Add_GetRef(MakeUnique<FSlot>()).Get();
+	}
+	TCPLoggingThreadState::Add(InstanceId, Slot);
+	return *Slot;
+}
+
+void FTCPLoggingStaging::ReleaseSlot(FSlot* Slot)
+{
+	FScopeLock Lock(&SlotsLock);
+	Slot->bExited = true;
+}
+
+bool FTCPLoggingStaging::AcquireChunk(ETCPLoggingLane Lane, FTCPLoggingStagedChunk& OutChunk)
+{
+	if (BufferPool.Acquire(OutChunk))
+	{
+		return true;
+	}
+
+	// Critical messages are only ever dropped once no bulk chunk is left to give way for them
+	const bool bCritical = Lane == ETCPLoggingLane::Critical;
+	switch (OverflowPolicy)
+	{
+		case ETCPLoggingOverflowPolicy::DropOldest:
+			return ReclaimChunk(ETCPLoggingLane::Bulk, false, OutChunk) || (bCritical && ReclaimChunk(Lane, false, OutChunk));
+		case ETCPLoggingOverflowPolicy::DropByPriority:
+			return bCritical && ReclaimChunk(ETCPLoggingLane::Bulk, false, OutChunk);
+		case ETCPLoggingOverflowPolicy::Block:
+			return BufferPool.AcquireWithin(OutChunk, OverflowBlockSeconds)
+				|| (bCritical && ReclaimChunk(ETCPLoggingLane::Bulk, false, OutChunk));
+		default:
+			return bCritical && ReclaimChunk(ETCPLoggingLane::Bulk, true, OutChunk);
+	}
+}
+
+bool FTCPLoggingStaging::ReclaimChunk(ETCPLoggingLane Lane, bool bNewest, FTCPLoggingStagedChunk& OutChunk)
+{
+	const int32 LaneIndex = (int32) Lane;
+	// Holding SlotsLock keeps the sender from collecting, so the chunk found is still there when it is taken
+	FScopeLock SlotsScope(&SlotsLock);
+	FSlot* Found = nullptr;
+	uint64 FoundCycles = 0;
+	for (const TUniquePtr<FSlot>& Slot : Slots)
+	{
+		if (!Slot->bHasMessages.load(std::memory_order_relaxed))
+		{
+			continue;
+		}
+		FScopeLock Lock(&Slot->Lock);
+		const TArray<FTCPLoggingStagedChunk>& Chunks = Slot->Chunks[LaneIndex];
+		if (Chunks.Num() == 0)
+		{
+			continue;
+		}
+		const uint64 Cycles = bNewest ? Chunks.Last().FirstStagedCycles : Chunks[0].FirstStagedCycles;
+		if (Found == nullptr || (bNewest ? Cycles > FoundCycles : Cycles < FoundCycles))
+		{
+			Found = Slot.Get();
+			FoundCycles = Cycles;
+		}
+	}
+	if (Found == nullptr)
+	{
+		return false;
+	}
+
+	{
+		FScopeLock Lock(&Found->Lock);
+		TArray<FTCPLoggingStagedChunk>& Chunks = Found->Chunks[LaneIndex];
+		const int32 Index = bNewest ? Chunks.Num() - 1 : 0;
+		OutChunk = MoveTemp(Chunks[Index]);
+		Chunks.RemoveAt(Index, 1, false);
+		Found->StagedBytes[LaneIndex] -= OutChunk.Data.Num();
+	}
+	const int32 DroppedEvents = OutChunk.MessageEnds.Num();
+	DroppedCounts[LaneIndex].fetch_add(DroppedEvents, std::memory_order_relaxed);
+	INC_DWORD_STAT_BY(STAT_TCPLogging_EventsDropped, DroppedEvents);
+	if (Lane == ETCPLoggingLane::Critical)
+	{
+		INC_DWORD_STAT_BY(STAT_TCPLogging_CriticalEventsDropped, DroppedEvents);
+	}
+	OutChunk.Data.Reset();
+	OutChunk.MessageEnds.Reset();
+	return true;
+}
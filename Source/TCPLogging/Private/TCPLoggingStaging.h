@@ -0,0 +1,141 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "TCPLoggingBufferPool.h"
+#include "TCPLoggingLane.h"
+#include "Templates/Function.h"
+#include "Templates/UniquePtr.h"
+
+#include <atomic>
+
+class FEvent;
+
+/**
+ * What recording does once the staging budget's slab has no free chunk left. Whatever the policy, staged bulk chunks
+ * give way before any critical message is dropped
+ */
+enum class ETCPLoggingOverflowPolicy : uint8
+{
+	/** The new message is dropped, a critical one drops the newest staged bulk chunk instead */
+	DropNewest,
+	/**
+	 * The oldest staged bulk chunk is dropped, on whichever thread staged it. A critical message drops the oldest staged
+	 * critical chunk if there is no bulk one, a bulk message is dropped itself
+	 */
+	DropOldest,
+	/** A critical message drops the oldest staged bulk chunk, a bulk one is dropped itself */
+	DropByPriority,
+	/**
+	 * The recording thread waits for the sender to free a chunk, up to a timeout, then drops the new message. A critical
+	 * one drops the oldest staged bulk chunk instead
+	 */
+	Block,
+};
+
+/** Parses the TCPLoggingOverflowPolicy config value ("dropnewest", "dropoldest", "priority" or "block") */
+bool LexTryParseString(ETCPLoggingOverflowPolicy& OutPolicy, const TCHAR* Text);
+const TCHAR* LexToString(ETCPLoggingOverflowPolicy Policy);
+
+/**
+ * Hands serialized messages from any number of recording threads to the sender.
+ * Every recording thread serializes into a message buffer of its own and appends the message to staging chunks of its
+ * own, guarded by a lock only the sender ever competes for, so recording threads never contend with each other however
+ * many there are. A chunk is never grown, a message that does not fit goes into the next one, and one too big for any
+ * chunk into an oversize chunk of its own. The sender collects whole chunks, which keeps the messages of each thread and
+ * lane in order; there is no order between threads.
+ *
+ * Every lane of a thread has a budget of its own, so a thread flooding bulk events still stages its critical ones.
+ * When the buffer pool is a slab it also bounds what all threads stage together, the overflow policy decides what gives
+ * way once it is used up.
+ *
+ * Also carries the sender's wake up signal, so recording never touches the sender itself and stays safe while a session
+ * is being started or ended on another thread.
+ */
+class FTCPLoggingStaging
+{
+public:
+	FTCPLoggingStaging(FTCPLoggingBufferPool& InBufferPool, int32 InChunkBytes, int32 InMaxStagedBytesPerThread,
+		int32 InMaxCriticalStagedBytesPerThread, ETCPLoggingOverflowPolicy InOverflowPolicy = ETCPLoggingOverflowPolicy::DropNewest,
+		double InOverflowBlockSeconds = 0.0);
+	~FTCPLoggingStaging();
+
+	UE_NONCOPYABLE(FTCPLoggingStaging);
+
+	/**
+	 * Runs Serialize on the calling thread's message buffer, which it must append exactly one message to.
+	 * Returns false without calling it if this thread already has too much waiting for the sender in that lane, or the
+	 * slab is used up and the overflow policy drops the new message.
+	 */
+	bool Stage(ETCPLoggingLane Lane, TFunctionRef<void(TArray<uint8>& Message)> Serialize);
+
+	/** Moves every staged chunk into Out, the critical ones of every thread first, grouped by thread. Called by the sender */
+	void Collect(TArray<FTCPLoggingStagedChunk>& Out);
+
+	/** Hands a collected chunk's buffer back for the recording threads to reuse */
+	void ReleaseChunk(FTCPLoggingStagedChunk&& Chunk);
+
+	/** Discards everything staged, e.g. left over from recording that raced the end of the last session */
+	void Reset();
+
+	/** True if any thread has staged messages */
+	bool HasStaged() const;
+
+	/** Sleeps the sender until a message is staged, Interrupt is called or WaitMs pass. CanSleep is checked last */
+	void WaitForMessages(uint32 WaitMs, TFunctionRef<bool()> CanSleep);
+
+	/** Sleeps the sender for WaitMs without waking up for staged messages, only Interrupt cuts it short */
+	void Sleep(uint32 WaitMs);
+
+	/** Wakes the sender whether or not it waits for messages */
+	void Interrupt();
+
+	/** Number of messages rejected because their thread had too much staged, or dropped by the overflow policy */
+	uint64 GetDroppedCount() const
+	{
+		return GetDroppedCount(ETCPLoggingLane::Critical) + GetDroppedCount(ETCPLoggingLane::Bulk);
+	}
+
+	uint64 GetDroppedCount(ETCPLoggingLane Lane) const
+	{
+		return DroppedCounts[(int32) Lane].load(std::memory_order_relaxed);
+	}
+
+private:
+	struct FSlot;
+
+	/** Slot of the calling thread, created on its first use */
+	FSlot& GetSlot();
+
+	/** The thread owning Slot exited, it is freed once the sender has collected what is left in it */
+	void ReleaseSlot(FSlot* Slot);
+
+	/** Gets an empty chunk for a message of Lane, applying the overflow policy if the slab is used up */
+	bool AcquireChunk(ETCPLoggingLane Lane, FTCPLoggingStagedChunk& OutChunk);
+
+	/**
+	 * Takes the oldest (or newest) chunk of Lane staged by any thread, counting its messages as dropped, and hands it out
+	 * emptied. Must not be called while holding a slot lock
+	 */
+	bool ReclaimChunk(ETCPLoggingLane Lane, bool bNewest, FTCPLoggingStagedChunk& OutChunk);
+
+	FTCPLoggingBufferPool& BufferPool;
+	const int32 ChunkBytes;
+	/** Budget of each lane, indexed by ETCPLoggingLane */
+	int32 MaxStagedBytesPerThread[TCPLoggingNumLanes];
+	const ETCPLoggingOverflowPolicy OverflowPolicy;
+	const double OverflowBlockSeconds;
+	/** Id the threads know this instance by in TCPLoggingThreadState, addresses may be reused */
+	const uint32 InstanceId;
+
+	/** Guards Slots, taken once per thread, when a thread exits and whenever the sender collects */
+	mutable FCriticalSection SlotsLock;
+	TArray<TUniquePtr<FSlot>> Slots;
+
+	FEvent* WakeEvent;
+	/** Set while the sender is (about to be) waiting for messages so recording threads only trigger WakeEvent when needed */
+	std::atomic<bool> bWaiting;
+	std::atomic<uint64> DroppedCounts[TCPLoggingNumLanes];
+};
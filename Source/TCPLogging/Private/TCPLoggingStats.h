@@ -0,0 +1,34 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "Stats/Stats.h"
+
+/**
+ * Cost and throughput of the analytics pipeline, visible through "stat TCPLogging", the CSV profiler (category
+ * TCPLogging) and Unreal Insights. Counters are per frame, the others hold their latest value.
+ */
+DECLARE_STATS_GROUP(TEXT("TCPLogging"), STATGROUP_TCPLogging, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Serialize Event"), STAT_TCPLogging_SerializeEvent, STATGROUP_TCPLogging, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Sender Batch"), STAT_TCPLogging_SendBatch, STATGROUP_TCPLogging, );
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Events Recorded"), STAT_TCPLogging_EventsRecorded, STATGROUP_TCPLogging, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Events Sent"), STAT_TCPLogging_EventsSent, STATGROUP_TCPLogging, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Events Dropped"), STAT_TCPLogging_EventsDropped, STATGROUP_TCPLogging, );
+/** The critical lane's share of the three above */
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Critical Events Recorded"), STAT_TCPLogging_CriticalEventsRecorded, STATGROUP_TCPLogging, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Critical Events Sent"), STAT_TCPLogging_CriticalEventsSent, STATGROUP_TCPLogging, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Critical Events Dropped"), STAT_TCPLogging_CriticalEventsDropped, STATGROUP_TCPLogging, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bytes Sent"), STAT_TCPLogging_BytesSent, STATGROUP_TCPLogging, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Send Calls"), STAT_TCPLogging_SendCalls, STATGROUP_TCPLogging, );
+
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Staged Events"), STAT_TCPLogging_StagedEvents, STATGROUP_TCPLogging, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Buffered Bytes"), STAT_TCPLogging_BufferedBytes, STATGROUP_TCPLogging, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Reconnects"), STAT_TCPLogging_Reconnects, STATGROUP_TCPLogging, );
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Record To Wire (ms)"), STAT_TCPLogging_RecordToWireMs, STATGROUP_TCPLogging, );
+
+CSV_DECLARE_CATEGORY_EXTERN(TCPLogging);
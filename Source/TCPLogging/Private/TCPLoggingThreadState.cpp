@@ -0,0 +1,90 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "TCPLoggingThreadState.h"
+
+#include "HAL/CriticalSection.h"
+#include "Misc/ScopeLock.h"
+
+#include <atomic>
+
+namespace TCPLoggingThreadState
+{
+	struct FRegistry
+	{
+		FCriticalSection Lock;
+		TMap<uint32, TFunction<void(void*)>> Owners;
+		std::atomic<uint32> NextOwnerId{1};
+	};
+
+	/** Never destroyed, threads may exit after static destruction has started */
+	static FRegistry& GetRegistry()
+	{
+		static FRegistry* Registry = new FRegistry();
+		return *Registry;
+	}
+
+	struct FThreadStates
+	{
+		struct FEntry
+		{
+			uint32 OwnerId;
+			void* State;
+		};
+		/** Most recently added first */
+		TArray<FEntry, TInlineAllocator<8>> Entries;
+
+		~FThreadStates()
+		{
+			FRegistry& Registry = GetRegistry();
+			FScopeLock Lock(&Registry.Lock);
+			for (const FEntry& Entry : Entries)
+			{
+				if (const TFunction<void(void*)>* OnThreadExit = Registry.Owners.Find(Entry.OwnerId))
+				{
+					(*OnThreadExit)(Entry.State);
+				}
+			}
+		}
+	};
+	static thread_local FThreadStates ThreadStates;
+
+	uint32 Register(TFunction<void(void* State)>&& OnThreadExit)
+	{
+		FRegistry& Registry = GetRegistry();
+		const uint32 OwnerId = Registry.NextOwnerId.fetch_add(1, std::memory_order_relaxed);
+		FScopeLock Lock(&Registry.Lock);
+		Registry.Owners.Add(OwnerId, MoveTemp(OnThreadExit));
+		return OwnerId;
+	}
+
+	void Unregister(uint32 OwnerId)
+	{
+		FRegistry& Registry = GetRegistry();
+		FScopeLock Lock(&Registry.Lock);
+		Registry.Owners.Remove(OwnerId);
+	}
+
+	void* Find(uint32 OwnerId)
+	{
+		for (const FThreadStates::FEntry& Entry : ThreadStates.Entries)
+		{
+			if (Entry.OwnerId == OwnerId)
+			{
+				return Entry.State;
+			}
+		}
+		return nullptr;
+	}
+
+	void Add(uint32 OwnerId, void* State)
+	{
+		// Owners are created far less often than threads record, so entries of unregistered ones are pruned here
+		TArray<FThreadStates::FEntry, TInlineAllocator<8>>& Entries = ThreadStates.Entries;
+		{
+			FRegistry& Registry = GetRegistry();
+			FScopeLock Lock(&Registry.Lock);
+			Entries.RemoveAll([&Registry](const FThreadStates::FEntry& Entry) { return !Registry.Owners.Contains(Entry.OwnerId); });
+		}
+		Entries.Insert(FThreadStates::FEntry{OwnerId, State}, 0);
+	}
+}
@@ -0,0 +1,32 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Templates/Function.h"
+
+/**
+ * Per thread lookup of the state a thread keeps in an owner, like its staging slot or metrics shard, for any number of
+ * owners at once. Every thread holds a small array of (owner id, state) pairs, so recording into several providers
+ * never falls back to the owner's lock after the first call.
+ *
+ * When a thread exits, every owner it has state in that is still registered gets OnThreadExit called with that state,
+ * on the exiting thread, and frees it once nothing refers to it anymore.
+ */
+namespace TCPLoggingThreadState
+{
+	/**
+	 * Registers an owner, returns its id, unique for the lifetime of the process. OnThreadExit is called under the
+	 * registry lock, so it must not call back into the registry, and Unregister waits for calls in progress.
+	 */
+	uint32 Register(TFunction<void(void* State)>&& OnThreadExit);
+
+	/** Must be called before the owner's states are destroyed, no OnThreadExit call starts afterwards */
+	void Unregister(uint32 OwnerId);
+
+	/** State the calling thread added for OwnerId, or null */
+	void* Find(uint32 OwnerId);
+
+	/** Remembers State as the calling thread's for OwnerId, which must not have one yet */
+	void Add(uint32 OwnerId, void* State);
+}
@@ -0,0 +1,327 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "TCPLoggingUtf8.h"
+
+#if PLATFORM_ENABLE_VECTORINTRINSICS_NEON
+#define TCPLOGGING_UTF8_NEON 1
+#define TCPLOGGING_UTF8_SSE2 0
+#include <arm_neon.h>
+#elif PLATFORM_ENABLE_VECTORINTRINSICS && PLATFORM_CPU_X86_FAMILY
+#define TCPLOGGING_UTF8_NEON 0
+#define TCPLOGGING_UTF8_SSE2 1
+#include <emmintrin.h>
+#else
+#define TCPLOGGING_UTF8_NEON 0
+#define TCPLOGGING_UTF8_SSE2 0
+#endif
+
+/** Most UTF-8 bytes a single TCHAR code unit can expand to */
+static constexpr int32 MaxUtf8BytesPerTChar = sizeof(TCHAR) == 4 ? 4 : 3;
+
+/** Longest escape, \u00XX for a control character */
+static constexpr int32 MaxEscapeBytes = 6;
+
+/** Characters checked per vector step, which also stores this many bytes whether or not all of them are kept */
+static constexpr int32 VectorWidth = 16;
+
+static FORCEINLINE bool NeedsEscape(uint32 Char)
+{
+	return Char < 0x20 || Char == '"' || Char == '\\';
+}
+
+static FORCEINLINE uint8* WriteEscape(uint8* Out, uint32 Char)
+{
+	static const ANSICHAR HexDigits[] = "0123456789abcdef";
+	*Out++ = '\\';
+	switch (Char)
+	{
+		case '"':
+		case '\\':
+			*Out++ = (uint8) Char;
+			break;
+		case '\n':
+			*Out++ = 'n';
+			break;
+		case '\r':
+			*Out++ = 'r';
+			break;
+		case '\t':
+			*Out++ = 't';
+			break;
+		case '\b':
+			*Out++ = 'b';
+			break;
+		case '\f':
+			*Out++ = 'f';
+			break;
+		default:
+			*Out++ = 'u';
+			*Out++ = '0';
+			*Out++ = '0';
+			*Out++ = (uint8) HexDigits[Char >> 4];
+			*Out++ = (uint8) HexDigits[Char & 0xF];
+			break;
+	}
+	return Out;
+}
+
+/** Encodes the non-ASCII code unit at Text[Index], and the low surrogate following it if they pair, advancing Index */
+static FORCEINLINE uint8* WriteCodePoint(uint8* Out, const TCHAR* Text, int32 Len, int32& Index)
+{
+	uint32 CodePoint = (uint32) Text[Index++];
+	if (CodePoint >= 0xD800 && CodePoint <= 0xDBFF && Index < Len)
+	{
+		const uint32 Low = (uint32) Text[Index];
+		if (Low >= 0xDC00 && Low <= 0xDFFF)
+		{
+			CodePoint = 0x10000 + ((CodePoint - 0xD800) << 10) + (Low - 0xDC00);
+			++Index;
+		}
+	}
+	if ((CodePoint >= 0xD800 && CodePoint <= 0xDFFF) || CodePoint > 0x10FFFF)
+	{
+		// Unpaired surrogate or out of range, emit U+FFFD rather than invalid UTF-8
+		CodePoint = 0xFFFD;
+	}
+
+	if (CodePoint < 0x800)
+	{
+		*Out++ = (uint8) (0xC0 | (CodePoint >> 6));
+		*Out++ = (uint8) (0x80 | (CodePoint & 0x3F));
+	}
+	else if (CodePoint < 0x10000)
+	{
+		*Out++ = (uint8) (0xE0 | (CodePoint >> 12));
+		*Out++ = (uint8) (0x80 | ((CodePoint >> 6) & 0x3F));
+		*Out++ = (uint8) (0x80 | (CodePoint & 0x3F));
+	}
+	else
+	{
+		*Out++ = (uint8) (0xF0 | (CodePoint >> 18));
+		*Out++ = (uint8) (0x80 | ((CodePoint >> 12) & 0x3F));
+		*Out++ = (uint8) (0x80 | ((CodePoint >> 6) & 0x3F));
+		*Out++ = (uint8) (0x80 | (CodePoint & 0x3F));
+	}
+	return Out;
+}
+
+/**
+ * Narrows the leading TCHARs that are ASCII and need no escaping into Out, VectorWidth at a time, and returns how many
+ * there were. Stops at the first vector holding anything else, the caller takes it from there one character at a time.
+ * May write up to VectorWidth bytes past what it returns.
+ */
+static FORCEINLINE int32 CopyPlainAscii(const TCHAR* Text, int32 Len, uint8* Out)
+{
+	int32 Index = 0;
+	if constexpr (sizeof(TCHAR) == 2)
+	{
+#if TCPLOGGING_UTF8_SSE2
+		const __m128i Space = _mm_set1_epi8(0x20);
+		const __m128i Quote = _mm_set1_epi8('"');
+		const __m128i Backslash = _mm_set1_epi8('\\');
+		for (; Index + VectorWidth <= Len; Index += VectorWidth)
+		{
+			const __m128i Low = _mm_loadu_si128((const __m128i*) (Text + Index));
+			const __m128i High = _mm_loadu_si128((const __m128i*) (Text + Index + 8));
+			// Units from 0x80 saturate to 0x80-0xFF, negative as signed bytes, and those from 0x8000 to zero, so the
+			// signed compare against a space catches them along with the control characters
+			const __m128i Bytes = _mm_packus_epi16(Low, High);
+			const __m128i Special = _mm_or_si128(_mm_cmplt_epi8(Bytes, Space),
+				_mm_or_si128(_mm_cmpeq_epi8(Bytes, Quote), _mm_cmpeq_epi8(Bytes, Backslash)));
+			_mm_storeu_si128((__m128i*) (Out + Index), Bytes);
+			const uint32 Mask = (uint32) _mm_movemask_epi8(Special);
+			if (Mask != 0)
+			{
+				return Index + (int32) FMath::CountTrailingZeros(Mask);
+			}
+		}
+#elif TCPLOGGING_UTF8_NEON
+		const uint8x16_t Space = vdupq_n_u8(0x20);
+		const uint8x16_t Delete = vdupq_n_u8(0x7F);
+		const uint8x16_t Quote = vdupq_n_u8('"');
+		const uint8x16_t Backslash = vdupq_n_u8('\\');
+		for (; Index + VectorWidth <= Len; Index += VectorWidth)
+		{
+			const uint16x8_t Low = vld1q_u16((const uint16*) (Text + Index));
+			const uint16x8_t High = vld1q_u16((const uint16*) (Text + Index + 8));
+			// Units from 0x100 saturate to 0xFF, which fails the ASCII check like everything from 0x80
+			const uint8x16_t Bytes = vcombine_u8(vqmovn_u16(Low), vqmovn_u16(High));
+			const uint8x16_t Special = vorrq_u8(vorrq_u8(vcltq_u8(Bytes, Space), vcgtq_u8(Bytes, Delete)),
+				vorrq_u8(vceqq_u8(Bytes, Quote), vceqq_u8(Bytes, Backslash)));
+			vst1q_u8(Out + Index, Bytes);
+			// Four bits per byte, NEON has no movemask
+			const uint64 Mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(Special), 4)), 0);
+			if (Mask != 0)
+			{
+				return Index + (int32) (FMath::CountTrailingZeros64(Mask) >> 2);
+			}
+		}
+#endif
+	}
+	return Index;
+}
+
+/** CopyPlainAscii for text that is UTF-8 already, where bytes from 0x80 are copied as they are */
+static FORCEINLINE int32 CopyPlainUtf8(const uint8* Text, int32 Len, uint8* Out)
+{
+	int32 Index = 0;
+#if TCPLOGGING_UTF8_SSE2
+	const __m128i LastControl = _mm_set1_epi8(0x1F);
+	const __m128i Quote = _mm_set1_epi8('"');
+	const __m128i Backslash = _mm_set1_epi8('\\');
+	for (; Index + VectorWidth <= Len; Index += VectorWidth)
+	{
+		const __m128i Bytes = _mm_loadu_si128((const __m128i*) (Text + Index));
+		// Unsigned Bytes <= 0x1F, SSE2 only compares signed
+		const __m128i Control = _mm_cmpeq_epi8(_mm_min_epu8(Bytes, LastControl), Bytes);
+		const __m128i Special =
+			_mm_or_si128(Control, _mm_or_si128(_mm_cmpeq_epi8(Bytes, Quote), _mm_cmpeq_epi8(Bytes, Backslash)));
+		_mm_storeu_si128((__m128i*) (Out + Index), Bytes);
+		const uint32 Mask = (uint32) _mm_movemask_epi8(Special);
+		if (Mask != 0)
+		{
+			return Index + (int32) FMath::CountTrailingZeros(Mask);
+		}
+	}
+#elif TCPLOGGING_UTF8_NEON
+	const uint8x16_t Space = vdupq_n_u8(0x20);
+	const uint8x16_t Quote = vdupq_n_u8('"');
+	const uint8x16_t Backslash = vdupq_n_u8('\\');
+	for (; Index + VectorWidth <= Len; Index += VectorWidth)
+	{
+		const uint8x16_t Bytes = vld1q_u8(Text + Index);
+		const uint8x16_t Special =
+			vorrq_u8(vcltq_u8(Bytes, Space), vorrq_u8(vceqq_u8(Bytes, Quote), vceqq_u8(Bytes, Backslash)));
+		vst1q_u8(Out + Index, Bytes);
+		const uint64 Mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(Special), 4)), 0);
+		if (Mask != 0)
+		{
+			return Index + (int32) (FMath::CountTrailingZeros64(Mask) >> 2);
+		}
+	}
+#endif
+	return Index;
+}
+
+/**
+ * Makes sure Out has room for an escape plus the worst case of the Remaining characters after it, at BytesPerChar
+ * each. Room for every character's worst case without escapes is added up front, so only escapes ever grow the buffer.
+ */
+static FORCEINLINE uint8* ReserveEscape(TArray<uint8>& Buffer, uint8* Out, int32 Remaining, int32 BytesPerChar)
+{
+	const int32 Used = (int32) (Out - Buffer.GetData());
+	const int32 Needed = MaxEscapeBytes + Remaining * BytesPerChar + VectorWidth;
+	if (Buffer.Num() - Used < Needed)
+	{
+		Buffer.AddUninitialized(Needed - (Buffer.Num() - Used));
+	}
+	return Buffer.GetData() + Used;
+}
+
+template <bool bVectorize>
+static void AppendJsonEscaped(TArray<uint8>& Buffer, const TCHAR* Text, int32 Len)
+{
+	const int32 Start = Buffer.Num();
+	Buffer.AddUninitialized(Len * MaxUtf8BytesPerTChar + VectorWidth);
+	uint8* Out = Buffer.GetData() + Start;
+
+	int32 Index = 0;
+	while (Index < Len)
+	{
+		if constexpr (bVectorize)
+		{
+			const int32 Plain = CopyPlainAscii(Text + Index, Len - Index, Out);
+			Index += Plain;
+			Out += Plain;
+			if (Index == Len)
+			{
+				break;
+			}
+		}
+
+		const uint32 Char = (uint32) Text[Index];
+		if (Char >= 0x80)
+		{
+			Out = WriteCodePoint(Out, Text, Len, Index);
+		}
+		else if (NeedsEscape(Char))
+		{
+			Out = WriteEscape(ReserveEscape(Buffer, Out, Len - Index - 1, MaxUtf8BytesPerTChar), Char);
+			++Index;
+		}
+		else
+		{
+			*Out++ = (uint8) Char;
+			++Index;
+		}
+	}
+
+	Buffer.SetNumUninitialized((int32) (Out - Buffer.GetData()), false);
+}
+
+void TCPLoggingAppendUtf8(TArray<uint8>& Buffer, const TCHAR* Text, int32 Len)
+{
+	const int32 Start = Buffer.Num();
+	Buffer.AddUninitialized(Len * MaxUtf8BytesPerTChar);
+	uint8* Out = Buffer.GetData() + Start;
+
+	int32 Index = 0;
+	while (Index < Len)
+	{
+		const uint32 Char = (uint32) Text[Index];
+		if (Char < 0x80)
+		{
+			*Out++ = (uint8) Char;
+			++Index;
+		}
+		else
+		{
+			Out = WriteCodePoint(Out, Text, Len, Index);
+		}
+	}
+
+	Buffer.SetNumUninitialized((int32) (Out - Buffer.GetData()), false);
+}
+
+void TCPLoggingAppendJsonEscaped(TArray<uint8>& Buffer, const TCHAR* Text, int32 Len)
+{
+	AppendJsonEscaped<true>(Buffer, Text, Len);
+}
+
+void TCPLoggingAppendJsonEscapedScalar(TArray<uint8>& Buffer, const TCHAR* Text, int32 Len)
+{
+	AppendJsonEscaped<false>(Buffer, Text, Len);
+}
+
+void TCPLoggingAppendJsonEscaped(TArray<uint8>& Buffer, FAnsiStringView Utf8)
+{
+	const uint8* Text = (const uint8*) Utf8.GetData();
+	const int32 Len = Utf8.Len();
+	const int32 Start = Buffer.Num();
+	Buffer.AddUninitialized(Len + VectorWidth);
+	uint8* Out = Buffer.GetData() + Start;
+
+	int32 Index = 0;
+	while (Index < Len)
+	{
+		const int32 Plain = CopyPlainUtf8(Text + Index, Len - Index, Out);
+		Index += Plain;
+		Out += Plain;
+		if (Index == Len)
+		{
+			break;
+		}
+
+		const uint32 Byte = Text[Index++];
+		if (NeedsEscape(Byte))
+		{
+			Out = WriteEscape(ReserveEscape(Buffer, Out, Len - Index, 1), Byte);
+		}
+		else
+		{
+			*Out++ = (uint8) Byte;
+		}
+	}
+
+	Buffer.SetNumUninitialized((int32) (Out - Buffer.GetData()), false);
+}
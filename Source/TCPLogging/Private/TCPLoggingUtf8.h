@@ -0,0 +1,25 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "Containers/StringView.h"
+#include "CoreMinimal.h"
+
+/**
+ * Appends Len TCHARs to Buffer as UTF-8, combining surrogate pairs and replacing anything unencodable with U+FFFD.
+ * Grows the buffer once up front for the worst case, so it never reallocates per character.
+ */
+void TCPLoggingAppendUtf8(TArray<uint8>& Buffer, const TCHAR* Text, int32 Len);
+
+/**
+ * Appends Len TCHARs to Buffer as the UTF-8 contents of a JSON string, escaping quotes, backslashes and control
+ * characters in the same pass. Runs of ASCII with nothing to escape, nearly all analytics text, are checked and
+ * narrowed 16 characters at a time with SSE2 or NEON where available.
+ */
+void TCPLoggingAppendJsonEscaped(TArray<uint8>& Buffer, const TCHAR* Text, int32 Len);
+
+/** The same for text that is UTF-8 already, e.g. strings decoded from the binary protocol */
+void TCPLoggingAppendJsonEscaped(TArray<uint8>& Buffer, FAnsiStringView Utf8);
+
+/** One character at a time version of the TCHAR overload, the reference the benchmark commandlet measures against */
+void TCPLoggingAppendJsonEscapedScalar(TArray<uint8>& Buffer, const TCHAR* Text, int32 Len);
@@ -6,6 +6,7 @@
 #include "Interfaces/IAnalyticsProviderModule.h"
 #include "Modules/ModuleManager.h"
 
+class FTCPLoggingMetrics;
 class IAnalyticsProvider;
 
 /**
@@ -41,6 +42,13 @@ public:
 	virtual TSharedPtr<IAnalyticsProvider> CreateAnalyticsProvider(
 		const FAnalyticsProviderConfigurationDelegate& GetConfigValue) const override;
 
+	/**
+	 * Metrics aggregation of the shared default provider, see TCPLoggingMetrics.h.
+	 *
+	 * @return Returns null until the default provider has been created
+	 */
+	static FTCPLoggingMetrics* GetMetrics();
+
 private:
 	virtual void StartupModule() override;
 	virtual void ShutdownModule() override;
@@ -0,0 +1,125 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "Containers/ArrayView.h"
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "Templates/Function.h"
+#include "Templates/UniquePtr.h"
+
+#include <atomic>
+
+/** One dimension of a metric, e.g. Map=Arena or Weapon=Rifle */
+struct FTCPLoggingMetricTag
+{
+	FName Key;
+	FName Value;
+
+	bool operator==(const FTCPLoggingMetricTag& Other) const
+	{
+		return Key == Other.Key && Value == Other.Value;
+	}
+};
+
+enum class ETCPLoggingMetricType : uint8
+{
+	/** Sum of every increment in the interval */
+	Counter,
+	/** Last value set in the interval */
+	Gauge,
+	/** Distribution of every recorded value in the interval */
+	Histogram,
+};
+
+/** Aggregated value of one metric over one interval */
+struct FTCPLoggingMetricSnapshot
+{
+	FName Name;
+	TArray<FTCPLoggingMetricTag> Tags;
+	ETCPLoggingMetricType Type = ETCPLoggingMetricType::Counter;
+
+	/** Counter total, or number of histogram samples */
+	int64 Count = 0;
+	/** Gauge value, or sum of histogram samples */
+	double Value = 0.0;
+
+	/** Histogram only. Percentiles are accurate to the bucket width, about 3% of the value */
+	double Min = 0.0;
+	double Max = 0.0;
+	double P50 = 0.0;
+	double P90 = 0.0;
+	double P99 = 0.0;
+	double P999 = 0.0;
+};
+
+/**
+ * Aggregates counters, gauges and histograms in memory so that high frequency measurements go out as one summary per
+ * interval rather than one event per occurrence. Keys are a name plus a small tag set, the order of tags does not matter.
+ *
+ * Every recording thread writes to a shard of its own, so recording only takes an uncontended lock. Shards are merged
+ * when the interval is collected, which happens on whichever recording call first notices it elapsed, or on Flush.
+ *
+ * Histograms are log-linear in the style of HDR histograms: 16 buckets per power of two between 2^-16 and 2^48,
+ * so any positive value is bucketed with a bounded relative error. Zero and negative values share one bucket.
+ */
+class TCPLOGGING_API FTCPLoggingMetrics
+{
+public:
+	/** Receives the metrics of one interval, along with how long the interval was */
+	using FSink = TFunction<void(TArray<FTCPLoggingMetricSnapshot>&& Metrics, double IntervalSeconds)>;
+
+	FTCPLoggingMetrics(double InIntervalSeconds, FSink&& InSink);
+	~FTCPLoggingMetrics();
+
+	/** Adds Delta to a counter. Safe to call from any thread */
+	void AddCounter(FName Name, int64 Delta = 1, TArrayView<const FTCPLoggingMetricTag> Tags = {});
+
+	/** Sets a gauge, the latest value across all threads wins. Safe to call from any thread */
+	void SetGauge(FName Name, double Value, TArrayView<const FTCPLoggingMetricTag> Tags = {});
+
+	/** Adds a sample to a histogram. Safe to call from any thread */
+	void RecordHistogram(FName Name, double Value, TArrayView<const FTCPLoggingMetricTag> Tags = {});
+
+	/** Hands everything aggregated so far to the sink and starts a new interval, whether or not paused */
+	void Flush();
+
+	/**
+	 * While paused, elapsed intervals are not flushed and keep aggregating into the next one, e.g. while the sink has
+	 * nowhere to send them. A flush in progress completes before this returns, none starts on its own afterwards
+	 */
+	void SetPaused(bool bInPaused);
+
+private:
+	struct FKey;
+	struct FValue;
+	struct FShard;
+
+	/** Shard of the calling thread, created on its first use */
+	FShard& GetShard();
+
+	/** The thread owning Shard exited, it is freed once the next flush has merged it */
+	void ReleaseShard(FShard* Shard);
+
+	/** Flushes if the interval has elapsed and not paused, only one thread wins when several race */
+	void FlushIfDue();
+
+	/** Flush with FlushLock held */
+	void FlushLocked();
+
+	const double IntervalSeconds;
+	FSink Sink;
+	/** Id the threads know this instance by in TCPLoggingThreadState, addresses may be reused */
+	const uint32 InstanceId;
+
+	/** Guards Shards, taken once per thread, when a thread exits and on every flush */
+	FCriticalSection ShardsLock;
+	TArray<TUniquePtr<FShard>> Shards;
+
+	/** Serializes flushes so intervals are reported in order */
+	FCriticalSection FlushLock;
+	std::atomic<uint64> NextFlushCycles;
+	uint64 IntervalStartCycles;
+	/** Guarded by FlushLock */
+	bool bPaused;
+};
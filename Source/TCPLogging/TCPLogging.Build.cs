@@ -1,5 +1,7 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
+using System.IO;
+
 namespace UnrealBuildTool.Rules
 {
     public class TCPLogging : ModuleRules
@@ -22,11 +24,23 @@ namespace UnrealBuildTool.Rules
                 new string[]
                 {
                     "Analytics",
+                    "Json",
 					// ... add private dependencies that you statically link with here ...
 				}
                 );
 
             PublicIncludePathModuleNames.Add("Analytics");
+
+            // Batches leave in one sendmsg on Linux, which needs the native handle behind the engine's BSD sockets.
+            // Sockets/Private is only used for FSocketBSD::GetNativeSocket, a stable accessor the engine's own BSD
+            // based subsystems rely on. The writer checks the subsystem at runtime before casting and falls back to
+            // FSocket::Send otherwise, so a platform whose sockets are not FSocketBSD only loses the vectored send
+            bool bVectoredSend = Target.IsInPlatformGroup(UnrealPlatformGroup.Linux);
+            if (bVectoredSend)
+            {
+                PrivateIncludePaths.Add(Path.Combine(EngineDirectory, "Source", "Runtime", "Sockets", "Private"));
+            }
+            PrivateDefinitions.Add("TCPLOGGING_VECTORED_SEND=" + (bVectoredSend ? "1" : "0"));
         }
     }
 }